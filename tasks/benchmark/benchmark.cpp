@@ -0,0 +1,336 @@
+/*
+ * Benchmark harness for all tasks
+ *
+ * Runs the task binaries over grids of inputs and thread counts (MAX_CPUS), measures the wall
+ * time of every run from fork() to the exit of the process and reports median and percentiles,
+ * the speedup over one thread, the parallel fraction per thread count ("% parallel code" of the
+ * READMEs) and a least squares Amdahl fit. The results can be written as JSON and compared to
+ * a stored baseline. See README.md for the options.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "json.h"
+#include "process.h"
+#include "split.h"
+#include "../common/topology.h"
+#include "stats.h"
+
+using namespace std;
+
+// TYPEDEFS
+
+struct task_t {
+    string name;
+    string binary;
+    vector<string> quick_inputs;    // inputs of the default grid
+    vector<string> full_inputs;     // additional inputs of --grid full
+};
+
+struct config_t {
+    vector<task_t> tasks;
+    vector<unsigned int> threads;
+    unsigned int warmup = 1u;
+    unsigned int repetitions = 5u;
+    bool full_grid = false;
+    string json_path;
+    string baseline_path;
+    double tolerance = 0.10;
+};
+
+struct result_t {
+    string task;
+    string input;
+    unsigned int threads;
+    bool failed;
+    vector<double> times_ms;
+    sample_stats_t stats;
+    double speedup;             // over the first thread count of the same input
+    double parallel_fraction;   // only for more than one thread
+};
+
+struct fit_t {
+    string task;
+    string input;
+    amdahl_fit_t amdahl;
+};
+
+// FUNCTIONS
+
+task_t *find_task( vector<task_t> &tasks, const string &name )
+{
+    for (auto &task : tasks) if (task.name == name) return &task;
+    return nullptr;
+}
+
+result_t measure( const config_t &config, const task_t &task, const string &input, unsigned int threads )
+{
+    result_t result;
+    result.task = task.name;
+    result.input = input;
+    result.threads = threads;
+    result.failed = false;
+    result.speedup = 1.0;
+    result.parallel_fraction = NAN;
+
+    for (unsigned int r = 0u; r < config.warmup + config.repetitions && !result.failed; r++) {
+        const double ms = run_process(task.binary, input, threads, {}, nullptr);
+        if (ms < 0.0) result.failed = true;
+        else if (r >= config.warmup) result.times_ms.push_back(ms);
+    }
+    result.stats = compute_stats(result.times_ms);
+    return result;
+}
+
+void print_result( const result_t &result )
+{
+    if (result.failed) {
+        printf("%-10s %-16s %4u %s\n", result.task.c_str(), result.input.c_str(), result.threads, "FAILED");
+    } else {
+        printf("%-10s %-16s %4u %10.3f %10.3f %10.3f %8.2fx", result.task.c_str(), result.input.c_str(), result.threads, result.stats.median, result.stats.p10, result.stats.p90, result.speedup);
+        if (isfinite(result.parallel_fraction)) printf(" %8.2f%%", 100.0*result.parallel_fraction);
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+/**
+ * @brief Measures all thread counts of one input and fits Amdahl's law over them
+ */
+void run_input( const config_t &config, const task_t &task, const string &input, vector<result_t> &results, vector<fit_t> &fits )
+{
+
+    vector<unsigned int> threads;
+    vector<double> medians;
+
+    for (unsigned int t : config.threads) {
+        result_t result = measure(config, task, input, t);
+        if (!result.failed && !medians.empty()) {
+            result.speedup = medians[0] / result.stats.median;
+            if (threads[0] == 1u && t > 1u) result.parallel_fraction = parallel_fraction(result.speedup, t);
+        }
+        if (!result.failed) {
+            threads.push_back(t);
+            medians.push_back(result.stats.median);
+        }
+        print_result(result);
+        results.push_back(result);
+    }
+
+    // the fit needs the time of a single thread and at least one more thread count
+    if (threads.size() >= 2u && threads[0] == 1u) {
+        fit_t fit;
+        fit.task = task.name;
+        fit.input = input;
+        fit.amdahl = fit_amdahl(threads, medians);
+        fits.push_back(fit);
+        printf("%-10s %-16s amdahl fit: %.2f%% parallel, max speedup %.2fx\n", task.name.c_str(), input.c_str(), 100.0*fit.amdahl.parallel_fraction, fit.amdahl.max_speedup);
+    } else if (config.threads.size() >= 2u) {
+        printf("%-10s %-16s no amdahl fit, it needs 1 thread and at least one more thread count\n", task.name.c_str(), input.c_str());
+    }
+
+}
+
+bool write_json( const config_t &config, const vector<result_t> &results, const vector<fit_t> &fits )
+{
+
+    ostringstream out;
+    out << "{\n  \"warmup\": " << config.warmup << ",\n  \"repetitions\": " << config.repetitions << ",\n  \"results\": [";
+    for (size_t i = 0u; i < results.size(); i++) {
+        const result_t &r = results[i];
+        out << (i == 0u ? "\n" : ",\n") << "    {\"task\": " << json_escape(r.task) << ", \"input\": " << json_escape(r.input) << ", \"threads\": " << r.threads
+            << ", \"failed\": " << (r.failed ? "true" : "false") << ", \"times_ms\": [";
+        for (size_t j = 0u; j < r.times_ms.size(); j++) out << (j == 0u ? "" : ", ") << json_number(r.times_ms[j]);
+        out << "], \"min_ms\": " << json_number(r.stats.min) << ", \"p10_ms\": " << json_number(r.stats.p10)
+            << ", \"median_ms\": " << json_number(r.stats.median) << ", \"p90_ms\": " << json_number(r.stats.p90)
+            << ", \"max_ms\": " << json_number(r.stats.max) << ", \"mean_ms\": " << json_number(r.stats.mean)
+            << ", \"speedup\": " << json_number(r.speedup) << ", \"parallel_fraction\": " << json_number(r.parallel_fraction) << "}";
+    }
+    out << "\n  ],\n  \"amdahl_fits\": [";
+    for (size_t i = 0u; i < fits.size(); i++) {
+        out << (i == 0u ? "\n" : ",\n") << "    {\"task\": " << json_escape(fits[i].task) << ", \"input\": " << json_escape(fits[i].input)
+            << ", \"parallel_fraction\": " << json_number(fits[i].amdahl.parallel_fraction) << ", \"max_speedup\": " << json_number(fits[i].amdahl.max_speedup) << "}";
+    }
+    out << "\n  ]\n}\n";
+
+    ofstream file(config.json_path);
+    file << out.str();
+    return file.good();
+
+}
+
+/**
+ * @brief Compares the medians with the ones of a baseline written by --json
+ * @return The amount of regressions, -1 if the baseline could not be read
+ */
+int compare_baseline( const config_t &config, const vector<result_t> &results )
+{
+
+    ifstream file(config.baseline_path);
+    if (!file) {
+        fprintf(stderr, "Could not open the baseline %s\n", config.baseline_path.c_str());
+        return -1;
+    }
+    stringstream text;
+    text << file.rdbuf();
+    const string content = text.str();
+    json_value_t baseline;
+    json_parser_t parser(content);
+    const json_value_t *baseline_results;
+    if (!parser.parse(baseline) || (baseline_results = baseline.get("results")) == nullptr || baseline_results->type != JSON_ARRAY) {
+        fprintf(stderr, "The baseline %s has no results\n", config.baseline_path.c_str());
+        return -1;
+    }
+
+    int regressions = 0;
+    printf("\n%-10s %-16s %4s %10s %10s %8s\n", "task", "input", "thr", "base_ms", "now_ms", "change");
+    for (const auto &r : results) {
+        if (r.failed) continue;
+        for (const auto &b : baseline_results->array) {
+            const json_value_t *task = b.get("task"), *input = b.get("input"), *threads = b.get("threads"), *median = b.get("median_ms");
+            if (task == nullptr || input == nullptr || threads == nullptr || median == nullptr || median->type != JSON_NUMBER) continue;
+            if (task->string != r.task || input->string != r.input || (unsigned int)threads->number != r.threads) continue;
+
+            const double change = r.stats.median / median->number - 1.0;
+            const bool regression = change > config.tolerance;
+            printf("%-10s %-16s %4u %10.3f %10.3f %+7.1f%%%s\n", r.task.c_str(), r.input.c_str(), r.threads, median->number, r.stats.median, 100.0*change,
+                regression ? " REGRESSION" : change < -config.tolerance ? " faster" : "");
+            if (regression) regressions++;
+            break;
+        }
+    }
+    printf("%d regression(s) above %.0f%%\n", regressions, 100.0*config.tolerance);
+    return regressions;
+
+}
+
+void print_usage( const char *name )
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --tasks himeno,mandelbrot,harmonic   tasks to run (default: all)\n"
+        "  --threads 1,2,4                      thread counts (default: 1, 2, 4, ... up to MAX_CPUS or all cpus)\n"
+        "  --grid quick|full                    input grid (default: quick)\n"
+        "  --input task=\"...\"                   replaces the grid of the task, may be repeated\n"
+        "  --bin task=path                      binary of the task\n"
+        "  --warmup n                           unmeasured runs before every measurement (default: 1)\n"
+        "  --reps n                             measured runs (default: 5)\n"
+        "  --json file                          write the results as JSON\n"
+        "  --baseline file                      compare with the JSON of an earlier run\n"
+        "  --tolerance x                        allowed relative slowdown of the median (default: 0.10)\n",
+        name);
+}
+
+int main( int argc, char *argv[] ) {
+
+    config_t config;
+    config.tasks = {
+        { "himeno", "../mopp-2018-t3-himeno/himeno",
+            { "32 32 64 10", "64 64 128 10" },
+            { "128 128 256 10" } },
+        { "mandelbrot", "../mopp-2017-t3-mandelbrot-set/mandelbrot",
+            { "23 79 240", "200 300 1000" },
+            { "500 500 1000", "2000 2000 1000" } },
+        { "harmonic", "../mopp-2018-t0-harmonic-progression-sum/harmonic-progression-sum",
+            { "100 1000000", "1000 100000" },
+            { "10000 100000", "100000 10000" } },
+    };
+    vector<string> selected;
+    vector<pair<string, string>> inputs;
+
+    // read the options
+    for (int i = 1; i < argc; i++) {
+        const string option = argv[i];
+        if (option == "--help" || option == "-h") {
+            print_usage(argv[0]);
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        const string value = argv[++i];
+        const size_t equals = value.find('=');
+        if (option == "--tasks") {
+            selected = split(value, ',');
+        } else if (option == "--threads") {
+            for (const auto &t : split(value, ',')) config.threads.push_back(stoul(t));
+        } else if (option == "--grid") {
+            config.full_grid = value == "full";
+        } else if ((option == "--input" || option == "--bin") && equals != string::npos) {
+            task_t *task = find_task(config.tasks, value.substr(0u, equals));
+            if (task == nullptr) {
+                fprintf(stderr, "Unknown task in %s %s\n", option.c_str(), value.c_str());
+                return 1;
+            }
+            if (option == "--bin") task->binary = value.substr(equals + 1u);
+            else inputs.emplace_back(task->name, value.substr(equals + 1u));
+        } else if (option == "--warmup") {
+            config.warmup = stoul(value);
+        } else if (option == "--reps") {
+            config.repetitions = max(1ul, stoul(value));
+        } else if (option == "--json") {
+            config.json_path = value;
+        } else if (option == "--baseline") {
+            config.baseline_path = value;
+        } else if (option == "--tolerance") {
+            config.tolerance = stod(value);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // 1, 2, 4, ... and the amount of cpus itself (the ones the container grants)
+    if (config.threads.empty()) {
+        const unsigned int cpus = system_topology().threads(THREADS_ALL_CPUS);
+        for (unsigned int t = 1u; t < cpus; t *= 2u) config.threads.push_back(t);
+        config.threads.push_back(cpus);
+    }
+
+    // an explicit input replaces the grid of its task
+    for (auto &task : config.tasks) {
+        bool replaced = false;
+        for (const auto &input : inputs) {
+            if (input.first != task.name) continue;
+            if (!replaced) task.quick_inputs.clear(), task.full_inputs.clear();
+            task.quick_inputs.push_back(input.second);
+            replaced = true;
+        }
+    }
+
+    vector<result_t> results;
+    vector<fit_t> fits;
+    printf("%-10s %-16s %4s %10s %10s %10s %9s %9s\n", "task", "input", "thr", "median_ms", "p10_ms", "p90_ms", "speedup", "parallel");
+    for (auto &task : config.tasks) {
+        if (!selected.empty() && find(selected.begin(), selected.end(), task.name) == selected.end()) continue;
+        if (access(task.binary.c_str(), X_OK) != 0) {
+            fprintf(stderr, "Skipping %s, %s is not built (make tasks)\n", task.name.c_str(), task.binary.c_str());
+            continue;
+        }
+        for (const auto &input : task.quick_inputs) run_input(config, task, input, results, fits);
+        if (config.full_grid) for (const auto &input : task.full_inputs) run_input(config, task, input, results, fits);
+    }
+
+    if (!config.json_path.empty() && !write_json(config, results, fits)) {
+        fprintf(stderr, "Could not write %s\n", config.json_path.c_str());
+        return 1;
+    }
+    if (!config.baseline_path.empty()) {
+        const int regressions = compare_baseline(config, results);
+        if (regressions < 0) return 1;
+        if (regressions > 0) return 2;
+    }
+
+    return 0;
+
+}
@@ -0,0 +1,80 @@
+/*
+ * Reference of the harmonic sum for the oracle, independent of harmonic_kernel.cpp
+ *
+ * Reads "d n" like harmonic-progression-sum and prints 1/1 + 1/2 + ... + 1/n with d decimal
+ * digits the way the lab defines it: every 1/i is truncated after the d+10th fractional digit,
+ * the truncated terms are summed exactly and the sum is rounded half up at the d+1th digit.
+ * The terms are plain long divisions into a big decimal with limbs of 9 digits, one term after
+ * the other on one thread, without the engines, the merge, the carries or the formatting of
+ * the task, so a bug there can not hide in both.
+ */
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <stdio.h>
+
+using namespace std;
+
+// DEFINES
+#define LIMB_DIGITS 9
+#define LIMB_BASE 1000000000ull
+
+// FUNCTIONS
+
+int main() {
+
+    unsigned long d, n;
+    if (scanf("%lu %lu", &d, &n) != 2) {
+        fprintf(stderr, "Expected the input \"d n\"\n");
+        return 1;
+    }
+
+    // the fraction in limbs, most significant first, the digits behind the d+10th one stay 0
+    const unsigned long fraction_digits = d + 10u;
+    const size_t num_limbs = (fraction_digits + LIMB_DIGITS - 1u) / LIMB_DIGITS;
+    uint64_t truncation = 1u;
+    for (size_t k = 0; k < num_limbs * LIMB_DIGITS - fraction_digits; k++) truncation *= 10u;
+    vector<uint64_t> fraction(num_limbs, 0u);
+    uint64_t integer = 0u;
+
+    // the limbs can take n terms below LIMB_BASE each before they are carried
+    for (uint64_t i = 1u; i <= n; i++) {
+        integer += 1u / i;
+        uint64_t remainder = 1u % i;
+        for (size_t k = 0; k < num_limbs && remainder != 0u; k++) {
+            const unsigned __int128 numerator = (unsigned __int128)remainder * LIMB_BASE;
+            uint64_t limb = (uint64_t)(numerator / i);
+            remainder = (uint64_t)(numerator % i);
+            if (k + 1u == num_limbs) limb -= limb % truncation;
+            fraction[k] += limb;
+        }
+    }
+    for (size_t k = num_limbs; k-- > 1u; ) {
+        fraction[k-1] += fraction[k] / LIMB_BASE;
+        fraction[k] %= LIMB_BASE;
+    }
+    integer += fraction[0] / LIMB_BASE;
+    fraction[0] %= LIMB_BASE;
+
+    // the digits, then rounded at the d+1th one
+    string digits;
+    char limb_text[LIMB_DIGITS + 1];
+    for (uint64_t limb : fraction) {
+        snprintf(limb_text, sizeof(limb_text), "%0*llu", LIMB_DIGITS, (unsigned long long)limb);
+        digits += limb_text;
+    }
+    const bool round_up = digits[d] >= '5';
+    digits.resize(d);
+    if (round_up) {
+        size_t k = d;
+        while (k > 0u && digits[k-1] == '9') digits[--k] = '0';
+        if (k > 0u) digits[k-1]++;
+        else integer++;
+    }
+
+    printf("%llu.%s\n", (unsigned long long)integer, digits.c_str());
+    return 0;
+
+}
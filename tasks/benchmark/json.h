@@ -0,0 +1,197 @@
+#ifndef __HEADER_JSON__
+#define __HEADER_JSON__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Just enough JSON for the benchmark results: a writer for strings and numbers and a small
+ * recursive descent parser to read a stored baseline back in.
+ */
+
+// TYPEDEFS
+
+enum json_type_t { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT };
+
+struct json_value_t {
+    json_type_t type = JSON_NULL;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<json_value_t> array;
+    std::map<std::string, json_value_t> object;
+
+    const json_value_t *get( const std::string &key ) const
+    {
+        auto it = object.find(key);
+        return it == object.end() ? nullptr : &it->second;
+    }
+};
+
+// FUNCTIONS
+
+std::string json_escape( const std::string &s )
+{
+    std::string out = "\"";
+    char buffer[8];
+    for (unsigned char ch : s) {
+        if (ch == '"' || ch == '\\') {
+            out += '\\';
+            out += ch;
+        } else if (ch < 0x20u) {
+            snprintf(buffer, sizeof(buffer), "\\u%04x", ch);
+            out += buffer;
+        } else {
+            out += ch;
+        }
+    }
+    return out + "\"";
+}
+
+// JSON has no infinity or nan, they are written as null
+std::string json_number( double value )
+{
+    if (!isfinite(value)) return "null";
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.6g", value);
+    return buffer;
+}
+
+class json_parser_t {
+
+public:
+
+    explicit json_parser_t( const std::string &text ) : m_text(text), m_pos(0u) {}
+
+    /**
+     * @brief Parses the whole text
+     * @return false if the text is no valid JSON
+     */
+    bool parse( json_value_t &value )
+    {
+        return parse_value(value) && (skip_space(), m_pos == m_text.size());
+    }
+
+private:
+
+    const std::string &m_text;
+    size_t m_pos;
+
+    void skip_space()
+    {
+        while (m_pos < m_text.size() && (m_text[m_pos] == ' ' || m_text[m_pos] == '\n' || m_text[m_pos] == '\r' || m_text[m_pos] == '\t')) m_pos++;
+    }
+
+    bool consume( const char *literal )
+    {
+        const size_t length = strlen(literal);
+        if (m_text.compare(m_pos, length, literal) != 0) return false;
+        m_pos += length;
+        return true;
+    }
+
+    bool parse_string( std::string &out )
+    {
+        if (m_text[m_pos] != '"') return false;
+        m_pos++;
+        while (m_pos < m_text.size() && m_text[m_pos] != '"') {
+            if (m_text[m_pos] == '\\') {
+                if (++m_pos >= m_text.size()) return false;
+                switch (m_text[m_pos]) {
+                    case 'n': out += '\n'; break;
+                    case 't': out += '\t'; break;
+                    case 'r': out += '\r'; break;
+                    case 'b': out += '\b'; break;
+                    case 'f': out += '\f'; break;
+                    case 'u':
+                        // only the control characters written by json_escape()
+                        if (m_pos + 4u >= m_text.size()) return false;
+                        out += (char)strtoul(m_text.substr(m_pos + 1u, 4u).c_str(), nullptr, 16);
+                        m_pos += 4u;
+                        break;
+                    default: out += m_text[m_pos]; break;
+                }
+            } else {
+                out += m_text[m_pos];
+            }
+            m_pos++;
+        }
+        if (m_pos >= m_text.size()) return false;
+        m_pos++;
+        return true;
+    }
+
+    bool parse_value( json_value_t &value )
+    {
+        skip_space();
+        if (m_pos >= m_text.size()) return false;
+        const char ch = m_text[m_pos];
+
+        if (ch == '{') {
+            value.type = JSON_OBJECT;
+            m_pos++;
+            skip_space();
+            if (m_pos < m_text.size() && m_text[m_pos] == '}') return m_pos++, true;
+            while (true) {
+                std::string key;
+                json_value_t member;
+                skip_space();
+                if (m_pos >= m_text.size() || !parse_string(key)) return false;
+                skip_space();
+                if (!consume(":") || !parse_value(member)) return false;
+                value.object[key] = std::move(member);
+                skip_space();
+                if (consume("}")) return true;
+                if (!consume(",")) return false;
+            }
+        }
+
+        if (ch == '[') {
+            value.type = JSON_ARRAY;
+            m_pos++;
+            skip_space();
+            if (m_pos < m_text.size() && m_text[m_pos] == ']') return m_pos++, true;
+            while (true) {
+                value.array.emplace_back();
+                if (!parse_value(value.array.back())) return false;
+                skip_space();
+                if (consume("]")) return true;
+                if (!consume(",")) return false;
+            }
+        }
+
+        if (ch == '"') {
+            value.type = JSON_STRING;
+            return parse_string(value.string);
+        }
+        if (consume("true")) {
+            value.type = JSON_BOOL;
+            value.boolean = true;
+            return true;
+        }
+        if (consume("false")) {
+            value.type = JSON_BOOL;
+            return true;
+        }
+        if (consume("null")) {
+            value.type = JSON_NULL;
+            return true;
+        }
+
+        char *end;
+        value.type = JSON_NUMBER;
+        value.number = strtod(m_text.c_str() + m_pos, &end);
+        if (end == m_text.c_str() + m_pos) return false;
+        m_pos = end - m_text.c_str();
+        return true;
+    }
+
+};
+
+#endif
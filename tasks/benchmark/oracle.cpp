@@ -0,0 +1,540 @@
+/*
+ * Correctness oracle for all builds of the tasks
+ *
+ * Runs every variant (make variants) over the inputs and thread counts like the benchmark and
+ * compares its output with the one of its reference build, the lab originals
+ * (himeno_original.c, mandelbrot_original.cpp) or harmonic_reference.cpp, a plain long division
+ * of the harmonic sum that shares no code with the task. A variant that is not built fails
+ * unless --allow-missing is given. Every
+ * variant has an explicit tolerance policy, so a fast path that changes the results more than
+ * it should fails here instead of in the judge. The throughput of every run is reported at
+ * the same time. See README.md for the options and the policies.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "json.h"
+#include "process.h"
+#include "split.h"
+#include "../common/topology.h"
+#include "stats.h"
+
+using namespace std;
+
+// TYPEDEFS
+
+enum policy_t {
+    POLICY_REFERENCE,   // the build the others get compared with
+    POLICY_IDENTICAL,   // the same bytes
+    POLICY_DIGITS,      // the printed numbers differ by at most tolerance units of the last digit
+    POLICY_RELATIVE,    // |value - reference| <= tolerance * |reference|, plus one unit of the last digit
+    POLICY_PIXELS       // an image of the same size, at most the fraction tolerance of the pixels differ
+};
+
+enum decode_t {
+    DECODE_NONE,
+    DECODE_LAST_FRAME,  // the output is several images, the last one counts
+    DECODE_PBM,         // binary PBM back to ascii
+    DECODE_RLE          // runs back to ascii
+};
+
+struct variant_t {
+    string name;
+    string binary;              // in the variants directory
+    string reference;           // name of the variant to compare with
+    policy_t policy;
+    double tolerance;
+    decode_t decode;
+    vector<pair<string, string>> environment;
+};
+
+struct task_t {
+    string name;
+    string unit;                // of the throughput
+    vector<string> quick_inputs;
+    vector<string> full_inputs;
+    vector<variant_t> variants;
+};
+
+struct config_t {
+    vector<task_t> tasks;
+    vector<unsigned int> threads;
+    vector<string> selected_variants;
+    string directory = "variants";
+    unsigned int repetitions = 3u;
+    bool full_grid = false;
+    bool allow_missing = false; // skip the variants that are not built instead of failing them
+    string json_path;
+};
+
+struct result_t {
+    string task;
+    string variant;
+    string input;
+    unsigned int threads;
+    bool failed;                // did not run or the output could not be decoded
+    bool passed;
+    string policy;
+    string detail;
+    sample_stats_t stats;
+    double throughput;          // units of the task per second of the median
+};
+
+// FUNCTIONS
+
+vector<double> parse_numbers( const string &input )
+{
+    vector<double> numbers;
+    istringstream stream(input);
+    double number;
+    while (stream >> number) numbers.push_back(number);
+    return numbers;
+}
+
+/**
+ * @brief The work of an input in the units of the task: cell updates, pixels or terms
+ */
+double work( const string &task, const string &input )
+{
+    const vector<double> n = parse_numbers(input);
+    if (task == "himeno" && n.size() >= 4u) return (n[0]-2.0) * (n[1]-2.0) * (n[2]-2.0) * n[3];
+    if (task == "mandelbrot" && n.size() >= 2u) return n[0] * n[1];
+    if (task == "harmonic" && n.size() >= 2u) return n[1];
+    return NAN;
+}
+
+string policy_name( const variant_t &variant )
+{
+    char name[64];
+    switch (variant.policy) {
+        case POLICY_REFERENCE: return "reference";
+        case POLICY_IDENTICAL: return "identical";
+        case POLICY_DIGITS: snprintf(name, sizeof(name), "digits:%g", variant.tolerance); return name;
+        case POLICY_RELATIVE: snprintf(name, sizeof(name), "relative:%g", variant.tolerance); return name;
+        case POLICY_PIXELS: snprintf(name, sizeof(name), "pixels:%g", variant.tolerance); return name;
+    }
+    return "";
+}
+
+/**
+ * @brief Turns the output of a variant into the form of its reference
+ * @return false if the output is not what the decoder expects
+ */
+bool decode( const variant_t &variant, const string &input, string &output )
+{
+
+    if (variant.decode == DECODE_NONE) return true;
+
+    if (variant.decode == DECODE_LAST_FRAME) {
+        const vector<double> n = parse_numbers(input);
+        if (n.size() < 2u) return false;
+        const size_t image_size = (size_t)n[0] * ((size_t)n[1] + 1u);
+        if (output.size() < image_size || output.size() % image_size != 0u) return false;
+        output.erase(0u, output.size() - image_size);
+        return true;
+    }
+
+    // PBM: "P4\n<cols> <rows>\n", then the rows padded to full bytes, MSB first
+    istringstream stream(output);
+    unsigned long rows, cols;
+    string ascii;
+    if (variant.decode == DECODE_PBM) {
+        string magic;
+        if (!(stream >> magic >> cols >> rows) || magic != "P4" || stream.get() != '\n') return false;
+        const size_t row_bytes = (cols + 7u) / 8u, begin = stream.tellg();
+        if (output.size() != begin + rows * row_bytes) return false;
+        for (size_t r = 0u; r < rows; r++) {
+            const unsigned char *row = (const unsigned char*)output.data() + begin + r * row_bytes;
+            for (size_t c = 0u; c < cols; c++) ascii += row[c/8u] & (0x80u >> (c%8u)) ? '#' : '.';
+            ascii += '\n';
+        }
+        output = ascii;
+        return true;
+    }
+
+    // RLE: "<rows> <cols>\n", then every row as "<length><#|.>" runs and a newline
+    if (!(stream >> rows >> cols) || stream.get() != '\n') return false;
+    for (size_t r = 0u; r < rows; r++) {
+        size_t row_length = 0u;
+        unsigned long run;
+        while (stream.peek() != '\n') {
+            const int value = (stream >> run) ? stream.get() : EOF;
+            if ((value != '#' && value != '.') || row_length + run > cols) return false;
+            ascii.append(run, (char)value);
+            row_length += run;
+        }
+        stream.get();
+        if (row_length != cols) return false;
+        ascii += '\n';
+    }
+    if (stream.peek() != EOF) return false;
+    output = ascii;
+    return true;
+
+}
+
+/**
+ * @brief Applies the policy of the variant to its output
+ * @param detail What was compared, for the report
+ */
+bool check( const variant_t &variant, const string &input, const string &output, const string &expected, string &detail )
+{
+
+    char text[256];
+
+    if (variant.policy == POLICY_IDENTICAL) {
+        if (output == expected) {
+            snprintf(text, sizeof(text), "%zu bytes", output.size());
+            detail = text;
+            return true;
+        }
+        const size_t first = mismatch(output.begin(), output.begin() + min(output.size(), expected.size()), expected.begin()).first - output.begin();
+        snprintf(text, sizeof(text), "%zu vs %zu bytes, first difference at byte %zu", output.size(), expected.size(), first);
+        detail = text;
+        return false;
+    }
+
+    if (variant.policy == POLICY_PIXELS) {
+        if (output.size() != expected.size()) {
+            snprintf(text, sizeof(text), "%zu vs %zu bytes", output.size(), expected.size());
+            detail = text;
+            return false;
+        }
+        size_t pixels = 0u, different = 0u;
+        for (size_t i = 0u; i < output.size(); i++) {
+            if ((output[i] == '\n') != (expected[i] == '\n')) {
+                snprintf(text, sizeof(text), "rows differ at byte %zu", i);
+                detail = text;
+                return false;
+            }
+            if (expected[i] == '\n') continue;
+            pixels++;
+            if (output[i] != expected[i]) different++;
+        }
+        const double fraction = pixels > 0u ? (double)different / pixels : 0.0;
+        snprintf(text, sizeof(text), "%zu of %zu pixels differ (%.3f%%)", different, pixels, 100.0 * fraction);
+        detail = text;
+        return fraction <= variant.tolerance;
+    }
+
+    // the numbers as printed, one unit of the last printed digit of the reference
+    char *end;
+    const double value = strtod(output.c_str(), &end);
+    if (end == output.c_str()) {
+        detail = "no number in the output";
+        return false;
+    }
+    const double reference = strtod(expected.c_str(), nullptr);
+    const size_t point = expected.find('.');
+    const size_t decimals = point == string::npos ? 0u : expected.find_first_not_of("0123456789", point + 1u) - point - 1u;
+    const double unit = pow(10.0, -(double)min<size_t>(decimals, 300u));
+
+    double allowed = unit;
+    if (variant.policy == POLICY_DIGITS) {
+        allowed = variant.tolerance * unit;
+    } else if (variant.policy == POLICY_RELATIVE) {
+        allowed += variant.tolerance * fabs(reference);
+    }
+
+    // a little slack for the decimal rounding of the bounds themselves
+    const double difference = fabs(value - reference);
+    snprintf(text, sizeof(text), "%.*f vs %.*f, difference %.3g, allowed %.3g", (int)decimals, value, (int)decimals, reference, difference, allowed);
+    detail = text;
+    return difference <= allowed * (1.0 + 1.0e-9);
+
+}
+
+void print_result( const task_t &task, const result_t &result )
+{
+    if (result.failed) {
+        printf("%-10s %-24s %-16s %4u %10s %12s %-10s %-12s %s\n", result.task.c_str(), result.variant.c_str(), result.input.c_str(), result.threads,
+            "-", "-", "", "FAILED", result.detail.c_str());
+    } else {
+        printf("%-10s %-24s %-16s %4u %10.3f %12.2f %-10s %-12s %s %s\n", result.task.c_str(), result.variant.c_str(), result.input.c_str(), result.threads,
+            result.stats.median, result.throughput / 1.0e6, ("M" + task.unit).c_str(), result.policy.c_str(), result.passed ? "ok" : "MISMATCH", result.detail.c_str());
+    }
+    fflush(stdout);
+}
+
+/**
+ * @brief Runs a variant config.repetitions times, the outputs of all runs have to pass
+ * @param expected nullptr for a reference, which gets its output stored here instead
+ */
+result_t run_variant( const config_t &config, const task_t &task, const variant_t &variant, const string &input, unsigned int threads,
+                      const string *expected, string *reference_output )
+{
+
+    result_t result;
+    result.task = task.name;
+    result.variant = variant.name;
+    result.input = input;
+    result.threads = threads;
+    result.failed = false;
+    result.passed = true;
+    result.policy = policy_name(variant);
+
+    vector<double> times_ms;
+    const string binary = config.directory + "/" + variant.binary;
+    for (unsigned int r = 0u; r < config.repetitions; r++) {
+        string output;
+        const double ms = run_process(binary, input, threads, variant.environment, &output);
+        if (ms < 0.0) {
+            result.failed = true;
+            result.detail = "the process failed";
+            break;
+        }
+        times_ms.push_back(ms);
+        if (expected == nullptr) {
+            if (reference_output != nullptr) *reference_output = output;
+            result.detail = to_string(output.size()) + " bytes";
+            continue;
+        }
+        if (!decode(variant, input, output)) {
+            result.failed = true;
+            result.detail = "the output could not be decoded";
+            break;
+        }
+        string detail;
+        const bool passed = check(variant, input, output, *expected, detail);
+        if (r == 0u || !passed) result.detail = detail;
+        result.passed = result.passed && passed;
+    }
+
+    result.passed = result.passed && !result.failed;
+    result.stats = compute_stats(times_ms);
+    result.throughput = work(task.name, input) / (result.stats.median / 1.0e3);
+    return result;
+
+}
+
+bool write_json( const config_t &config, const vector<result_t> &results )
+{
+
+    ostringstream out;
+    out << "{\n  \"repetitions\": " << config.repetitions << ",\n  \"results\": [";
+    for (size_t i = 0u; i < results.size(); i++) {
+        const result_t &r = results[i];
+        out << (i == 0u ? "\n" : ",\n") << "    {\"task\": " << json_escape(r.task) << ", \"variant\": " << json_escape(r.variant)
+            << ", \"input\": " << json_escape(r.input) << ", \"threads\": " << r.threads << ", \"failed\": " << (r.failed ? "true" : "false")
+            << ", \"passed\": " << (r.passed ? "true" : "false") << ", \"policy\": " << json_escape(r.policy) << ", \"detail\": " << json_escape(r.detail)
+            << ", \"median_ms\": " << json_number(r.failed ? NAN : r.stats.median) << ", \"throughput\": " << json_number(r.failed ? NAN : r.throughput) << "}";
+    }
+    out << "\n  ]\n}\n";
+
+    ofstream file(config.json_path);
+    file << out.str();
+    return file.good();
+
+}
+
+void print_usage( const char *name )
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --tasks himeno,mandelbrot,harmonic   tasks to check (default: all)\n"
+        "  --variants himeno-hybrid,...         variants to check besides the references (default: all)\n"
+        "  --threads 1,2,4                      thread counts (default: 1, 2, 4, ... up to MAX_CPUS or all cpus)\n"
+        "  --grid quick|full                    input grid (default: quick)\n"
+        "  --input task=\"...\"                   replaces the grid of the task, may be repeated\n"
+        "  --dir path                           directory of the builds (default: variants, see make variants)\n"
+        "  --reps n                             runs per variant, input and thread count (default: 3)\n"
+        "  --allow-missing                      skip the variants that are not built instead of failing them\n"
+        "  --json file                          write the results as JSON\n",
+        name);
+}
+
+int main( int argc, char *argv[] ) {
+
+    config_t config;
+    config.tasks = {
+        { "himeno", "cells/s",
+            { "33 33 65 20", "64 64 128 10" },
+            { "129 129 257 40" },
+            {
+                { "himeno-original", "himeno-original", "", POLICY_REFERENCE, 0.0, DECODE_NONE, {} },
+                { "himeno-original-float64", "himeno-original-float64", "", POLICY_REFERENCE, 0.0, DECODE_NONE, {} },
+                // the float sum of the lab, in another order with several threads
+                { "himeno", "himeno", "himeno-original", POLICY_DIGITS, 1.0, DECODE_NONE, {} },
+                { "himeno-async0", "himeno-async0", "himeno-original", POLICY_DIGITS, 1.0, DECODE_NONE, {} },
+                { "himeno-float64", "himeno-float64", "himeno-original-float64", POLICY_DIGITS, 1.0, DECODE_NONE, {} },
+                // stale edges slow the convergence down, a few percent of gosa after the same iterations
+                { "himeno-async2", "himeno-async2", "himeno-original-float64", POLICY_RELATIVE, 0.05, DECODE_NONE, {} },
+                // the float sum of the lab in the order of the cells
+                { "himeno-stream", "himeno-stream", "himeno-original", POLICY_DIGITS, 1.0, DECODE_NONE, {} },
+                { "himeno-hybrid", "himeno-hybrid", "himeno-original", POLICY_DIGITS, 1.0, DECODE_NONE, {} },
+                { "himeno-masked", "himeno-masked", "himeno-original", POLICY_DIGITS, 1.0, DECODE_NONE, {} },
+            } },
+        { "mandelbrot", "pixels/s",
+            { "23 79 240", "200 300 1000" },
+            { "500 500 1000" },
+            {
+                { "mandelbrot-original", "mandelbrot-original", "", POLICY_REFERENCE, 0.0, DECODE_NONE, {} },
+                { "mandelbrot", "mandelbrot", "mandelbrot-original", POLICY_IDENTICAL, 0.0, DECODE_NONE, {} },
+                { "mandelbrot-pbm", "mandelbrot", "mandelbrot-original", POLICY_IDENTICAL, 0.0, DECODE_PBM, { { "OUTPUT_FORMAT", "pbm" } } },
+                { "mandelbrot-rle", "mandelbrot", "mandelbrot-original", POLICY_IDENTICAL, 0.0, DECODE_RLE, { { "OUTPUT_FORMAT", "rle" } } },
+                { "mandelbrot-pipelined", "mandelbrot-pipelined", "mandelbrot-original", POLICY_IDENTICAL, 0.0, DECODE_NONE, {} },
+                { "mandelbrot-pool", "mandelbrot-pool", "mandelbrot-original", POLICY_IDENTICAL, 0.0, DECODE_NONE, {} },
+                { "mandelbrot-progressive", "mandelbrot-progressive", "mandelbrot-original", POLICY_IDENTICAL, 0.0, DECODE_LAST_FRAME, {} },
+                { "mandelbrot-c", "mandelbrot-c", "mandelbrot-original", POLICY_IDENTICAL, 0.0, DECODE_NONE, {} },
+                { "mandelbrot-fork", "mandelbrot-fork", "mandelbrot-original", POLICY_IDENTICAL, 0.0, DECODE_NONE, {} },
+                // more precise than float, the pixels on the chaotic border may flip
+                { "mandelbrot-adaptive", "mandelbrot-adaptive", "mandelbrot-original", POLICY_PIXELS, 0.001, DECODE_NONE, {} },
+                { "mandelbrot-deepzoom", "mandelbrot-deepzoom", "mandelbrot-original", POLICY_PIXELS, 0.001, DECODE_NONE, {} },
+            } },
+        { "harmonic", "terms/s",
+            { "20 1000", "100 12345", "1000 100000" },
+            { "10000 100000" },
+            {
+                { "harmonic-reference", "harmonic-reference", "", POLICY_REFERENCE, 0.0, DECODE_NONE, {} },
+                { "harmonic-digits", "harmonic-digits", "harmonic-reference", POLICY_IDENTICAL, 0.0, DECODE_NONE, {} },
+                { "harmonic", "harmonic", "harmonic-reference", POLICY_IDENTICAL, 0.0, DECODE_NONE, {} },
+            } },
+    };
+    vector<string> selected;
+    vector<pair<string, string>> inputs;
+
+    // read the options
+    for (int i = 1; i < argc; i++) {
+        const string option = argv[i];
+        if (option == "--help" || option == "-h") {
+            print_usage(argv[0]);
+            return 0;
+        }
+        if (option == "--allow-missing") {
+            config.allow_missing = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        const string value = argv[++i];
+        const size_t equals = value.find('=');
+        if (option == "--tasks") {
+            selected = split(value, ',');
+        } else if (option == "--variants") {
+            config.selected_variants = split(value, ',');
+        } else if (option == "--threads") {
+            for (const auto &t : split(value, ',')) config.threads.push_back(stoul(t));
+        } else if (option == "--grid") {
+            config.full_grid = value == "full";
+        } else if (option == "--input" && equals != string::npos) {
+            inputs.emplace_back(value.substr(0u, equals), value.substr(equals + 1u));
+        } else if (option == "--dir") {
+            config.directory = value;
+        } else if (option == "--reps") {
+            config.repetitions = max(1ul, stoul(value));
+        } else if (option == "--json") {
+            config.json_path = value;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // 1, 2, 4, ... and the amount of cpus itself (the ones the container grants)
+    if (config.threads.empty()) {
+        const unsigned int cpus = system_topology().threads(THREADS_ALL_CPUS);
+        for (unsigned int t = 1u; t < cpus; t *= 2u) config.threads.push_back(t);
+        config.threads.push_back(cpus);
+    }
+
+    // an explicit input replaces the grid of its task
+    for (auto &task : config.tasks) {
+        bool replaced = false;
+        for (const auto &input : inputs) {
+            if (input.first != task.name) continue;
+            if (!replaced) task.quick_inputs.clear(), task.full_inputs.clear();
+            task.quick_inputs.push_back(input.second);
+            replaced = true;
+        }
+    }
+
+    vector<result_t> results;
+    size_t mismatches = 0u;
+    printf("%-10s %-24s %-16s %4s %10s %12s %-10s %-12s %s\n", "task", "variant", "input", "thr", "median_ms", "throughput", "unit", "policy", "result");
+    for (const auto &task : config.tasks) {
+
+        if (!selected.empty() && find(selected.begin(), selected.end(), task.name) == selected.end()) continue;
+        vector<string> task_inputs = task.quick_inputs;
+        if (config.full_grid) task_inputs.insert(task_inputs.end(), task.full_inputs.begin(), task.full_inputs.end());
+
+        for (const auto &input : task_inputs) {
+
+            // a variant that is not built fails, unless it may be missing
+            auto is_built = [&]( const variant_t &variant, unsigned int threads ) {
+                if (access((config.directory + "/" + variant.binary).c_str(), X_OK) == 0) return true;
+                if (config.allow_missing) {
+                    fprintf(stderr, "Skipping %s, it is not built (make variants)\n", variant.name.c_str());
+                    return false;
+                }
+                result_t result;
+                result.task = task.name;
+                result.variant = variant.name;
+                result.input = input;
+                result.threads = threads;
+                result.failed = true;
+                result.passed = false;
+                result.policy = policy_name(variant);
+                result.detail = "not built (make variants), --allow-missing skips it";
+                result.stats = compute_stats(vector<double>());
+                result.throughput = NAN;
+                mismatches++;
+                print_result(task, result);
+                results.push_back(result);
+                return false;
+            };
+
+            // the references run once on one thread, the originals are sequential
+            map<string, string> reference_outputs;
+            for (const auto &variant : task.variants) {
+                if (variant.policy != POLICY_REFERENCE) continue;
+                if (!is_built(variant, 1u)) continue;
+                string output;
+                const result_t result = run_variant(config, task, variant, input, 1u, nullptr, &output);
+                if (!result.failed) reference_outputs[variant.name] = output;
+                else mismatches++;
+                print_result(task, result);
+                results.push_back(result);
+            }
+
+            for (const auto &variant : task.variants) {
+                if (variant.policy == POLICY_REFERENCE) continue;
+                if (!config.selected_variants.empty() && find(config.selected_variants.begin(), config.selected_variants.end(), variant.name) == config.selected_variants.end()) continue;
+                if (!is_built(variant, config.threads.front())) continue;
+                const auto expected = reference_outputs.find(variant.reference);
+                if (expected == reference_outputs.end()) {
+                    // the reference failed (and counts already) or was skipped with --allow-missing
+                    fprintf(stderr, "Skipping %s, there is no output of %s\n", variant.name.c_str(), variant.reference.c_str());
+                    continue;
+                }
+                for (unsigned int threads : config.threads) {
+                    const result_t result = run_variant(config, task, variant, input, threads, &expected->second, nullptr);
+                    if (!result.passed) mismatches++;
+                    print_result(task, result);
+                    results.push_back(result);
+                }
+            }
+
+        }
+    }
+
+    printf("%zu of %zu check(s) failed\n", mismatches, results.size());
+    if (!config.json_path.empty() && !write_json(config, results)) {
+        fprintf(stderr, "Could not write %s\n", config.json_path.c_str());
+        return 1;
+    }
+    return mismatches > 0u ? 2 : 0;
+
+}
@@ -0,0 +1,95 @@
+#ifndef __HEADER_PROCESS__
+#define __HEADER_PROCESS__
+
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/*
+ * Runs a task binary the way the judge does: the input on stdin, the thread count in MAX_CPUS.
+ * Used by the benchmark (stdout discarded) and the oracle (stdout kept).
+ */
+
+// FUNCTIONS
+
+/**
+ * @brief Runs the binary once with input on stdin, stderr is discarded
+ * @param environment Extra variables for the process, e.g. OUTPUT_FORMAT
+ * @param output nullptr to discard stdout, else it gets the whole stdout. It goes to an unlinked
+ * file, not a pipe, so binaries that write in parallel with pwrite() take that path
+ * @return The wall time from fork() until the process exited in milliseconds, negative if the
+ * process could not be started or failed
+ */
+double run_process( const std::string &binary, const std::string &input, unsigned int threads,
+                    const std::vector<std::pair<std::string, std::string>> &environment, std::string *output )
+{
+
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0) return -1.0;
+    FILE *output_file = output != nullptr ? tmpfile() : nullptr;
+    const int output_fd = output_file != nullptr ? fileno(output_file) : open("/dev/null", O_WRONLY);
+
+    const auto ts_begin = std::chrono::steady_clock::now();
+    const pid_t pid = output_fd < 0 ? -1 : fork();
+    if (pid < 0) {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        if (output_file != nullptr) fclose(output_file);
+        else if (output_fd >= 0) close(output_fd);
+        return -1.0;
+    }
+
+    if (pid == 0) {
+        const int null_fd = open("/dev/null", O_WRONLY);
+        dup2(pipe_fds[0], STDIN_FILENO);
+        dup2(output_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        close(null_fd);
+        setenv("MAX_CPUS", std::to_string(threads).c_str(), 1);
+        for (const auto &variable : environment) setenv(variable.first.c_str(), variable.second.c_str(), 1);
+        execl(binary.c_str(), binary.c_str(), (char*)nullptr);
+        _exit(127);
+    }
+
+    // the inputs are tiny, they fit into the pipe buffer
+    close(pipe_fds[0]);
+    const std::string line = input + "\n";
+    (void)! write(pipe_fds[1], line.data(), line.size());
+    close(pipe_fds[1]);
+
+    int status;
+    bool exited = true;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            exited = false;
+            break;
+        }
+    }
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - ts_begin).count();
+    const bool success = exited && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+    if (output_file != nullptr) {
+        output->clear();
+        char buffer[1 << 16];
+        size_t length;
+        rewind(output_file);
+        while ((length = fread(buffer, 1, sizeof(buffer), output_file)) > 0u) output->append(buffer, length);
+        fclose(output_file);
+    } else {
+        close(output_fd);
+    }
+    return success ? ms : -1.0;
+
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef __HEADER_SPLIT__
+#define __HEADER_SPLIT__
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+ * The lists of the command lines (--threads 1,2,4, --grid 65,65,129, layouts like 2x28), shared
+ * by the benchmark, the oracle and the benches of the tasks.
+ */
+
+// FUNCTIONS
+
+/**
+ * @brief The parts of s between the separators, empty parts are dropped
+ */
+static inline std::vector<std::string> split( const std::string &s, char separator )
+{
+    std::vector<std::string> parts;
+    std::string part;
+    std::istringstream stream(s);
+    while (std::getline(stream, part, separator)) if (!part.empty()) parts.push_back(part);
+    return parts;
+}
+
+#endif
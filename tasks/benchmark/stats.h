@@ -0,0 +1,89 @@
+#ifndef __HEADER_STATS__
+#define __HEADER_STATS__
+
+#include <algorithm>
+#include <vector>
+
+#include <math.h>
+
+// TYPEDEFS
+
+struct sample_stats_t {
+    double min;
+    double max;
+    double mean;
+    double p10;
+    double median;
+    double p90;
+    double p99;
+};
+
+// result of fitting Amdahl's law t(p) = t(1) * ((1-f) + f/p) to the measured times
+struct amdahl_fit_t {
+    double parallel_fraction;   // f in [0, 1]
+    double max_speedup;         // 1/(1-f), infinite for f == 1
+};
+
+// FUNCTIONS
+
+/**
+ * @brief Percentile with linear interpolation between the closest ranks
+ * @param sorted The samples in ascending order, must not be empty
+ * @param q The percentile in [0, 1]
+ */
+inline double percentile( const std::vector<double> &sorted, double q )
+{
+    const double rank = q * (sorted.size() - 1u);
+    const size_t lower = (size_t)floor(rank);
+    const size_t upper = std::min(lower + 1u, sorted.size() - 1u);
+    return sorted[lower] + (rank - lower) * (sorted[upper] - sorted[lower]);
+}
+
+sample_stats_t compute_stats( std::vector<double> samples )
+{
+    sample_stats_t stats = {};
+    if (samples.empty()) return stats;
+    std::sort(samples.begin(), samples.end());
+    stats.min = samples.front();
+    stats.max = samples.back();
+    for (double s : samples) stats.mean += s;
+    stats.mean /= samples.size();
+    stats.p10 = percentile(samples, 0.10);
+    stats.median = percentile(samples, 0.50);
+    stats.p90 = percentile(samples, 0.90);
+    stats.p99 = percentile(samples, 0.99);
+    return stats;
+}
+
+/**
+ * @brief Parallel fraction of a single measurement, the "% parallel code" of the READMEs
+ * @param speedup The measured speedup over one thread
+ * @param threads The amount of threads, must be > 1
+ */
+inline double parallel_fraction( double speedup, unsigned int threads )
+{
+    return (1.0 - 1.0/speedup) / (1.0 - 1.0/threads);
+}
+
+/**
+ * @brief Least squares fit of Amdahl's law over all thread counts. With x = 1/p - 1 and
+ * y = t(p)/t(1) - 1 the law becomes y = f*x, so f = sum(x*y) / sum(x*x)
+ * @param threads The thread counts
+ * @param times The median times for every thread count, times[0] must be the one of threads[0] == 1
+ */
+amdahl_fit_t fit_amdahl( const std::vector<unsigned int> &threads, const std::vector<double> &times )
+{
+    double sum_xy = 0.0, sum_xx = 0.0, x, y;
+    for (size_t i = 1u; i < threads.size(); i++) {
+        x = 1.0/threads[i] - 1.0;
+        y = times[i]/times[0] - 1.0;
+        sum_xy += x*y;
+        sum_xx += x*x;
+    }
+    amdahl_fit_t fit;
+    fit.parallel_fraction = sum_xx == 0.0 ? 0.0 : std::min(std::max(sum_xy / sum_xx, 0.0), 1.0);
+    fit.max_speedup = fit.parallel_fraction >= 1.0 ? INFINITY : 1.0 / (1.0 - fit.parallel_fraction);
+    return fit;
+}
+
+#endif
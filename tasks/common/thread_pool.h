@@ -0,0 +1,147 @@
+#ifndef __HEADER_THREAD_POOL__
+#define __HEADER_THREAD_POOL__
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "topology.h"
+#include "trace.h"
+
+/*
+ * Fork-join team of threads that is reused for every parallel region, so a caller pays the
+ * thread creation once instead of once per call. The calling thread takes part in every run()
+ * as thread 0, a pool of size 1 has no extra threads at all.
+ *
+ * With a list of CPUs (topology_t::thread_cpus()) thread t runs on cpus[t]. The calling thread
+ * is not touched, it pins itself to cpus[0] if it wants to.
+ */
+class thread_pool_t {
+
+    public:
+
+        explicit thread_pool_t( unsigned int num_threads, const std::vector<int> &cpus = std::vector<int>() ) :
+            m_uiNumThreads(num_threads == 0u ? 1u : num_threads)
+        {
+            for (unsigned int t = 1u; t < m_uiNumThreads; t++) m_threads.emplace_back(&thread_pool_t::work, this, t, t < cpus.size() ? cpus[t] : -1);
+        }
+
+        ~thread_pool_t()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_bStop = true;
+            }
+            m_start.notify_all();
+            for (auto &thread : m_threads) thread.join();
+        }
+
+        thread_pool_t( const thread_pool_t& ) = delete;
+        thread_pool_t &operator=( const thread_pool_t& ) = delete;
+
+        /**
+         * @brief The amount of threads including the calling one
+         */
+        unsigned int size() const { return m_uiNumThreads; }
+
+        /**
+         * @brief Calls fn(i, thread_number) for every i in [0, n) and returns when all calls are done.
+         * The threads take the indices one after another, so every i is a unit of dynamically
+         * balanced work. Must not be called from within fn
+         */
+        template<typename F>
+        void run( unsigned int n, F &&fn )
+        {
+            typedef typename std::remove_reference<F>::type fn_t;
+            run_erased(n, [](void *context, unsigned int i, unsigned int thread_number) {
+                (*(fn_t*)context)(i, thread_number);
+            }, (void*)&fn);
+        }
+
+    private:
+
+        typedef void (*invoke_t)( void *context, unsigned int i, unsigned int thread_number );
+
+        const unsigned int m_uiNumThreads;
+        std::vector<std::thread> m_threads;
+
+        std::mutex m_mutex;
+        std::condition_variable m_start;
+        std::condition_variable m_done;
+        unsigned long m_ulGeneration = 0u;  // increased for every run()
+        bool m_bStop = false;
+
+        // the current run
+        invoke_t m_invoke = nullptr;
+        void *m_pContext = nullptr;
+        unsigned int m_uiSize = 0u;
+        alignas(64) std::atomic<unsigned int> m_next{0u};
+        alignas(64) std::atomic<unsigned int> m_active{0u};  // threads (except the caller) still working on it
+
+        void execute( unsigned int thread_number )
+        {
+            unsigned int i;
+            while ((i = m_next.fetch_add(1u, std::memory_order_relaxed)) < m_uiSize) {
+                TRACE_SPAN_BEGIN(ts_chunk);
+                m_invoke(m_pContext, i, thread_number);
+                TRACE_SPAN_END(ts_chunk, "chunk", i);
+            }
+        }
+
+        void run_erased( unsigned int n, invoke_t invoke, void *context )
+        {
+
+            // nothing to share
+            if (m_uiNumThreads == 1u || n <= 1u) {
+                for (unsigned int i = 0u; i < n; i++) invoke(context, i, 0u);
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_invoke = invoke;
+                m_pContext = context;
+                m_uiSize = n;
+                m_next.store(0u, std::memory_order_relaxed);
+                m_active.store(m_uiNumThreads - 1u, std::memory_order_relaxed);
+                m_ulGeneration++;
+            }
+            m_start.notify_all();
+
+            execute(0u);
+
+            // the barrier at the end of the run
+            TRACE_SPAN_BEGIN(ts_wait);
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_done.wait(lock, [this] { return m_active.load(std::memory_order_acquire) == 0u; });
+            TRACE_SPAN_END(ts_wait, "join wait", n);
+
+        }
+
+        void work( unsigned int thread_number, int cpu )
+        {
+            pin_thread(cpu);
+            unsigned long generation = 0u;
+            while (true) {
+                {
+                    TRACE_SPAN_BEGIN(ts_idle);
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_start.wait(lock, [&] { return m_bStop || m_ulGeneration != generation; });
+                    if (m_bStop) return;
+                    generation = m_ulGeneration;
+                    TRACE_SPAN_END(ts_idle, "idle", generation);
+                }
+                execute(thread_number);
+                if (m_active.fetch_sub(1u, std::memory_order_acq_rel) == 1u) {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_done.notify_one();
+                }
+            }
+        }
+
+};
+
+#endif
@@ -0,0 +1,300 @@
+#ifndef __HEADER_TOPOLOGY__
+#define __HEADER_TOPOLOGY__
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * The CPUs this process may actually use and how they are built, read once from the kernel:
+ *  - the allowed CPUs (affinity mask, which includes the cpuset of the cgroup)
+ *  - the CPU quota of the cgroup (v2 cpu.max or v1 cfs quota), a container with "--cpus=2"
+ *    gets the time of two CPUs, no matter how many it may run on
+ *  - physical cores (SMT siblings), NUMA nodes and the cache sizes from sysfs
+ * Everything falls back to "one core per CPU, one node" if sysfs is not there.
+ *
+ * MAX_CPUS stays the way to set the thread count explicitly, the topology only decides when it
+ * is not set (or not a number).
+ */
+
+// TYPEDEFS
+
+struct cpu_info_t {
+    int cpu;            // number of the CPU for the affinity
+    int core;           // physical core, the same for all SMT siblings (counted from 0)
+    int node;           // NUMA node
+};
+
+enum thread_policy_t {
+    THREADS_ALL_CPUS,           // one thread per usable CPU (compute bound work, SMT helps to hide latencies)
+    THREADS_PHYSICAL_CORES      // one thread per physical core (bandwidth bound work, siblings only compete)
+};
+
+struct topology_t {
+    std::vector<cpu_info_t> cpus;       // the allowed CPUs in ascending order
+    unsigned int num_cores = 0u;        // physical cores among the allowed CPUs
+    unsigned int num_nodes = 0u;        // NUMA nodes among the allowed CPUs
+    double cpu_quota = 0.0;             // CPUs worth of time of the cgroup, 0 if not limited
+    size_t l1d_size = 0u;               // per core, 0 if unknown
+    size_t l2_size = 0u;
+    size_t l3_size = 0u;                // per instance
+    unsigned int l3_cpus = 0u;          // CPUs that share one L3
+
+    /**
+     * @brief The amount of CPUs there is time for: the allowed ones, limited by the quota
+     */
+    unsigned int usable_cpus() const
+    {
+        unsigned int usable = cpus.empty() ? 1u : cpus.size();
+        if (cpu_quota > 0.0) usable = std::min(usable, (unsigned int)std::max(1.0, ceil(cpu_quota)));
+        return usable;
+    }
+
+    /**
+     * @brief The thread count for a kind of work, MAX_CPUS wins if it is set
+     */
+    unsigned int threads( thread_policy_t policy ) const
+    {
+        const char *NUM_CORES_STRING = getenv("MAX_CPUS");
+        if (NUM_CORES_STRING != NULL) {
+            char *end;
+            const long max_cpus = strtol(NUM_CORES_STRING, &end, 10);
+            if (end != NUM_CORES_STRING && max_cpus > 0) return max_cpus;
+        }
+        if (policy == THREADS_PHYSICAL_CORES) return std::max(1u, std::min(usable_cpus(), num_cores));
+        return usable_cpus();
+    }
+
+    /**
+     * @brief The CPU for every one of num_threads threads: one CPU per physical core first,
+     * spread round robin over the NUMA nodes, then the SMT siblings, then from the start again
+     */
+    std::vector<int> thread_cpus( unsigned int num_threads ) const
+    {
+        // cores of every node, in the order of their first CPU
+        std::map<int, std::vector<std::vector<int>>> nodes;
+        std::map<int, std::pair<int, size_t>> core_slots;      // core -> node, index in the node
+        for (const cpu_info_t &info : cpus) {
+            auto slot = core_slots.find(info.core);
+            if (slot == core_slots.end()) {
+                auto &node_cores = nodes[info.node];
+                slot = core_slots.insert({ info.core, { info.node, node_cores.size() } }).first;
+                node_cores.emplace_back();
+            }
+            nodes[slot->second.first][slot->second.second].push_back(info.cpu);
+        }
+
+        std::vector<int> order;
+        for (size_t sibling = 0u; order.size() < cpus.size(); sibling++) {
+            for (size_t core = 0u;; core++) {
+                bool any_left = false;
+                for (auto &node : nodes) {
+                    if (core >= node.second.size()) continue;
+                    any_left = true;
+                    if (sibling < node.second[core].size()) order.push_back(node.second[core][sibling]);
+                }
+                if (!any_left) break;
+            }
+        }
+
+        std::vector<int> plan(num_threads, -1);
+        for (unsigned int t = 0u; t < num_threads && !order.empty(); t++) plan[t] = order[t % order.size()];
+        return plan;
+    }
+};
+
+// FUNCTIONS
+
+// parses a cpu list like "0-3,8,10-11"
+inline std::set<int> parse_cpu_list( const std::string &list )
+{
+    std::set<int> result;
+    const char *ptr = list.c_str();
+    char *end;
+    while (*ptr != '\0') {
+        const long first = strtol(ptr, &end, 10);
+        if (end == ptr) break;
+        long last = first;
+        ptr = end;
+        if (*ptr == '-') {
+            last = strtol(ptr + 1, &end, 10);
+            ptr = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++) result.insert(cpu);
+        while (*ptr == ',' || *ptr == '\n' || *ptr == ' ') ptr++;
+    }
+    return result;
+}
+
+inline bool read_text_file( const std::string &path, std::string &content )
+{
+    std::ifstream file(path);
+    if (!file) return false;
+    std::getline(file, content, '\0');
+    return true;
+}
+
+// "32K", "1024K", "8M" of the sysfs cache sizes
+inline size_t parse_size( const std::string &text )
+{
+    char *end;
+    size_t size = strtoul(text.c_str(), &end, 10);
+    if (*end == 'K') size <<= 10;
+    else if (*end == 'M') size <<= 20;
+    else if (*end == 'G') size <<= 30;
+    return size;
+}
+
+// path of the own cgroup v2 below /sys/fs/cgroup, the entry looks like "0::/some/path"
+inline std::string cgroup_directory()
+{
+    std::string cgroups, path;
+    if (read_text_file("/proc/self/cgroup", cgroups)) {
+        const size_t pos = cgroups.find("0::");
+        if (pos != std::string::npos) path = cgroups.substr(pos + 3u, cgroups.find('\n', pos) - pos - 3u);
+    }
+    if (path == "/") path = "";
+    return "/sys/fs/cgroup" + path;
+}
+
+// CPU time limit of the own cgroup, 0 if there is none
+inline double read_cpu_quota()
+{
+    std::string content;
+
+    // cgroup v2: "<quota> <period>" or "max <period>", checked for the own cgroup and the root of the namespace
+    for (const std::string &dir : { cgroup_directory(), std::string("/sys/fs/cgroup") }) {
+        if (!read_text_file(dir + "/cpu.max", content)) continue;
+        if (content.compare(0u, 3u, "max") == 0) return 0.0;
+        double quota, period;
+        if (sscanf(content.c_str(), "%lf %lf", &quota, &period) == 2 && period > 0.0) return quota / period;
+    }
+
+    // cgroup v1
+    std::string quota, period;
+    if (read_text_file("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", quota) && read_text_file("/sys/fs/cgroup/cpu/cpu.cfs_period_us", period)) {
+        const double q = atof(quota.c_str()), p = atof(period.c_str());
+        if (q > 0.0 && p > 0.0) return q / p;
+    }
+    return 0.0;
+}
+
+inline topology_t detect_topology()
+{
+    topology_t topology;
+    const std::string sysfs = "/sys/devices/system/cpu/cpu";
+    std::string content;
+
+    // the affinity mask already is the intersection with the cpuset of the cgroup
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        CPU_ZERO(&allowed);
+        CPU_SET(0, &allowed);
+    }
+
+    // the cpuset of the cgroup on its own, in case the mask was set before the cgroup changed
+    if (read_text_file(cgroup_directory() + "/cpuset.cpus.effective", content) || read_text_file("/sys/fs/cgroup/cpuset/cpuset.effective_cpus", content)) {
+        const std::set<int> cpuset = parse_cpu_list(content);
+        cpu_set_t restricted;
+        CPU_ZERO(&restricted);
+        for (int cpu : cpuset) if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) CPU_SET(cpu, &restricted);
+        if (CPU_COUNT(&restricted) > 0) allowed = restricted;
+    }
+
+    // NUMA nodes
+    std::map<int, int> node_of;
+    if (read_text_file("/sys/devices/system/node/online", content)) {
+        for (int node : parse_cpu_list(content)) {
+            std::string cpu_list;
+            if (!read_text_file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist", cpu_list)) continue;
+            for (int cpu : parse_cpu_list(cpu_list)) node_of[cpu] = node;
+        }
+    }
+
+    // cores, the first CPU in the sibling list of a CPU names the core
+    std::map<int, int> core_index;
+    std::set<int> nodes;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed)) continue;
+        int first_sibling = cpu;
+        if (read_text_file(sysfs + std::to_string(cpu) + "/topology/thread_siblings_list", content)) {
+            const std::set<int> siblings = parse_cpu_list(content);
+            if (!siblings.empty()) first_sibling = *siblings.begin();
+        }
+        auto core = core_index.insert({ first_sibling, (int)core_index.size() }).first;
+        const auto node = node_of.find(cpu);
+        cpu_info_t info;
+        info.cpu = cpu;
+        info.core = core->second;
+        info.node = node == node_of.end() ? 0 : node->second;
+        topology.cpus.push_back(info);
+        nodes.insert(info.node);
+    }
+    topology.num_cores = core_index.size();
+    topology.num_nodes = nodes.size();
+    topology.cpu_quota = read_cpu_quota();
+
+    // caches of the first allowed CPU
+    const std::string cache = sysfs + std::to_string(topology.cpus.empty() ? 0 : topology.cpus[0].cpu) + "/cache/index";
+    for (int index = 0; index < 8; index++) {
+        std::string level, type, size, shared;
+        if (!read_text_file(cache + std::to_string(index) + "/level", level) || !read_text_file(cache + std::to_string(index) + "/type", type)
+            || !read_text_file(cache + std::to_string(index) + "/size", size)) break;
+        if (type.compare(0u, 11u, "Instruction") == 0) continue;
+        switch (atoi(level.c_str())) {
+            case 1: topology.l1d_size = parse_size(size); break;
+            case 2: topology.l2_size = parse_size(size); break;
+            case 3:
+                topology.l3_size = parse_size(size);
+                if (read_text_file(cache + std::to_string(index) + "/shared_cpu_list", shared)) topology.l3_cpus = parse_cpu_list(shared).size();
+                break;
+        }
+    }
+
+    return topology;
+}
+
+/**
+ * @brief The topology of the machine, detected on the first call
+ */
+inline const topology_t &system_topology()
+{
+    static const topology_t topology = detect_topology();
+    return topology;
+}
+
+/**
+ * @brief Restricts the calling thread to one CPU, does nothing for cpu < 0
+ */
+inline bool pin_thread( int cpu )
+{
+    if (cpu < 0) return true;
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) == 0;
+}
+
+/**
+ * @brief One line summary for the log of the binaries
+ */
+inline std::string describe_topology( const topology_t &topology )
+{
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "%zu cpus (%u cores, %u nodes), quota %.2f, L1d %zuK, L2 %zuK, L3 %zuK per %u cpus",
+        topology.cpus.size(), topology.num_cores, topology.num_nodes, topology.cpu_quota,
+        topology.l1d_size >> 10, topology.l2_size >> 10, topology.l3_size >> 10, topology.l3_cpus);
+    return buffer;
+}
+
+#endif
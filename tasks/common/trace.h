@@ -0,0 +1,177 @@
+#ifndef __HEADER_TRACE__
+#define __HEADER_TRACE__
+
+/*
+ * Timeline of the scheduling events of the tasks (chunk grabs, waits of the threads for each
+ * other, input/output phases) for chrome://tracing or https://ui.perfetto.dev. Works from C and
+ * C++, build with -D ENABLE_TRACE (the "trace" targets of the Makefiles):
+ *
+ *   TRACE_SPAN_BEGIN(ts);                  // takes a timestamp
+ *   ...
+ *   TRACE_SPAN_END(ts, "chunk", begin);    // one event from ts until now, the name must be a literal
+ *   TRACE_INSTANT("grab", chunk);          // one event without duration
+ *   TRACE_SCOPE("write output", 0);        // C++ only: span until the end of the scope
+ *
+ * Every thread writes into its own ring of TRACE_RING_SIZE events (the oldest get overwritten),
+ * so recording is a TSC read and four stores without any synchronization. At exit all rings are
+ * written to $TRACE_FILE (default trace.json) as Chrome trace JSON.
+ *
+ * Without ENABLE_TRACE all macros expand to nothing, the arguments are not even evaluated, so a
+ * normal build has no overhead at all.
+ */
+
+#ifdef ENABLE_TRACE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+#endif
+
+// TYPEDEFS
+#define TRACE_RING_SIZE 65536u      // events per thread, 2 MiB
+
+typedef struct {
+    uint64_t begin;         // ticks of trace_now()
+    uint64_t duration;      // ticks, 0 for an instant event
+    const char *name;
+    uint64_t arg;
+} trace_event_t;
+
+typedef struct trace_ring_s {
+    uint64_t count;                 // events written so far, only written by the owning thread
+    struct trace_ring_s *next;
+    int tid;
+    trace_event_t events[TRACE_RING_SIZE];
+} trace_ring_t;
+
+// GLOBALS
+// weak, so all translation units of a binary share one set of rings
+__attribute__((weak)) trace_ring_t *trace_rings = NULL;
+__attribute__((weak)) __thread trace_ring_t *trace_own_ring = NULL;
+__attribute__((weak)) int trace_num_rings = 0;
+__attribute__((weak)) uint64_t trace_start_ticks = 0;
+__attribute__((weak)) int64_t trace_start_ns = 0;
+
+// FUNCTIONS
+
+static inline int64_t trace_clock_ns( void )
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000ll + ts.tv_nsec;
+}
+
+static inline uint64_t trace_now( void )
+{
+    #if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+    #else
+        return trace_clock_ns();
+    #endif
+}
+
+/**
+ * @brief Writes all rings as Chrome trace JSON, registered with atexit()
+ */
+static void trace_dump( void )
+{
+    const char *path = getenv("TRACE_FILE") != NULL ? getenv("TRACE_FILE") : "trace.json";
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Could not write the trace to %s\n", path);
+        return;
+    }
+
+    // ticks per microsecond since the first event
+    const double ticks_per_us = (trace_now() - trace_start_ticks) / ((trace_clock_ns() - trace_start_ns) / 1000.0);
+    const int pid = getpid();
+    uint64_t written = 0u, dropped = 0u, i, first, count;
+    const char *separator = "";
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    trace_ring_t *ring;
+    for (ring = __atomic_load_n(&trace_rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+        count = __atomic_load_n(&ring->count, __ATOMIC_ACQUIRE);
+        first = count > TRACE_RING_SIZE ? count - TRACE_RING_SIZE : 0u;
+        dropped += first;
+        fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}", separator, pid, ring->tid, ring->tid);
+        separator = ",";
+        for (i = first; i < count; i++) {
+            const trace_event_t *e = &ring->events[i % TRACE_RING_SIZE];
+            const double ts = (double)(int64_t)(e->begin - trace_start_ticks) / ticks_per_us;
+            if (e->duration == 0u) {
+                fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"arg\":%llu}}",
+                    e->name, ts, pid, ring->tid, (unsigned long long)e->arg);
+            } else {
+                fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"arg\":%llu}}",
+                    e->name, ts, e->duration / ticks_per_us, pid, ring->tid, (unsigned long long)e->arg);
+            }
+            written++;
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    fprintf(stderr, "Trace of %llu events written to %s (%llu overwritten)\n", (unsigned long long)written, path, (unsigned long long)dropped);
+}
+
+// creates the ring of the calling thread, the first one also starts the clock
+static trace_ring_t *trace_register( void )
+{
+    trace_ring_t *ring = (trace_ring_t*)calloc(1u, sizeof(trace_ring_t));
+    if (ring == NULL) abort();
+    ring->tid = __atomic_fetch_add(&trace_num_rings, 1, __ATOMIC_RELAXED);
+    if (ring->tid == 0) {
+        trace_start_ns = trace_clock_ns();
+        trace_start_ticks = trace_now();
+        atexit(trace_dump);
+    }
+    ring->next = __atomic_load_n(&trace_rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&trace_rings, &ring->next, ring, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    trace_own_ring = ring;
+    return ring;
+}
+
+static inline void trace_record( const char *name, uint64_t begin, uint64_t duration, uint64_t arg )
+{
+    trace_ring_t *ring = trace_own_ring != NULL ? trace_own_ring : trace_register();
+    trace_event_t *e = &ring->events[ring->count % TRACE_RING_SIZE];
+    e->begin = begin;
+    e->duration = duration;
+    e->name = name;
+    e->arg = arg;
+    __atomic_store_n(&ring->count, ring->count + 1u, __ATOMIC_RELEASE);
+}
+
+#define TRACE_SPAN_BEGIN(var) const uint64_t var = trace_now()
+#define TRACE_SPAN_END(var, name, arg) trace_record(name, var, trace_now() - (var) + 1u, arg)
+#define TRACE_INSTANT(name, arg) trace_record(name, trace_now(), 0u, arg)
+
+#ifdef __cplusplus
+struct trace_scope_t {
+    const char *name;
+    uint64_t arg;
+    uint64_t begin;
+    trace_scope_t( const char *name, uint64_t arg ) : name(name), arg(arg), begin(trace_now()) {}
+    ~trace_scope_t() { trace_record(name, begin, trace_now() - begin + 1u, arg); }
+};
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name, arg) trace_scope_t TRACE_CONCAT(trace_scope_, __LINE__)(name, arg)
+#endif
+
+#else
+
+#define TRACE_SPAN_BEGIN(var) ((void)0)
+#define TRACE_SPAN_END(var, name, arg) ((void)0)
+#define TRACE_INSTANT(name, arg) ((void)0)
+#define TRACE_SCOPE(name, arg) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,414 @@
+#ifndef __HEADER_CACHE__
+#define __HEADER_CACHE__
+
+#include "protocol.h"
+
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Content addressed cache of job results. Every entry is one file <hash of the key>.cache in the
+ * cache directory, the key is stored in the file as well, so a collision is a miss:
+ *
+ *   cache_file_header_t | key | padding to 64 bytes | data
+ *
+ * Entries that got used are mapped read only and the data gets served right from the mapping.
+ * The mappings are kept in a LRU list up to a memory budget, the files in a second LRU list up to
+ * a disk budget (ordered by their mtime after a restart).
+ *
+ * Besides the outputs the cache keeps Himeno fields under "himeno-field <type> <rows> <cols> <deps> <updates>",
+ * so a run with more iterations can continue from the field of a shorter run of the same size and type.
+ */
+
+// TYPEDEFS
+#define CACHE_MAGIC "CDSCACHE"
+#define CACHE_DATA_ALIGNMENT 64u
+
+struct cache_file_header_t {
+    char magic[8];
+    uint64_t key_size;
+    uint64_t data_size;
+    double compute_seconds;     // time it took to compute the data from scratch
+};
+
+/**
+ * @brief One mapped cache file, unmapped when the last user drops it
+ */
+struct cache_entry_t {
+    std::string key;
+    const char *data = nullptr;
+    size_t size = 0u;
+    double compute_seconds = 0.0;
+    void *map = MAP_FAILED;
+    size_t map_size = 0u;
+
+    ~cache_entry_t() { if (map != MAP_FAILED) munmap(map, map_size); }
+};
+
+typedef std::shared_ptr<const cache_entry_t> cache_entry_ptr_t;
+
+// FUNCTIONS
+
+// FNV-1a, only used for the file names
+inline uint64_t cache_hash( const std::string &key )
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : key) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+inline size_t cache_data_offset( size_t key_size )
+{
+    return (sizeof(cache_file_header_t) + key_size + CACHE_DATA_ALIGNMENT - 1u) / CACHE_DATA_ALIGNMENT * CACHE_DATA_ALIGNMENT;
+}
+
+class result_cache_t {
+
+    public:
+
+        /**
+         * @param directory Directory of the cache files, created if missing. Empty disables the cache
+         * @param memory_bytes Budget of the mapped entries
+         * @param disk_bytes Budget of the cache files
+         */
+        result_cache_t( const std::string &directory, size_t memory_bytes, size_t disk_bytes ) :
+            m_directory(directory),
+            m_memoryBudget(memory_bytes),
+            m_diskBudget(disk_bytes)
+        {
+            if (m_directory.empty()) return;
+            mkdir(m_directory.c_str(), 0755);
+            load_directory();
+        }
+
+        bool enabled() const { return !m_directory.empty(); }
+
+        /**
+         * @brief Looks up the output of a job and counts the hit or miss
+         */
+        cache_entry_ptr_t lookup( const std::string &key )
+        {
+            if (!enabled()) return nullptr;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            bool from_disk;
+            cache_entry_ptr_t entry = open_entry(key, from_disk);
+            if (entry == nullptr) {
+                m_ulMisses++;
+                return nullptr;
+            }
+            (from_disk ? m_ulDiskHits : m_ulMemoryHits)++;
+            m_dSavedSeconds += entry->compute_seconds;
+            return entry;
+        }
+
+        /**
+         * @brief Finds the Himeno field with the most updates that are not more than max_updates
+         * @param updates Set to the updates of the field if one is found
+         */
+        cache_entry_ptr_t lookup_field( const char *type, uint64_t rows, uint64_t cols, uint64_t deps, uint64_t max_updates, uint64_t &updates )
+        {
+            if (!enabled()) return nullptr;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto fields = m_fields.find(field_size_key(type, rows, cols, deps));
+            if (fields == m_fields.end()) return nullptr;
+            // newest first, a field that got evicted in between is skipped
+            for (auto it = fields->second.rbegin(); it != fields->second.rend(); ++it) {
+                if (*it > max_updates) continue;
+                bool from_disk;
+                cache_entry_ptr_t entry = open_entry(field_key(type, rows, cols, deps, *it), from_disk);
+                if (entry == nullptr) continue;
+                updates = *it;
+                m_ulResumed++;
+                m_dSavedSeconds += entry->compute_seconds;
+                return entry;
+            }
+            return nullptr;
+        }
+
+        /**
+         * @brief Writes an entry, replaces an existing one with the same key
+         */
+        void store( const std::string &key, const char *data, size_t size, double compute_seconds )
+        {
+            if (!enabled() || cache_data_offset(key.size()) + size > m_diskBudget) return;
+
+            // write to a temporary file and rename it, so readers never see half a file
+            const std::string path = entry_path(key);
+            const std::string tmp_path = path + ".tmp." + std::to_string(m_uiTmpCounter++);
+            cache_file_header_t header;
+            memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+            header.key_size = key.size();
+            header.data_size = size;
+            header.compute_seconds = compute_seconds;
+            std::string head((const char*)&header, sizeof(header));
+            head += key;
+            head.resize(cache_data_offset(key.size()), '\0');
+
+            const int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) return;
+            const bool written = write_all(fd, head.data(), head.size()) && write_all(fd, data, size);
+            close(fd);
+            if (!written || rename(tmp_path.c_str(), path.c_str()) != 0) {
+                unlink(tmp_path.c_str());
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            forget(key, false);
+            add_disk_entry(key, head.size() + size, true);
+            evict_disk();
+        }
+
+        void store_field( const char *type, uint64_t rows, uint64_t cols, uint64_t deps, uint64_t updates, const char *data, size_t size, double compute_seconds )
+        {
+            store(field_key(type, rows, cols, deps, updates), data, size, compute_seconds);
+        }
+
+        std::string statistics()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!enabled()) return "cache off\n";
+            char buffer[384];
+            snprintf(buffer, sizeof(buffer),
+                "cache hits %lu (memory %lu, disk %lu), misses %lu, resumed himeno %lu, saved %.3fs\n"
+                "cache memory %.1f/%.1f MiB in %zu entries, disk %.1f/%.1f MiB in %zu files, %lu evicted\n",
+                m_ulMemoryHits + m_ulDiskHits, m_ulMemoryHits, m_ulDiskHits, m_ulMisses, m_ulResumed, m_dSavedSeconds,
+                m_memoryBytes/1048576.0, m_memoryBudget/1048576.0, m_memory.size(),
+                m_diskBytes/1048576.0, m_diskBudget/1048576.0, m_disk.size(), m_ulEvictions);
+            return buffer;
+        }
+
+        static std::string field_key( const char *type, uint64_t rows, uint64_t cols, uint64_t deps, uint64_t updates )
+        {
+            return "himeno-field " + field_size_key(type, rows, cols, deps) + " " + std::to_string(updates);
+        }
+
+    private:
+
+        struct disk_entry_t {
+            size_t bytes;
+            std::list<std::string>::iterator lru;
+        };
+
+        struct memory_entry_t {
+            cache_entry_ptr_t entry;
+            std::list<std::string>::iterator lru;
+        };
+
+        const std::string m_directory;
+        const size_t m_memoryBudget;
+        const size_t m_diskBudget;
+
+        std::mutex m_mutex;
+        std::unordered_map<std::string, disk_entry_t> m_disk;
+        std::list<std::string> m_diskLru;                       // front is the most recently used
+        size_t m_diskBytes = 0u;
+        std::unordered_map<std::string, memory_entry_t> m_memory;
+        std::list<std::string> m_memoryLru;
+        size_t m_memoryBytes = 0u;
+        std::map<std::string, std::set<uint64_t>> m_fields;     // cached updates per field size
+        std::atomic<unsigned int> m_uiTmpCounter{0u};
+
+        unsigned long m_ulMemoryHits = 0u;
+        unsigned long m_ulDiskHits = 0u;
+        unsigned long m_ulMisses = 0u;
+        unsigned long m_ulResumed = 0u;
+        unsigned long m_ulEvictions = 0u;
+        double m_dSavedSeconds = 0.0;
+
+        static std::string field_size_key( const char *type, uint64_t rows, uint64_t cols, uint64_t deps )
+        {
+            return std::string(type) + " " + std::to_string(rows) + " " + std::to_string(cols) + " " + std::to_string(deps);
+        }
+
+        std::string entry_path( const std::string &key ) const
+        {
+            char name[32];
+            snprintf(name, sizeof(name), "/%016llx.cache", (unsigned long long)cache_hash(key));
+            return m_directory + name;
+        }
+
+        // returns the mapped entry, maps the file if needed, must be called with the mutex held
+        cache_entry_ptr_t open_entry( const std::string &key, bool &from_disk )
+        {
+            from_disk = false;
+            auto memory = m_memory.find(key);
+            if (memory != m_memory.end()) {
+                m_memoryLru.splice(m_memoryLru.begin(), m_memoryLru, memory->second.lru);
+                touch_disk_entry(key);
+                return memory->second.entry;
+            }
+            if (m_disk.find(key) == m_disk.end()) return nullptr;
+
+            std::shared_ptr<cache_entry_t> entry = map_file(key);
+            if (entry == nullptr) {
+                // gone or replaced by an entry with the same hash
+                forget(key, true);
+                return nullptr;
+            }
+            from_disk = true;
+            touch_disk_entry(key);
+
+            m_memoryLru.push_front(key);
+            m_memory[key] = { entry, m_memoryLru.begin() };
+            m_memoryBytes += entry->map_size;
+            while (m_memoryBytes > m_memoryBudget && m_memoryLru.size() > 1u) {
+                auto victim = m_memory.find(m_memoryLru.back());
+                m_memoryBytes -= victim->second.entry->map_size;
+                m_memory.erase(victim);
+                m_memoryLru.pop_back();
+            }
+            return entry;
+        }
+
+        std::shared_ptr<cache_entry_t> map_file( const std::string &key ) const
+        {
+            const int fd = open(entry_path(key).c_str(), O_RDONLY);
+            if (fd < 0) return nullptr;
+            struct stat st;
+            auto entry = std::make_shared<cache_entry_t>();
+            if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(cache_file_header_t)) {
+                entry->map_size = st.st_size;
+                entry->map = mmap(nullptr, entry->map_size, PROT_READ, MAP_SHARED, fd, 0);
+            }
+            close(fd);
+            if (entry->map == MAP_FAILED) return nullptr;
+
+            const cache_file_header_t *header = (const cache_file_header_t*)entry->map;
+            const char *base = (const char*)entry->map;
+            if (memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0 || header->key_size != key.size()
+                || cache_data_offset(header->key_size) + header->data_size != entry->map_size
+                || memcmp(base + sizeof(cache_file_header_t), key.data(), key.size()) != 0) return nullptr;
+
+            entry->key = key;
+            entry->data = base + cache_data_offset(header->key_size);
+            entry->size = header->data_size;
+            entry->compute_seconds = header->compute_seconds;
+            return entry;
+        }
+
+        void add_disk_entry( const std::string &key, size_t bytes, bool newest )
+        {
+            if (newest) m_diskLru.push_front(key);
+            else m_diskLru.push_back(key);
+            m_disk[key] = { bytes, newest ? m_diskLru.begin() : std::prev(m_diskLru.end()) };
+            m_diskBytes += bytes;
+
+            uint64_t rows, cols, deps, updates;
+            char type[16];
+            if (sscanf(key.c_str(), "himeno-field %15s %lu %lu %lu %lu", type, &rows, &cols, &deps, &updates) == 5) {
+                m_fields[field_size_key(type, rows, cols, deps)].insert(updates);
+            }
+        }
+
+        // deletes the least recently used files until the disk budget holds, keeps the newest one
+        void evict_disk()
+        {
+            while (m_diskBytes > m_diskBudget && m_diskLru.size() > 1u) {
+                const std::string victim = m_diskLru.back();
+                unlink(entry_path(victim).c_str());
+                forget(victim, true);
+                m_ulEvictions++;
+            }
+        }
+
+        // moves the entry to the front, the mtime keeps the order over restarts
+        void touch_disk_entry( const std::string &key )
+        {
+            auto disk = m_disk.find(key);
+            if (disk == m_disk.end()) return;
+            m_diskLru.splice(m_diskLru.begin(), m_diskLru, disk->second.lru);
+            utimensat(AT_FDCWD, entry_path(key).c_str(), nullptr, 0);
+        }
+
+        // drops the entry from the indices, the mapping lives on while it is used
+        void forget( const std::string &key, bool including_field )
+        {
+            auto disk = m_disk.find(key);
+            if (disk != m_disk.end()) {
+                m_diskBytes -= disk->second.bytes;
+                m_diskLru.erase(disk->second.lru);
+                m_disk.erase(disk);
+            }
+            auto memory = m_memory.find(key);
+            if (memory != m_memory.end()) {
+                m_memoryBytes -= memory->second.entry->map_size;
+                m_memoryLru.erase(memory->second.lru);
+                m_memory.erase(memory);
+            }
+            uint64_t rows, cols, deps, updates;
+            char type[16];
+            if (including_field && sscanf(key.c_str(), "himeno-field %15s %lu %lu %lu %lu", type, &rows, &cols, &deps, &updates) == 5) {
+                m_fields[field_size_key(type, rows, cols, deps)].erase(updates);
+            }
+        }
+
+        // indexes the files of a former run, oldest last
+        void load_directory()
+        {
+            DIR *dir = opendir(m_directory.c_str());
+            if (dir == nullptr) return;
+
+            struct file_t {
+                std::string key;
+                size_t bytes;
+                struct timespec mtime;
+            };
+            std::vector<file_t> files;
+            struct dirent *item;
+            while ((item = readdir(dir)) != nullptr) {
+
+                const std::string path = m_directory + "/" + item->d_name;
+                if (strstr(item->d_name, ".cache.tmp.") != nullptr) {
+                    unlink(path.c_str());
+                    continue;
+                }
+                const size_t length = strlen(item->d_name);
+                if (length < 6u || strcmp(item->d_name + length - 6u, ".cache") != 0) continue;
+
+                // only the header and the key get read
+                cache_file_header_t header;
+                struct stat st;
+                const int fd = open(path.c_str(), O_RDONLY);
+                if (fd < 0) continue;
+                bool valid = fstat(fd, &st) == 0 && pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header)
+                    && memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) == 0 && header.key_size <= MAX_LINE_LENGTH
+                    && cache_data_offset(header.key_size) + header.data_size == (uint64_t)st.st_size;
+                std::string key(valid ? header.key_size : 0u, '\0');
+                valid = valid && pread(fd, &key[0], key.size(), sizeof(header)) == (ssize_t)key.size() && entry_path(key) == path;
+                close(fd);
+                if (valid) files.push_back({ key, (size_t)st.st_size, st.st_mtim });
+
+            }
+            closedir(dir);
+
+            std::sort(files.begin(), files.end(), []( const file_t &a, const file_t &b ) {
+                return a.mtime.tv_sec != b.mtime.tv_sec ? a.mtime.tv_sec > b.mtime.tv_sec : a.mtime.tv_nsec > b.mtime.tv_nsec;
+            });
+            for (const file_t &file : files) add_disk_entry(file.key, file.bytes, false);
+            evict_disk();
+        }
+
+};
+
+#endif
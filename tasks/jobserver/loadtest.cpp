@@ -0,0 +1,185 @@
+/*
+ * Load test client for the job server
+ *
+ * Usage: ./loadtest [--socket path] [--clients n] [--requests n] [--jobs "job;job;..."]
+ *
+ * Every client opens its own connection and sends its requests one after the other, cycling
+ * through the given jobs (e.g. "harmonic 100 1000;mandelbrot 23 79 240;himeno 16 16 32 3").
+ * Prints the throughput, the latency seen by the clients and the queue and service times the
+ * server reported per job, then the statistics of the server.
+ */
+
+#include "protocol.h"
+#include "../benchmark/stats.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+
+// TYPEDEFS
+
+struct job_samples_t {
+    vector<double> latency_us;
+    vector<double> queue_us;
+    vector<double> service_us;
+    unsigned long errors = 0u;
+};
+
+// FUNCTIONS
+
+static int connect_to( const string &path )
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1u);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0) return fd;
+    if (fd >= 0) close(fd);
+    return -1;
+}
+
+/**
+ * @brief Sends one request and reads its response
+ * @return false if the connection broke, an ERR response counts as an error of the job
+ */
+static bool request( int fd, socket_reader_t &reader, const string &job, string &output, long long &queue_us, long long &service_us, bool &is_error )
+{
+    const string line = job + "\n";
+    string header;
+    size_t bytes;
+    if (!write_all(fd, line.data(), line.size()) || !reader.read_line(header)) return false;
+    is_error = header.compare(0u, 3u, "OK ") != 0;
+    if (is_error) {
+        output = header;
+        return true;
+    }
+    if (sscanf(header.c_str(), "OK %zu %lld %lld", &bytes, &queue_us, &service_us) != 3) return false;
+    return reader.read_bytes(output, bytes);
+}
+
+static void print_row( const char *name, const vector<double> &samples )
+{
+    const sample_stats_t s = compute_stats(samples);
+    printf("  %-8s %10.0f %10.0f %10.0f %10.0f %10.0f\n", name, s.mean, s.median, s.p90, s.p99, s.max);
+}
+
+int main( int argc, char *argv[] ) {
+
+    // read the options
+    string socket_path = DEFAULT_SOCKET_PATH;
+    unsigned long num_clients = 4u, num_requests = 100u;
+    string job_list = "harmonic 100 1000;mandelbrot 23 79 240;himeno 16 16 32 3";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--socket") == 0) socket_path = argv[i+1];
+        else if (strcmp(argv[i], "--clients") == 0) num_clients = strtoul(argv[i+1], NULL, 10);
+        else if (strcmp(argv[i], "--requests") == 0) num_requests = strtoul(argv[i+1], NULL, 10);
+        else if (strcmp(argv[i], "--jobs") == 0) job_list = argv[i+1];
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (num_clients < 1u) num_clients = 1u;
+
+    vector<string> jobs;
+    for (size_t begin = 0u, end; begin <= job_list.size(); begin = end + 1u) {
+        end = job_list.find(';', begin);
+        if (end == string::npos) end = job_list.size();
+        if (end > begin) jobs.push_back(job_list.substr(begin, end - begin));
+    }
+    if (jobs.empty()) {
+        fprintf(stderr, "No jobs given\n");
+        return 1;
+    }
+
+    // samples[client][job], merged after the run so the clients need no locking
+    vector<vector<job_samples_t>> samples(num_clients, vector<job_samples_t>(jobs.size()));
+    vector<bool> failed(num_clients, false);
+    vector<thread> clients;
+
+    const auto ts_begin = chrono::steady_clock::now();
+    for (unsigned long c = 0u; c < num_clients; c++) clients.emplace_back([&, c]() {
+        const int fd = connect_to(socket_path);
+        if (fd < 0) {
+            failed[c] = true;
+            return;
+        }
+        socket_reader_t reader(fd);
+        string output;
+        long long queue_us = 0, service_us = 0;
+        bool is_error;
+        for (unsigned long r = 0u; r < num_requests; r++) {
+            // every client starts at another job, so the mix is the same at all times
+            const size_t j = (c + r) % jobs.size();
+            const auto ts_request = chrono::steady_clock::now();
+            if (!request(fd, reader, jobs[j], output, queue_us, service_us, is_error)) {
+                failed[c] = true;
+                break;
+            }
+            job_samples_t &s = samples[c][j];
+            if (is_error) {
+                if (s.errors++ == 0u) fprintf(stderr, "%s: %s\n", jobs[j].c_str(), output.c_str());
+                continue;
+            }
+            s.latency_us.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - ts_request).count());
+            s.queue_us.push_back(queue_us);
+            s.service_us.push_back(service_us);
+        }
+        close(fd);
+    });
+    for (auto &client : clients) client.join();
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - ts_begin).count();
+
+    for (unsigned long c = 0u; c < num_clients; c++) {
+        if (failed[c]) {
+            fprintf(stderr, "Client %lu lost the connection to %s\n", c, socket_path.c_str());
+            return 1;
+        }
+    }
+
+    unsigned long total = 0u;
+    printf("%lu clients x %lu requests in %.3fs\n", num_clients, num_requests, seconds);
+    for (size_t j = 0u; j < jobs.size(); j++) {
+        job_samples_t merged;
+        for (unsigned long c = 0u; c < num_clients; c++) {
+            const job_samples_t &s = samples[c][j];
+            merged.latency_us.insert(merged.latency_us.end(), s.latency_us.begin(), s.latency_us.end());
+            merged.queue_us.insert(merged.queue_us.end(), s.queue_us.begin(), s.queue_us.end());
+            merged.service_us.insert(merged.service_us.end(), s.service_us.begin(), s.service_us.end());
+            merged.errors += s.errors;
+        }
+        total += merged.latency_us.size();
+        printf("%s: %zu ok, %lu errors\n", jobs[j].c_str(), merged.latency_us.size(), merged.errors);
+        if (merged.latency_us.empty()) continue;
+        printf("  %-8s %10s %10s %10s %10s %10s\n", "", "mean_us", "p50_us", "p90_us", "p99_us", "max_us");
+        print_row("latency", merged.latency_us);
+        print_row("queue", merged.queue_us);
+        print_row("service", merged.service_us);
+    }
+    printf("throughput: %.1f jobs/s\n", total / seconds);
+
+    // statistics of the server over all its clients
+    const int fd = connect_to(socket_path);
+    if (fd >= 0) {
+        socket_reader_t reader(fd);
+        string output;
+        long long queue_us, service_us;
+        bool is_error;
+        if (request(fd, reader, "stats", output, queue_us, service_us, is_error) && !is_error) printf("\nserver:\n%s", output.c_str());
+        close(fd);
+    }
+
+    return 0;
+
+}
@@ -0,0 +1,170 @@
+#ifndef __HEADER_PROTOCOL__
+#define __HEADER_PROTOCOL__
+
+#include <string>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Line based protocol of the job server on a unix stream socket. A client sends one request
+ * per line and gets one response per request, in order:
+ *
+ *   himeno <rows> <cols> <deps> <iterations>    ->  OK <bytes> <queue_us> <service_us>\n<output>
+ *   mandelbrot <rows> <cols> <iterations>
+ *   harmonic <d> <n>
+ *   stats                                       ->  OK <bytes> 0 0\n<statistics as text>
+ *   anything else or invalid parameters         ->  ERR <message>\n
+ *
+ * The output is exactly what the command line binary prints for the same input.
+ */
+
+// TYPEDEFS
+#define DEFAULT_SOCKET_PATH "/tmp/cds-jobs.sock"
+#define MAX_LINE_LENGTH 256u
+
+enum job_kind_t { JOB_HIMENO, JOB_MANDELBROT, JOB_HARMONIC, JOB_STATS };
+
+struct job_spec_t {
+    job_kind_t kind;
+    uint64_t args[4];
+};
+
+// FUNCTIONS
+
+/**
+ * @brief Parses one request line
+ * @return false with a message in error if the request is invalid
+ */
+bool parse_job( const std::string &line, job_spec_t &spec, std::string &error )
+{
+    char name[16];
+    unsigned long long a[5];
+    const int fields = sscanf(line.c_str(), "%15s %llu %llu %llu %llu %llu", name, &a[0], &a[1], &a[2], &a[3], &a[4]);
+
+    if (fields >= 1 && strcmp(name, "stats") == 0 && fields == 1) {
+        spec.kind = JOB_STATS;
+        return true;
+    }
+    if (fields >= 1 && strcmp(name, "himeno") == 0 && fields == 5) {
+        if (a[0] < 3u || a[1] < 3u || a[2] < 3u || a[0] > 4096u || a[1] > 4096u || a[2] > 4096u || (a[0]-2u)*(a[1]-2u)*(a[2]-2u) > (1ull << 28)) {
+            error = "himeno needs 3 <= rows, cols, deps <= 4096 and at most 2^28 inner points";
+            return false;
+        }
+        spec.kind = JOB_HIMENO;
+    } else if (fields >= 1 && strcmp(name, "mandelbrot") == 0 && fields == 4) {
+        if (a[0] < 1u || a[1] < 1u || a[0] > 65536u || a[1] > 65536u || a[0]*(a[1]+1u) > (1ull << 30)) {
+            error = "mandelbrot needs 1 <= rows, cols <= 65536 and an image of at most 1 GiB";
+            return false;
+        }
+        spec.kind = JOB_MANDELBROT;
+    } else if (fields >= 1 && strcmp(name, "harmonic") == 0 && fields == 3) {
+        if (a[0] < 1u || a[1] < 1u || a[0] > (1ull << 26)) {
+            error = "harmonic needs 1 <= d <= 2^26 and n >= 1";
+            return false;
+        }
+        spec.kind = JOB_HARMONIC;
+    } else {
+        error = "unknown request, expected himeno/mandelbrot/harmonic with their input or stats";
+        return false;
+    }
+
+    for (int i = 0; i < 4; i++) spec.args[i] = i < fields - 1 ? a[i] : 0u;
+    return true;
+}
+
+/**
+ * @brief Rough time of a job on one thread in ns, used to tell small jobs from large ones. The
+ * factors were measured with the default inputs, mandelbrot is an upper bound since most points
+ * escape early. Himeno also pays for faulting in and initializing its two fields, so a large grid
+ * is never a small job, whatever its iterations
+ */
+double job_cost( const job_spec_t &spec )
+{
+    switch (spec.kind) {
+        case JOB_HIMENO: return (10.0 * spec.args[3] + 4.0) * spec.args[0] * spec.args[1] * spec.args[2];
+        case JOB_MANDELBROT: return 2.0 * spec.args[0] * spec.args[1] * spec.args[2];
+        case JOB_HARMONIC: return 12.0 * spec.args[1] * (spec.args[0] / 18u + 1u);
+        default: return 0.0;
+    }
+}
+
+// canonical form of a request, the key of its result in the cache
+std::string job_key( const job_spec_t &spec )
+{
+    switch (spec.kind) {
+        case JOB_HIMENO: return "himeno " + std::to_string(spec.args[0]) + " " + std::to_string(spec.args[1]) + " " + std::to_string(spec.args[2]) + " " + std::to_string(spec.args[3]);
+        case JOB_MANDELBROT: return "mandelbrot " + std::to_string(spec.args[0]) + " " + std::to_string(spec.args[1]) + " " + std::to_string(spec.args[2]);
+        case JOB_HARMONIC: return "harmonic " + std::to_string(spec.args[0]) + " " + std::to_string(spec.args[1]);
+        default: return "stats";
+    }
+}
+
+// writes the whole buffer, returns false on errors
+bool write_all( int fd, const char *buffer, size_t size )
+{
+    ssize_t written;
+    while (size > 0u) {
+        written = write(fd, buffer, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        buffer += written;
+        size -= written;
+    }
+    return true;
+}
+
+/**
+ * @brief Buffered reading of lines and raw bytes from a socket
+ */
+class socket_reader_t {
+
+    public:
+
+        explicit socket_reader_t( int fd ) : m_fd(fd) {}
+
+        // reads up to the next newline (not included), false on end of stream or errors
+        bool read_line( std::string &line )
+        {
+            line.clear();
+            while (true) {
+                const size_t newline = m_buffer.find('\n');
+                if (newline != std::string::npos) {
+                    line = m_buffer.substr(0u, newline);
+                    m_buffer.erase(0u, newline + 1u);
+                    return true;
+                }
+                if (m_buffer.size() > MAX_LINE_LENGTH || !fill()) return false;
+            }
+        }
+
+        // reads exactly size bytes
+        bool read_bytes( std::string &out, size_t size )
+        {
+            while (m_buffer.size() < size) if (!fill()) return false;
+            out.assign(m_buffer, 0u, size);
+            m_buffer.erase(0u, size);
+            return true;
+        }
+
+    private:
+
+        int m_fd;
+        std::string m_buffer;
+
+        bool fill()
+        {
+            char chunk[65536];
+            ssize_t length;
+            do length = read(m_fd, chunk, sizeof(chunk)); while (length < 0 && errno == EINTR);
+            if (length <= 0) return false;
+            m_buffer.append(chunk, length);
+            return true;
+        }
+
+};
+
+#endif
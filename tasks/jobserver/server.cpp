@@ -0,0 +1,499 @@
+/*
+ * Local job server for the tasks
+ *
+ * Usage: MAX_CPUS=<threads> ./server [--socket path] [--small-cost ns] [--max-batch n] [--prefault MiB]
+ *                                     [--cache-dir path] [--cache-memory MiB] [--cache-disk MiB]
+ *
+ * Keeps one warm thread pool and per-thread buffers for the whole lifetime and takes jobs over a
+ * unix domain socket (see protocol.h). Jobs are queued in arrival order:
+ *  - small jobs (cost below --small-cost) at the front of the queue are taken as a batch, every
+ *    job of the batch runs single threaded on one thread of the pool
+ *  - large jobs run exclusively on all threads of the pool
+ * Every response contains the time the job waited in the queue and the time it took to run.
+ * Results are kept in a cache (see cache.h, an empty --cache-dir turns it off), cached outputs are
+ * answered right away and Himeno continues from the cached field of the same size with the most
+ * iterations that are not more than the requested ones.
+ * SIGINT/SIGTERM stop the server: queued jobs still run and get answered, new ones are rejected,
+ * every connection thread is joined before the server goes away, then the statistics get printed.
+ */
+
+#include "protocol.h"
+#include "cache.h"
+#include "../libtasks/tasks.h"
+#include "../benchmark/stats.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <future>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+
+// TYPEDEFS
+#define DEFAULT_SMALL_COST 1.0e7   // 10ms of work on one thread, see job_cost()
+#define BATCH_PER_THREAD 4u
+#define LATENCY_SAMPLES 65536u     // latencies of the last jobs kept for the percentiles
+#define DEFAULT_CACHE_DIR "/tmp/cds-cache"
+#define DEFAULT_CACHE_MEMORY_MIB 256u
+#define DEFAULT_CACHE_DISK_MIB 4096u
+#define HIMENO_FIELD_TYPE "float"  // element type of the cached himeno fields
+
+typedef chrono::steady_clock clock_type;
+
+struct job_t {
+    job_spec_t spec;
+    bool exclusive;
+    string output;                  // sized by the connection thread, filled by the pool
+    size_t length = 0u;
+    cache_entry_ptr_t resume;       // cached himeno field to continue from
+    uint64_t resume_updates = 0u;
+    clock_type::time_point arrival;
+    clock_type::time_point start;
+    clock_type::time_point end;
+    promise<void> done;
+};
+
+// a client, the thread serving it is joined and the socket closed by the main thread
+struct connection_t {
+    int fd;
+    thread worker;
+    atomic<bool> finished{false};
+};
+
+// grows on demand and keeps its memory, new memory gets touched once so it is faulted in
+struct scratch_t {
+    char *data = nullptr;
+    size_t size = 0u;
+
+    char *get( size_t bytes )
+    {
+        if (bytes > size) {
+            delete[] data;
+            data = new char[bytes];
+            memset(data, 0, bytes);
+            size = bytes;
+        }
+        return data;
+    }
+
+    ~scratch_t() { delete[] data; }
+};
+
+struct alignas(64) thread_buffers_t {
+    scratch_t p;
+    scratch_t wrk;
+};
+
+class job_server_t {
+
+    public:
+
+        job_server_t( unsigned int num_threads, double small_cost, unsigned int max_batch, size_t prefault_bytes, result_cache_t &cache ) :
+            m_cache(cache),
+            m_pool(num_threads, system_topology().thread_cpus(num_threads)),
+            m_buffers(num_threads),
+            m_dSmallCost(small_cost),
+            m_uiMaxBatch(max_batch == 0u ? BATCH_PER_THREAD*num_threads : max_batch)
+        {
+            // fault in the buffers of all threads on their own threads (first touch), by the thread
+            // and not the work index, a thread may take several indices and get() does nothing twice
+            if (prefault_bytes > 0u) m_pool.run(m_pool.size(), [&]( unsigned int, unsigned int thread_number ) {
+                m_buffers[thread_number].p.get(prefault_bytes/2u);
+                m_buffers[thread_number].wrk.get(prefault_bytes/2u);
+            });
+            // a thread that got no index at all is faulted in here, on the wrong node at worst
+            for (thread_buffers_t &buffers : m_buffers) {
+                buffers.p.get(prefault_bytes/2u);
+                buffers.wrk.get(prefault_bytes/2u);
+            }
+            m_dispatcher = thread(&job_server_t::dispatch, this);
+        }
+
+        ~job_server_t()
+        {
+            stop();
+            m_dispatcher.join();
+        }
+
+        /**
+         * @brief Rejects new jobs, the queued ones still run
+         */
+        void stop()
+        {
+            {
+                lock_guard<mutex> lock(m_mutex);
+                m_bStop = true;
+            }
+            m_queued.notify_all();
+        }
+
+        bool is_exclusive( const job_spec_t &spec ) const { return job_cost(spec) >= m_dSmallCost; }
+
+        result_cache_t &cache() { return m_cache; }
+
+        /**
+         * @brief Queues the job and waits until it is done
+         * @return false if the server is stopping, the job was not run then
+         */
+        bool run( job_t &job )
+        {
+            auto done = job.done.get_future();
+            job.arrival = clock_type::now();
+            {
+                lock_guard<mutex> lock(m_mutex);
+                if (m_bStop) return false;
+                m_queue.push_back(&job);
+            }
+            m_queued.notify_one();
+            done.wait();
+            return true;
+        }
+
+        string statistics()
+        {
+            lock_guard<mutex> lock(m_statsMutex);
+            char buffer[512];
+            const sample_stats_t queue = compute_stats(m_queueUs), service = compute_stats(m_serviceUs);
+            snprintf(buffer, sizeof(buffer),
+                "threads %u\njobs %lu (himeno %lu, mandelbrot %lu, harmonic %lu)\nbatched %lu in %lu batches, exclusive %lu\n"
+                "%-10s %10s %10s %10s %10s %10s\n"
+                "%-10s %10.0f %10.0f %10.0f %10.0f %10.0f\n"
+                "%-10s %10.0f %10.0f %10.0f %10.0f %10.0f\n",
+                m_pool.size(), m_ulJobs[JOB_HIMENO] + m_ulJobs[JOB_MANDELBROT] + m_ulJobs[JOB_HARMONIC],
+                m_ulJobs[JOB_HIMENO], m_ulJobs[JOB_MANDELBROT], m_ulJobs[JOB_HARMONIC], m_ulBatchedJobs, m_ulBatches, m_ulExclusiveJobs,
+                "(last jobs)", "mean_us", "p50_us", "p90_us", "p99_us", "max_us",
+                "queue", queue.mean, queue.median, queue.p90, queue.p99, queue.max,
+                "service", service.mean, service.median, service.p90, service.p99, service.max);
+            return buffer + m_cache.statistics();
+        }
+
+    private:
+
+        result_cache_t &m_cache;
+        thread_pool_t m_pool;
+        vector<thread_buffers_t> m_buffers;     // one set per thread of the pool
+        const double m_dSmallCost;
+        const unsigned int m_uiMaxBatch;
+
+        mutex m_mutex;
+        condition_variable m_queued;
+        deque<job_t*> m_queue;
+        bool m_bStop = false;
+        thread m_dispatcher;
+
+        mutex m_statsMutex;
+        unsigned long m_ulJobs[3] = {0u, 0u, 0u};
+        unsigned long m_ulBatches = 0u;
+        unsigned long m_ulBatchedJobs = 0u;
+        unsigned long m_ulExclusiveJobs = 0u;
+        vector<double> m_queueUs;
+        vector<double> m_serviceUs;
+        size_t m_sampleIndex = 0u;
+
+        void dispatch()
+        {
+            vector<job_t*> batch;
+            while (true) {
+
+                unique_lock<mutex> lock(m_mutex);
+                m_queued.wait(lock, [this] { return m_bStop || !m_queue.empty(); });
+                if (m_queue.empty()) return;
+
+                // a large job gets the whole pool
+                job_t *job = m_queue.front();
+                m_queue.pop_front();
+                if (job->exclusive) {
+                    lock.unlock();
+                    job->start = clock_type::now();
+                    execute(*job, m_pool, 0u);
+                    finish(*job);
+                    continue;
+                }
+
+                // small jobs from the front of the queue run next to each other, single threaded
+                batch.clear();
+                batch.push_back(job);
+                while (!m_queue.empty() && !m_queue.front()->exclusive && batch.size() < m_uiMaxBatch) {
+                    batch.push_back(m_queue.front());
+                    m_queue.pop_front();
+                }
+                lock.unlock();
+
+                {
+                    lock_guard<mutex> stats_lock(m_statsMutex);
+                    m_ulBatches++;
+                }
+                m_pool.run(batch.size(), [&]( unsigned int i, unsigned int thread_number ) {
+                    thread_pool_t single(1u);
+                    batch[i]->start = clock_type::now();
+                    execute(*batch[i], single, thread_number);
+                    finish(*batch[i]);
+                });
+
+            }
+        }
+
+        void execute( job_t &job, thread_pool_t &pool, unsigned int thread_number )
+        {
+            const uint64_t *a = job.spec.args;
+            thread_buffers_t &buffers = m_buffers[thread_number];
+
+            // a truncated field or one of another grid or type would be read past its end, start from scratch then
+            if (job.resume != nullptr && (job.resume->size != himeno_field_size(vec3_uint_t(a[0], a[1], a[2])) * sizeof(float)
+                || job.resume->key != result_cache_t::field_key(HIMENO_FIELD_TYPE, a[0], a[1], a[2], job.resume_updates))) {
+                fprintf(stderr, "Ignoring the cached field %s of %zu bytes\n", job.resume->key.c_str(), job.resume->size);
+                job.resume = nullptr;
+                job.resume_updates = 0u;
+            }
+            const double resume_seconds = job.resume == nullptr ? 0.0 : job.resume->compute_seconds;
+            double compute_seconds = -1.0;
+            switch (job.spec.kind) {
+
+                case JOB_HIMENO: {
+                    // no iterations need no fields, the buffers of the thread would never shrink again
+                    if (a[3] == 0u) {
+                        job.length = snprintf(&job.output[0], job.output.size(), "%.6f\n", 0.0f);
+                        break;
+                    }
+                    const vec3_uint_t size(a[0], a[1], a[2]);
+                    const size_t bytes = himeno_field_size(size) * sizeof(float);
+                    float *p = (float*)buffers.p.get(bytes);
+                    float *wrk = (float*)buffers.wrk.get(bytes);
+
+                    // same as jacobi(), but the field before the last iteration goes to the cache
+                    if (job.resume != nullptr) memcpy(p, job.resume->data, bytes);
+                    else himeno_init(size, p, pool);
+                    p = jacobi_update(size, a[3] - 1u - job.resume_updates, p, wrk, pool);
+                    const double field_seconds = resume_seconds + chrono::duration<double>(clock_type::now() - job.start).count();
+                    job.length = snprintf(&job.output[0], job.output.size(), "%.6f\n", jacobi_gosa(size, p, pool));
+                    compute_seconds = resume_seconds + chrono::duration<double>(clock_type::now() - job.start).count();
+                    if (a[3] - 1u > job.resume_updates) m_cache.store_field(HIMENO_FIELD_TYPE, a[0], a[1], a[2], a[3] - 1u, (const char*)p, bytes, field_seconds);
+                    break;
+                }
+
+                case JOB_MANDELBROT:
+                    mandelbrot_render(a[0], a[1], a[2], &job.output[0], pool);
+                    job.length = mandelbrot_image_size(a[0], a[1]);
+                    break;
+
+                case JOB_HARMONIC:
+                    job.length = harmonic_sum(a[0], a[1], &job.output[0], pool);
+                    job.output[job.length++] = '\n';
+                    break;
+
+                default:
+                    break;
+
+            }
+
+            if (compute_seconds < 0.0) compute_seconds = chrono::duration<double>(clock_type::now() - job.start).count();
+            m_cache.store(job_key(job.spec), job.output.data(), job.length, compute_seconds);
+        }
+
+        void finish( job_t &job )
+        {
+            job.end = clock_type::now();
+            {
+                lock_guard<mutex> lock(m_statsMutex);
+                const double queue_us = chrono::duration<double, micro>(job.start - job.arrival).count();
+                const double service_us = chrono::duration<double, micro>(job.end - job.start).count();
+                if (m_queueUs.size() < LATENCY_SAMPLES) {
+                    m_queueUs.push_back(queue_us);
+                    m_serviceUs.push_back(service_us);
+                } else {
+                    m_queueUs[m_sampleIndex] = queue_us;
+                    m_serviceUs[m_sampleIndex] = service_us;
+                }
+                m_sampleIndex = (m_sampleIndex + 1u) % LATENCY_SAMPLES;
+                m_ulJobs[job.spec.kind]++;
+                if (job.exclusive) m_ulExclusiveJobs++;
+                else m_ulBatchedJobs++;
+            }
+            job.done.set_value();
+        }
+
+};
+
+// FUNCTIONS
+
+static size_t output_size( const job_spec_t &spec )
+{
+    switch (spec.kind) {
+        case JOB_HIMENO: return 64u;
+        case JOB_MANDELBROT: return mandelbrot_image_size(spec.args[0], spec.args[1]);
+        case JOB_HARMONIC: return harmonic_output_size(spec.args[0]);
+        default: return 0u;
+    }
+}
+
+static void serve_connection( job_server_t *server, connection_t *connection )
+{
+
+    const int fd = connection->fd;
+    socket_reader_t reader(fd);
+    string line, error;
+    char header[96];
+    job_spec_t spec;
+    bool ok = true;
+
+    while (ok && reader.read_line(line)) {
+
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!parse_job(line, spec, error)) {
+            error = "ERR " + error + "\n";
+            ok = write_all(fd, error.data(), error.size());
+            continue;
+        }
+
+        if (spec.kind == JOB_STATS) {
+            const string text = server->statistics();
+            const int length = snprintf(header, sizeof(header), "OK %zu 0 0\n", text.size());
+            ok = write_all(fd, header, length) && write_all(fd, text.data(), text.size());
+            continue;
+        }
+
+        // a cached output gets written right from its mapping
+        const auto ts_lookup = clock_type::now();
+        const cache_entry_ptr_t cached = server->cache().lookup(job_key(spec));
+        if (cached != nullptr) {
+            const int length = snprintf(header, sizeof(header), "OK %zu 0 %lld\n", cached->size,
+                (long long)chrono::duration_cast<chrono::microseconds>(clock_type::now() - ts_lookup).count());
+            ok = write_all(fd, header, length) && write_all(fd, cached->data, cached->size);
+            continue;
+        }
+
+        job_t job;
+        job.spec = spec;
+        job.exclusive = server->is_exclusive(spec);
+        job.output.resize(output_size(spec));
+        if (spec.kind == JOB_HIMENO && spec.args[3] >= 2u) {
+            job.resume = server->cache().lookup_field(HIMENO_FIELD_TYPE, spec.args[0], spec.args[1], spec.args[2], spec.args[3] - 1u, job.resume_updates);
+        }
+        if (!server->run(job)) {
+            error = "ERR the server is stopping\n";
+            ok = write_all(fd, error.data(), error.size());
+            continue;
+        }
+
+        const int length = snprintf(header, sizeof(header), "OK %zu %lld %lld\n", job.length,
+            (long long)chrono::duration_cast<chrono::microseconds>(job.start - job.arrival).count(),
+            (long long)chrono::duration_cast<chrono::microseconds>(job.end - job.start).count());
+        ok = write_all(fd, header, length) && write_all(fd, job.output.data(), job.length);
+
+    }
+
+    connection->finished.store(true, memory_order_release);
+
+}
+
+static void join_connection( connection_t &connection )
+{
+    connection.worker.join();
+    close(connection.fd);
+}
+
+static int listen_fd = -1;
+
+static void handle_stop( int )
+{
+    // lets accept() fail, the main thread cleans up
+    shutdown(listen_fd, SHUT_RDWR);
+}
+
+int main( int argc, char *argv[] ) {
+
+    // get amount of cores
+    const unsigned int num_threads = system_topology().threads(THREADS_ALL_CPUS);
+
+    // read the options
+    string socket_path = DEFAULT_SOCKET_PATH;
+    double small_cost = DEFAULT_SMALL_COST;
+    unsigned long max_batch = 0u, prefault_mib = 0u;
+    string cache_dir = DEFAULT_CACHE_DIR;
+    unsigned long cache_memory_mib = DEFAULT_CACHE_MEMORY_MIB, cache_disk_mib = DEFAULT_CACHE_DISK_MIB;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--socket") == 0) socket_path = argv[i+1];
+        else if (strcmp(argv[i], "--small-cost") == 0) small_cost = strtod(argv[i+1], NULL);
+        else if (strcmp(argv[i], "--max-batch") == 0) max_batch = strtoul(argv[i+1], NULL, 10);
+        else if (strcmp(argv[i], "--prefault") == 0) prefault_mib = strtoul(argv[i+1], NULL, 10);
+        else if (strcmp(argv[i], "--cache-dir") == 0) cache_dir = argv[i+1];
+        else if (strcmp(argv[i], "--cache-memory") == 0) cache_memory_mib = strtoul(argv[i+1], NULL, 10);
+        else if (strcmp(argv[i], "--cache-disk") == 0) cache_disk_mib = strtoul(argv[i+1], NULL, 10);
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        fprintf(stderr, "The socket path %s is too long\n", socket_path.c_str());
+        return 1;
+    }
+    strcpy(address.sun_path, socket_path.c_str());
+    unlink(socket_path.c_str());
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listen_fd, 128) != 0) {
+        fprintf(stderr, "Could not listen on %s: %s\n", socket_path.c_str(), strerror(errno));
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+
+    {
+        result_cache_t cache(cache_dir, cache_memory_mib << 20, cache_disk_mib << 20);
+        job_server_t server(num_threads, small_cost, max_batch, prefault_mib << 20, cache);
+        fprintf(stderr, "Serving on %s with %u threads, jobs below %.3g are batched\n", socket_path.c_str(), num_threads, small_cost);
+
+        list<connection_t> connections;
+        int fd;
+        while (true) {
+            fd = accept(listen_fd, NULL, NULL);
+            if (fd < 0 && errno == EINTR) continue;
+            if (fd < 0) break;
+
+            // clean up after the clients that left
+            for (auto it = connections.begin(); it != connections.end();) {
+                if (!it->finished.load(memory_order_acquire)) {
+                    ++it;
+                    continue;
+                }
+                join_connection(*it);
+                it = connections.erase(it);
+            }
+            connections.emplace_back();
+            connections.back().fd = fd;
+            connections.back().worker = thread(serve_connection, &server, &connections.back());
+        }
+
+        // the connections end after their current job, the server and the cache outlive them
+        server.stop();
+        for (auto &connection : connections) shutdown(connection.fd, SHUT_RDWR);
+        for (auto &connection : connections) join_connection(connection);
+
+        fprintf(stderr, "%s", server.statistics().c_str());
+    }
+
+    close(listen_fd);
+    unlink(socket_path.c_str());
+    return 0;
+
+}
@@ -0,0 +1,147 @@
+/*
+ * Per call overhead of the tasks for small inputs
+ *
+ * Usage: MAX_CPUS=<threads> ./overhead [calls]
+ *
+ * Every task is called in three ways:
+ *  - warm:    library call on a thread pool and buffers that are reused for every call
+ *  - cold:    library call that creates its thread pool and buffers for every call
+ *  - process: the command line binary gets spawned with the input on stdin (if it is built)
+ * The difference between the modes is the cost of thread creation and of process startup.
+ */
+
+#include "tasks.h"
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+// TYPEDEFS
+
+struct overhead_task_t {
+    string name;
+    string input;
+    string binary;
+    function<void( thread_pool_t& )> prepare;   // allocates the buffers
+    function<void( thread_pool_t& )> call;      // one call on the prepared buffers
+    function<void()> release;                   // frees the buffers
+};
+
+// FUNCTIONS
+
+static bool run_process( const overhead_task_t &task, unsigned int threads )
+{
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0) return false;
+    const pid_t pid = fork();
+    if (pid == 0) {
+        const int null_fd = open("/dev/null", O_WRONLY);
+        dup2(pipe_fds[0], STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        setenv("MAX_CPUS", to_string(threads).c_str(), 1);
+        execl(task.binary.c_str(), task.binary.c_str(), (char*)nullptr);
+        _exit(127);
+    }
+    close(pipe_fds[0]);
+    const string line = task.input + "\n";
+    (void)! write(pipe_fds[1], line.data(), line.size());
+    close(pipe_fds[1]);
+    int status;
+    return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static void print_row( const overhead_task_t &task, unsigned int threads, const char *mode, unsigned int calls, double seconds )
+{
+    printf("%-10s %-14s %4u %-8s %6u %12.1f\n", task.name.c_str(), task.input.c_str(), threads, mode, calls, seconds*1.0e6/calls);
+    fflush(stdout);
+}
+
+int main( int argc, char *argv[] ) {
+
+    const unsigned int threads = system_topology().threads(THREADS_ALL_CPUS);
+    const vector<int> cpus = system_topology().thread_cpus(threads);
+    const unsigned int calls = argc > 1 ? strtoul(argv[1], NULL, 10) : 200u;
+
+    // small inputs, where the overhead matters the most
+    const vec3_uint_t himeno_size(16u, 16u, 32u);
+    float *himeno_p = nullptr, *himeno_wrk = nullptr;
+    char *mandelbrot_img = nullptr, *harmonic_output = nullptr;
+    vector<overhead_task_t> tasks = {
+        { "himeno", "16 16 32 3", "../mopp-2018-t3-himeno/himeno",
+            [&]( thread_pool_t& ) {
+                himeno_p = new float[himeno_field_size(himeno_size)];
+                himeno_wrk = new float[himeno_field_size(himeno_size)];
+            },
+            [&]( thread_pool_t &pool ) {
+                himeno_init(himeno_size, himeno_p, pool);
+                jacobi(himeno_size, 3u, himeno_p, himeno_wrk, pool);
+            },
+            [&]() { delete[] himeno_p; delete[] himeno_wrk; } },
+        { "mandelbrot", "23 79 240", "../mopp-2017-t3-mandelbrot-set/mandelbrot",
+            [&]( thread_pool_t& ) { mandelbrot_img = new char[mandelbrot_image_size(23u, 79u)]; },
+            [&]( thread_pool_t &pool ) { mandelbrot_render(23u, 79u, 240u, mandelbrot_img, pool); },
+            [&]() { delete[] mandelbrot_img; } },
+        { "harmonic", "100 1000", "../mopp-2018-t0-harmonic-progression-sum/harmonic-progression-sum",
+            [&]( thread_pool_t& ) { harmonic_output = new char[harmonic_output_size(100u)]; },
+            [&]( thread_pool_t &pool ) { harmonic_sum(100u, 1000u, harmonic_output, pool); },
+            [&]() { delete[] harmonic_output; } },
+    };
+
+    printf("%-10s %-14s %4s %-8s %6s %12s\n", "task", "input", "thr", "mode", "calls", "us_per_call");
+    for (const auto &task : tasks) {
+
+        // warm: one pool and one set of buffers for all calls
+        {
+            thread_pool_t pool(threads, cpus);
+            task.prepare(pool);
+            task.call(pool);
+            const auto ts_begin = chrono::steady_clock::now();
+            for (unsigned int i = 0u; i < calls; i++) task.call(pool);
+            print_row(task, threads, "warm", calls, chrono::duration<double>(chrono::steady_clock::now() - ts_begin).count());
+            task.release();
+        }
+
+        // cold: everything gets created per call
+        {
+            const auto ts_begin = chrono::steady_clock::now();
+            for (unsigned int i = 0u; i < calls; i++) {
+                thread_pool_t pool(threads);
+                task.prepare(pool);
+                task.call(pool);
+                task.release();
+            }
+            print_row(task, threads, "cold", calls, chrono::duration<double>(chrono::steady_clock::now() - ts_begin).count());
+        }
+
+        // process: a fresh binary per call, fewer calls since they are slow
+        if (access(task.binary.c_str(), X_OK) != 0) {
+            printf("%-10s %-14s %4u %-8s skipped, %s is not built\n", task.name.c_str(), task.input.c_str(), threads, "process", task.binary.c_str());
+            continue;
+        }
+        const unsigned int process_calls = calls / 10u > 0u ? calls / 10u : 1u;
+        const auto ts_begin = chrono::steady_clock::now();
+        for (unsigned int i = 0u; i < process_calls; i++) {
+            if (!run_process(task, threads)) {
+                fprintf(stderr, "%s failed\n", task.binary.c_str());
+                return 1;
+            }
+        }
+        print_row(task, threads, "process", process_calls, chrono::duration<double>(chrono::steady_clock::now() - ts_begin).count());
+
+    }
+
+    return 0;
+
+}
@@ -0,0 +1,14 @@
+#ifndef __HEADER_TASKS__
+#define __HEADER_TASKS__
+
+/*
+ * The kernels of all tasks as one library (libtasks.a). The caller owns the buffers and one
+ * thread pool that all calls share, see the headers of the single tasks for the details.
+ */
+
+#include "../common/thread_pool.h"
+#include "../mopp-2018-t3-himeno/himeno.h"
+#include "../mopp-2017-t3-mandelbrot-set/mandelbrot_kernel.h"
+#include "../mopp-2018-t0-harmonic-progression-sum/harmonic_kernel.h"
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef __HEADER_BANDS__
+#define __HEADER_BANDS__
+
+#include <algorithm>
+#include <atomic>
+#include <coroutine>
+#include <exception>
+
+#include <stdint.h>
+
+#include "output.h"
+#include "../common/trace.h"
+
+/*
+ * Pipelined ascii output of mandelbrot.cpp (make pipelined, needs C++20): instead of the whole image
+ * only a window of bands of rows is in memory. The collector counts the pixels of every band and
+ * sets the bit of its slot in the completion bitmap as soon as the band is full. The writer is a
+ * coroutine that awaits the bits of the bands in order, writes a band while the workers calculate
+ * the next ones and then frees the slot. The feeder grants no pixels beyond the window, so the
+ * memory stays the same for every image size.
+ */
+
+// TYPEDEFS
+#define BAND_BYTES (1u << 16)   // size a band should have, at least one row
+#define BAND_WINDOW 64u         // bands in memory at once, at most 64 (the bits of the bitmap)
+
+struct band_ring_t {
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t band_rows;         // rows per band, the last band may have less
+    uint32_t num_bands;
+    char *slots;                // BAND_WINDOW bands of band_rows lines
+    uint32_t *pixels_done;      // pixels of the band in every slot, only used by the collector
+    alignas(64) std::atomic<uint64_t> complete{0u};   // bit per slot, set while its band is full and not written
+    alignas(64) std::atomic<uint32_t> flushed{0u};    // bands written so far
+};
+
+/**
+ * @brief Return type of the writer coroutine, the driver resumes it whenever the bit it awaits is set
+ */
+struct band_writer_t {
+    struct promise_type {
+        uint64_t awaited = 0u;  // the bit of the bitmap the coroutine waits for
+        bool success = false;
+        band_writer_t get_return_object() { return { std::coroutine_handle<promise_type>::from_promise(*this) }; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_value( bool result ) { success = result; }
+        void unhandled_exception() { std::terminate(); }
+    };
+    std::coroutine_handle<promise_type> handle;
+};
+
+/**
+ * @brief Awaits the band in a slot to be complete
+ */
+struct band_complete_t {
+    band_ring_t &ring;
+    uint32_t slot;
+    bool await_ready() const { return ring.complete.load(std::memory_order_acquire) & (1ull << slot); }
+    void await_suspend( std::coroutine_handle<band_writer_t::promise_type> handle ) const { handle.promise().awaited = 1ull << slot; }
+    void await_resume() const {}
+};
+
+// FUNCTIONS
+
+void band_ring_init( band_ring_t &ring, uint32_t rows, uint32_t cols )
+{
+    ring.rows = rows;
+    ring.cols = cols;
+    ring.band_rows = std::min(std::max(1u, BAND_BYTES / (cols + 1u)), std::max(rows, 1u));
+    ring.num_bands = (rows + ring.band_rows - 1u) / ring.band_rows;
+    ring.slots = new char[(size_t)BAND_WINDOW*ring.band_rows*(cols+1u)];
+    for (size_t line = 0u; line < (size_t)BAND_WINDOW*ring.band_rows; line++) ring.slots[line*(cols+1u) + cols] = '\n';
+    ring.pixels_done = new uint32_t[BAND_WINDOW]();
+}
+
+void band_ring_free( band_ring_t &ring )
+{
+    delete[] ring.slots;
+    delete[] ring.pixels_done;
+}
+
+/**
+ * @brief The end of the pixels the feeder may grant, the last pixel of the window
+ */
+inline uint64_t band_ring_limit( const band_ring_t &ring )
+{
+    const uint64_t end = (uint64_t)(ring.flushed.load(std::memory_order_acquire) + BAND_WINDOW) * ring.band_rows * ring.cols;
+    return std::min(end, (uint64_t)ring.rows * ring.cols);
+}
+
+/**
+ * @brief Stores a pixel, only called by the collector
+ */
+inline void band_ring_set( band_ring_t &ring, uint64_t p, char value )
+{
+    const uint32_t r = (uint32_t)(p / ring.cols), band = r / ring.band_rows, slot = band % BAND_WINDOW;
+    ring.slots[((size_t)slot*ring.band_rows + r % ring.band_rows)*(ring.cols+1u) + p % ring.cols] = value;
+    const uint32_t band_rows = std::min(ring.band_rows, ring.rows - band*ring.band_rows);
+    if (++ring.pixels_done[slot] == band_rows * ring.cols) {
+        ring.pixels_done[slot] = 0u;
+        ring.complete.fetch_or(1ull << slot, std::memory_order_release);
+        ring.complete.notify_one();
+    }
+}
+
+static band_writer_t write_bands( band_ring_t &ring, int fd )
+{
+    for (uint32_t band = 0u; band < ring.num_bands; band++) {
+
+        const uint32_t slot = band % BAND_WINDOW;
+        co_await band_complete_t{ ring, slot };
+
+        TRACE_SPAN_BEGIN(ts_band);
+        const uint32_t band_rows = std::min(ring.band_rows, ring.rows - band*ring.band_rows);
+        if (!write_all(fd, ring.slots + (size_t)slot*ring.band_rows*(ring.cols+1u), (size_t)band_rows*(ring.cols+1u))) {
+            // let the feeder grant the rest, the pixels get dropped
+            ring.flushed.store(ring.num_bands, std::memory_order_release);
+            co_return false;
+        }
+        ring.complete.fetch_and(~(1ull << slot), std::memory_order_relaxed);
+        ring.flushed.store(band + 1u, std::memory_order_release);
+        TRACE_SPAN_END(ts_band, "write band", band);
+
+    }
+    co_return true;
+}
+
+/**
+ * @brief Writes the bands in order as they get complete, returns after the last one
+ * @return false if writing failed
+ */
+bool band_ring_write( band_ring_t &ring, int fd )
+{
+
+    band_writer_t writer = write_bands(ring, fd);
+    while (!writer.handle.done()) {
+        const uint64_t awaited = writer.handle.promise().awaited;
+        uint64_t complete = ring.complete.load(std::memory_order_acquire);
+        while (!(complete & awaited)) {
+            ring.complete.wait(complete, std::memory_order_acquire);
+            complete = ring.complete.load(std::memory_order_acquire);
+        }
+        writer.handle.resume();
+    }
+
+    const bool success = writer.handle.promise().success;
+    writer.handle.destroy();
+    return success;
+
+}
+
+#endif
@@ -1,16 +1,21 @@
 #ifndef __HEADER_COMMON__
 #define __HEADER_COMMON__
 
+#include <stdint.h>
 #include <time.h>
 
 typedef unsigned int uint;
 
-clock_t get_timestamp() {
-    return clock();
+// monotonic wall clock time in nanoseconds. clock() would return the cpu time of the
+// whole process, which sums up the time of all threads
+static inline int64_t get_timestamp( void ) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000ll + ts.tv_nsec;
 }
 
-clock_t get_timediff( clock_t ts ) {
-    return clock() - ts;
+static inline int64_t get_timediff( int64_t ts ) {
+    return get_timestamp() - ts;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,194 @@
+#ifndef __HEADER_COUNTS__
+#define __HEADER_COUNTS__
+
+#include "output.h"
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// TYPEDEFS
+#define COUNT_ROW_BATCH 64u // rows that get colored/written by a thread at once
+
+/**
+ * Escape counts of every pixel for the pgm/ppm output. The counts get written by the
+ * workers directly (every pixel is calculated by exactly one worker), each worker also
+ * keeps its own histogram of the counts which are merged after all pixels are done.
+ */
+struct count_image_t {
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t num_iterations;
+    output_format_t format;
+    uint8_t count_bytes;        // 2 if num_iterations fits into an uint16_t, else 4
+    void *counts;               // escape count of every pixel, num_iterations means inside
+    float *smooth;              // continuous escape count, nullptr if OUTPUT_SMOOTH is not set
+    float *equalised;           // histogram equalised value in [0, 1] for every count
+
+    // parallel writing
+    int fd;
+    bool seekable;
+    off_t data_offset;          // file offset of the first row
+    uint32_t row_bytes;         // 1 byte per pixel for pgm, 3 for ppm
+    std::atomic<bool> ready;    // set as soon as the histogram is equalised and the header written
+    std::atomic<uint32_t> next_batch;
+    std::atomic<bool> success;
+};
+
+// FUNCTIONS
+
+void count_image_init( count_image_t &img, uint32_t rows, uint32_t cols, uint32_t num_iterations, output_format_t format )
+{
+    const char *smooth = getenv("OUTPUT_SMOOTH");
+    img.rows = rows;
+    img.cols = cols;
+    img.num_iterations = num_iterations;
+    img.format = format;
+    img.count_bytes = num_iterations <= UINT16_MAX ? sizeof(uint16_t) : sizeof(uint32_t);
+    img.counts = malloc((size_t)rows*cols*img.count_bytes);
+    img.smooth = smooth != NULL && strcmp(smooth, "1") == 0 ? new float[(size_t)rows*cols] : nullptr;
+    img.equalised = new float[(size_t)num_iterations+1u];
+    img.row_bytes = format == OUTPUT_PPM ? 3u*cols : cols;
+    img.ready = false;
+    img.next_batch = 0u;
+    img.success = true;
+}
+
+void count_image_free( count_image_t &img )
+{
+    free(img.counts);
+    delete[] img.smooth;
+    delete[] img.equalised;
+}
+
+/**
+ * @brief Allocates the histogram of one worker, padded to full cachelines
+ */
+uint32_t *count_histogram_alloc( uint32_t num_iterations )
+{
+    const size_t size = (((size_t)num_iterations+1u)*sizeof(uint32_t) + 63u) & ~(size_t)63u;
+    auto histogram = (uint32_t*)aligned_alloc(64u, size);
+    memset(histogram, 0, size);
+    return histogram;
+}
+
+/**
+ * @brief Stores the result of a pixel
+ * @param p The pixel number
+ * @param n The escape count
+ * @param z_sqr The squared absolute value of z after n iterations
+ */
+inline void count_image_set( count_image_t &img, size_t p, uint32_t n, float z_sqr )
+{
+    if (img.count_bytes == sizeof(uint16_t)) ((uint16_t*)img.counts)[p] = n;
+    else ((uint32_t*)img.counts)[p] = n;
+    if (img.smooth != nullptr) {
+        img.smooth[p] = n == img.num_iterations ? n : std::min(std::max(n + 1.0f - log2f(0.5f*logf(z_sqr)), 0.0f), (float)img.num_iterations - 1.0f);
+    }
+}
+
+inline uint32_t count_image_get( const count_image_t &img, size_t p )
+{
+    return img.count_bytes == sizeof(uint16_t) ? ((uint16_t*)img.counts)[p] : ((uint32_t*)img.counts)[p];
+}
+
+/**
+ * @brief Merges the histograms of all workers and calculates the equalised value of every count
+ */
+void count_image_equalise( count_image_t &img, uint32_t *const *histograms, uint32_t num_histograms )
+{
+
+    // escaped pixels only, the inside of the set stays black
+    uint64_t cdf = 0u, escaped = 0u;
+    for (uint32_t n = 0u; n < img.num_iterations; n++) for (uint32_t i = 0u; i < num_histograms; i++) escaped += histograms[i][n];
+
+    for (uint32_t n = 0u; n < img.num_iterations; n++) {
+        for (uint32_t i = 0u; i < num_histograms; i++) cdf += histograms[i][n];
+        img.equalised[n] = escaped == 0u ? 0.0f : (float)((double)cdf / escaped);
+    }
+    img.equalised[img.num_iterations] = 0.0f;
+
+}
+
+/**
+ * @brief Colors one row into out (row_bytes bytes)
+ */
+void count_image_color_row( const count_image_t &img, uint32_t r, uint8_t *out )
+{
+
+    size_t p = (size_t)r*img.cols;
+    uint32_t n;
+    float t, mu;
+
+    for (uint32_t c = 0u; c < img.cols; c++, p++) {
+
+        // equalised value, interpolated between two counts for the smooth output
+        n = count_image_get(img, p);
+        if (n == img.num_iterations) {
+            t = -1.0f;
+        } else if (img.smooth != nullptr) {
+            mu = img.smooth[p];
+            n = (uint32_t)mu;
+            t = img.equalised[n] + (mu - n) * (img.equalised[std::min(n+1u, img.num_iterations-1u)] - img.equalised[n]);
+        } else {
+            t = img.equalised[n];
+        }
+
+        if (img.format == OUTPUT_PGM) {
+            out[c] = t < 0.0f ? 0u : (uint8_t)(1.0f + t*254.0f); // 0 is reserved for the inside
+        } else if (t < 0.0f) {
+            out[3u*c] = out[3u*c+1u] = out[3u*c+2u] = 0u;
+        } else {
+            // cosine palette from dark blue over white to orange
+            out[3u*c]    = (uint8_t)(255.0f*(0.5f + 0.5f*cosf(6.2831853f*(t + 0.50f))));
+            out[3u*c+1u] = (uint8_t)(255.0f*(0.5f + 0.5f*cosf(6.2831853f*(t + 0.60f))));
+            out[3u*c+2u] = (uint8_t)(255.0f*(0.5f + 0.5f*cosf(6.2831853f*(t + 0.75f))));
+        }
+
+    }
+
+}
+
+/**
+ * @brief Writes the PGM/PPM header and decides if the rows can be written in parallel
+ * @return false if writing failed
+ */
+bool count_image_begin_write( count_image_t &img, int fd )
+{
+    const std::string header = std::string(img.format == OUTPUT_PGM ? "P5\n" : "P6\n")
+        + std::to_string(img.cols) + " " + std::to_string(img.rows) + "\n255\n";
+    const off_t base = lseek(fd, 0, SEEK_CUR);
+    img.fd = fd;
+    img.seekable = base >= 0 && !(fcntl(fd, F_GETFL) & O_APPEND);
+    img.data_offset = base + header.size();
+    if (!img.seekable) return write_all(fd, header.data(), header.size());
+    if (!pwrite_all(fd, header.data(), header.size(), base)) return false;
+    lseek(fd, img.data_offset + (off_t)img.rows*img.row_bytes, SEEK_SET);
+    return true;
+}
+
+/**
+ * @brief Colors and writes batches of rows until all rows are taken. Called by every worker
+ * in parallel if the output is seekable, else once by the main thread
+ */
+void count_image_write_rows( count_image_t &img )
+{
+    auto buffer = new uint8_t[(size_t)COUNT_ROW_BATCH*img.row_bytes];
+    uint32_t r_begin, r_end, r;
+    while (img.success && (r_begin = (img.next_batch++) * COUNT_ROW_BATCH) < img.rows) {
+        r_end = std::min(r_begin + COUNT_ROW_BATCH, img.rows);
+        for (r = r_begin; r < r_end; r++) count_image_color_row(img, r, buffer + (size_t)(r-r_begin)*img.row_bytes);
+        if (img.seekable
+            ? !pwrite_all(img.fd, buffer, (size_t)(r_end-r_begin)*img.row_bytes, img.data_offset + (off_t)r_begin*img.row_bytes)
+            : !write_all(img.fd, buffer, (size_t)(r_end-r_begin)*img.row_bytes)
+        ) img.success = false;
+    }
+    delete[] buffer;
+}
+
+#endif
@@ -0,0 +1,243 @@
+/*
+ * Microbenchmark of the work dispatch strategies for mandelbrot.c
+ *
+ * Usage: MAX_CPUS=<threads> ./dispatch_bench [rows cols iterations]
+ * Without arguments a grid of image sizes and iteration counts is measured.
+ *
+ * Strategies:
+ *  - mutex:  chunks of 10 pixels from a counter behind a pthread mutex (the former mandelbrot.c)
+ *  - atomic: chunks of 10 pixels with fetch_add on a cacheline isolated counter
+ *  - guided: decreasing chunk sizes from dispenser.h (the current mandelbrot.c)
+ *  - static: equal ranges per thread without any synchronization
+ * Each strategy runs with the kernel of mandelbrot.c (always all iterations) and with the
+ * kernel of the original (stops as soon as |z| >= 2, so the cost per pixel varies).
+ */
+
+#define _GNU_SOURCE
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dispenser.h"
+
+// TYPEDEFS
+#define FIXED_CHUNK_SIZE 10u
+#define REPETITIONS 3u
+
+typedef unsigned int uint;
+typedef unsigned char byte;
+
+typedef enum { STRATEGY_MUTEX, STRATEGY_ATOMIC, STRATEGY_GUIDED, STRATEGY_STATIC, NUM_STRATEGIES } strategy_t;
+static const char *STRATEGY_NAMES[NUM_STRATEGIES] = { "mutex", "atomic", "guided", "static" };
+
+typedef struct {
+    uint rows;
+    uint cols;
+    uint num_iterations;
+    uint num_threads;
+    int early_exit;
+    strategy_t strategy;
+    char *img;
+
+    // the dispatchers, each on its own cacheline
+    _Alignas(64) pthread_mutex_t mutex;
+    uint mutex_value;
+    _Alignas(64) atomic_uint atomic_value;
+    _Alignas(64) chunk_dispenser_t dispenser;
+} bench_t;
+
+typedef struct {
+    byte padding_front[64];
+    bench_t *bench;
+    uint thread_number;
+    byte padding_back[64];
+} bench_params_t;
+
+// FUNCTIONS
+
+static int64_t get_timestamp_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000ll + ts.tv_nsec;
+}
+
+static void calculate_range( bench_t *b, uint p_begin, uint p_end )
+{
+    uint p, n, row, col;
+    float z_r, z_i, z_r_tmp, c_r, c_i;
+
+    row = p_begin / (b->cols+1u);
+    col = p_begin % (b->cols+1u);
+    for (p = p_begin; p < p_end; p++) {
+        if (col == b->cols) {
+            b->img[p] = '\n';
+            col = 0u;
+            row++;
+            continue;
+        }
+        z_r = 0.0f;
+        z_i = 0.0f;
+        c_r = col * 2.0f / b->cols - 1.5f;
+        c_i = row * 2.0f / b->rows - 1.0f;
+        for (n = 0u; n < b->num_iterations; n++) {
+            if (b->early_exit && z_r*z_r + z_i*z_i >= 4.0f) break;
+            z_r_tmp = 2.0f*z_r;
+            z_r = z_r*z_r - z_i*z_i + c_r;
+            z_i = z_i * z_r_tmp + c_i;
+        }
+        b->img[p] = sqrtf(z_r*z_r + z_i*z_i) < 2.0f ? '#' : '.';
+        col++;
+    }
+}
+
+static void *work( void *params_uncasted )
+{
+
+    bench_params_t *params = (bench_params_t*) params_uncasted;
+    bench_t *b = params->bench;
+    const uint size = b->rows*(b->cols+1u);
+    uint p_begin, p_end;
+
+    switch (b->strategy) {
+
+        case STRATEGY_MUTEX:
+            while (1) {
+                pthread_mutex_lock(&b->mutex);
+                p_begin = b->mutex_value;
+                b->mutex_value += FIXED_CHUNK_SIZE;
+                pthread_mutex_unlock(&b->mutex);
+                if (p_begin >= size) break;
+                calculate_range(b, p_begin, p_begin + FIXED_CHUNK_SIZE > size ? size : p_begin + FIXED_CHUNK_SIZE);
+            }
+            break;
+
+        case STRATEGY_ATOMIC:
+            while ((p_begin = atomic_fetch_add_explicit(&b->atomic_value, FIXED_CHUNK_SIZE, memory_order_relaxed)) < size) {
+                calculate_range(b, p_begin, p_begin + FIXED_CHUNK_SIZE > size ? size : p_begin + FIXED_CHUNK_SIZE);
+            }
+            break;
+
+        case STRATEGY_GUIDED:
+            while (dispenser_next(&b->dispenser, &p_begin, &p_end)) calculate_range(b, p_begin, p_end);
+            break;
+
+        case STRATEGY_STATIC:
+            calculate_range(b, (uint)((uint64_t)params->thread_number*size/b->num_threads), (uint)((uint64_t)(params->thread_number+1u)*size/b->num_threads));
+            break;
+
+        default:
+            break;
+
+    }
+
+    return NULL;
+
+}
+
+static double run( bench_t *b )
+{
+
+    const uint size = b->rows*(b->cols+1u);
+    pthread_t *threads = malloc(b->num_threads * sizeof(pthread_t));
+    bench_params_t *params_arr = malloc(b->num_threads * sizeof(bench_params_t));
+    uint i;
+
+    // reset the dispatchers
+    b->mutex_value = 0u;
+    atomic_store(&b->atomic_value, 0u);
+    dispenser_init(&b->dispenser, size, b->num_threads, FIXED_CHUNK_SIZE);
+
+    const int64_t ts_begin = get_timestamp_ns();
+    for (i = 0u; i < b->num_threads; i++) {
+        params_arr[i].bench = b;
+        params_arr[i].thread_number = i;
+        pthread_create(&threads[i], NULL, work, &params_arr[i]);
+    }
+    for (i = 0u; i < b->num_threads; i++) pthread_join(threads[i], NULL);
+    const int64_t duration = get_timestamp_ns() - ts_begin;
+
+    dispenser_free(&b->dispenser);
+    free(params_arr);
+    free(threads);
+    return duration / 1.0e6;
+
+}
+
+static void bench_configuration( bench_t *b )
+{
+
+    const uint size = b->rows*(b->cols+1u);
+    char *reference = malloc(size);
+    double best, ms;
+    uint s, r;
+
+    for (b->early_exit = 0; b->early_exit <= 1; b->early_exit++) {
+        for (s = 0u; s < NUM_STRATEGIES; s++) {
+
+            // best of some repetitions
+            b->strategy = (strategy_t) s;
+            best = 0.0;
+            for (r = 0u; r < REPETITIONS; r++) {
+                ms = run(b);
+                if (r == 0u || ms < best) best = ms;
+            }
+
+            // all strategies must produce the same image
+            if (s == 0u) memcpy(reference, b->img, size);
+            else if (memcmp(reference, b->img, size) != 0) fprintf(stderr, "Strategy %s produced a different image!\n", STRATEGY_NAMES[s]);
+
+            printf("%6u %6u %6u %7s %7s %4u %10.3f\n", b->rows, b->cols, b->num_iterations, b->early_exit ? "escape" : "fixed", STRATEGY_NAMES[s], b->num_threads, best);
+            fflush(stdout);
+
+        }
+    }
+
+    free(reference);
+
+}
+
+int main( int argc, char *argv[] ) {
+
+    static const uint SIZES[][2] = { {100u, 100u}, {500u, 500u}, {1000u, 2000u} };
+    static const uint ITERATIONS[] = { 100u, 1000u };
+
+    // get amount of cores
+    const char *NUM_CORES_STRING = getenv("MAX_CPUS");
+    static bench_t b;
+    b.num_threads = NUM_CORES_STRING == NULL ? 1u : strtoul(NUM_CORES_STRING, NULL, 10);
+    if (b.num_threads == 0u) b.num_threads = 1u;
+    pthread_mutex_init(&b.mutex, NULL);
+
+    printf("%6s %6s %6s %7s %7s %4s %10s\n", "rows", "cols", "iter", "kernel", "disp", "thr", "best_ms");
+    if (argc == 4) {
+        b.rows = strtoul(argv[1], NULL, 10);
+        b.cols = strtoul(argv[2], NULL, 10);
+        b.num_iterations = strtoul(argv[3], NULL, 10);
+        b.img = malloc(b.rows*(b.cols+1u));
+        bench_configuration(&b);
+        free(b.img);
+        return 0;
+    }
+
+    uint i, j;
+    for (i = 0u; i < sizeof(SIZES)/sizeof(SIZES[0]); i++) {
+        for (j = 0u; j < sizeof(ITERATIONS)/sizeof(ITERATIONS[0]); j++) {
+            b.rows = SIZES[i][0];
+            b.cols = SIZES[i][1];
+            b.num_iterations = ITERATIONS[j];
+            b.img = malloc(b.rows*(b.cols+1u));
+            bench_configuration(&b);
+            free(b.img);
+        }
+    }
+
+    return 0;
+
+}
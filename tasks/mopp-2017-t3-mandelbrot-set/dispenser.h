@@ -0,0 +1,74 @@
+#ifndef __HEADER_DISPENSER__
+#define __HEADER_DISPENSER__
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "../common/trace.h"
+
+// TYPEDEFS
+#define DISPENSER_CACHELINE_SIZE 64u
+
+/*
+ * Lock-free dispenser of chunks of a range [0, size). The chunk boundaries follow a guided
+ * schedule (each chunk is 1/(2*threads) of the remaining work, but at least min_chunk) and are
+ * calculated once up front. Taking a chunk is then a single fetch_add on a counter that has
+ * its own cacheline, so the threads never wait for each other.
+ */
+typedef struct {
+    _Alignas(DISPENSER_CACHELINE_SIZE) atomic_uint next_chunk;
+    unsigned char padding[DISPENSER_CACHELINE_SIZE-sizeof(atomic_uint)];
+    unsigned int num_chunks;
+    unsigned int *chunk_begin;  // num_chunks+1 entries, read-only after dispenser_init()
+} chunk_dispenser_t;
+
+// FUNCTIONS
+
+static void dispenser_init( chunk_dispenser_t *d, unsigned int size, unsigned int num_threads, unsigned int min_chunk )
+{
+
+    unsigned int begin, chunk, i;
+    if (min_chunk == 0u) min_chunk = 1u;
+    if (num_threads == 0u) num_threads = 1u;
+
+    // count the chunks first
+    d->num_chunks = 0u;
+    for (begin = 0u; begin < size; begin += chunk, d->num_chunks++) {
+        chunk = (size - begin) / (2u*num_threads);
+        if (chunk < min_chunk) chunk = min_chunk;
+        if (chunk > size - begin) chunk = size - begin;
+    }
+
+    d->chunk_begin = malloc((d->num_chunks + 1u) * sizeof(unsigned int));
+    for (begin = 0u, i = 0u; begin < size; begin += chunk, i++) {
+        d->chunk_begin[i] = begin;
+        chunk = (size - begin) / (2u*num_threads);
+        if (chunk < min_chunk) chunk = min_chunk;
+        if (chunk > size - begin) chunk = size - begin;
+    }
+    d->chunk_begin[d->num_chunks] = size;
+    atomic_init(&d->next_chunk, 0u);
+
+}
+
+/**
+ * @brief Takes the next chunk
+ * @return 0 if there is no work left, else the chunk is [*begin, *end)
+ */
+static inline int dispenser_next( chunk_dispenser_t *d, unsigned int *begin, unsigned int *end )
+{
+    const unsigned int chunk = atomic_fetch_add_explicit(&d->next_chunk, 1u, memory_order_relaxed);
+    if (chunk >= d->num_chunks) return 0;
+    TRACE_INSTANT("grab", chunk);
+    *begin = d->chunk_begin[chunk];
+    *end = d->chunk_begin[chunk+1u];
+    return 1;
+}
+
+static void dispenser_free( chunk_dispenser_t *d )
+{
+    free(d->chunk_begin);
+    d->chunk_begin = NULL;
+}
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef __HEADER_DOUBLE_DOUBLE__
+#define __HEADER_DOUBLE_DOUBLE__
+
+#include <ctype.h>
+
+/*
+ * Double-double numbers: the unevaluated sum hi + lo of two doubles with |lo| <= ulp(hi)/2,
+ * which gives 106 bits of mantissa. T is double or a GCC vector of doubles, all operations
+ * work lane by lane without branches. The error free transformations need every operation
+ * to be rounded on its own, so the file must not be built with -ffast-math or with FMA
+ * contraction: g++ contracts a*b + c into an FMA with -march=native even with -std=c++17, which
+ * breaks the Veltkamp split of dd_two_prod(). Every build of a file that includes this one passes
+ * -ffp-contract=off (the adaptive target, libtasks).
+ */
+
+#ifdef __FAST_MATH__
+    #error "double_double.h needs every operation rounded on its own, do not build it with -ffast-math"
+#endif
+
+// TYPEDEFS
+
+template<typename T>
+struct dd_t {
+    T hi;
+    T lo;
+};
+
+// FUNCTIONS
+
+// s + e == a + b exactly
+template<typename T>
+static inline dd_t<T> dd_two_sum( T a, T b )
+{
+    const T s = a + b, bb = s - a;
+    return { s, (a - (s - bb)) + (b - bb) };
+}
+
+// s + e == a + b exactly if |a| >= |b|
+template<typename T>
+static inline dd_t<T> dd_quick_two_sum( T a, T b )
+{
+    const T s = a + b;
+    return { s, b - (s - a) };
+}
+
+// p + e == a * b exactly (Dekker, splits both factors into 26 bit halves)
+template<typename T>
+static inline dd_t<T> dd_two_prod( T a, T b )
+{
+    const T p = a * b;
+    const T ta = a * 134217729.0, tb = b * 134217729.0;
+    const T a_hi = ta - (ta - a), a_lo = a - a_hi;
+    const T b_hi = tb - (tb - b), b_lo = b - b_hi;
+    return { p, ((a_hi*b_hi - p) + a_hi*b_lo + a_lo*b_hi) + a_lo*b_lo };
+}
+
+template<typename T>
+static inline dd_t<T> dd_add( const dd_t<T> &a, const dd_t<T> &b )
+{
+    dd_t<T> s = dd_two_sum(a.hi, b.hi);
+    const dd_t<T> t = dd_two_sum(a.lo, b.lo);
+    s.lo += t.hi;
+    s = dd_quick_two_sum(s.hi, s.lo);
+    s.lo += t.lo;
+    return dd_quick_two_sum(s.hi, s.lo);
+}
+
+template<typename T>
+static inline dd_t<T> dd_add( const dd_t<T> &a, T b )
+{
+    dd_t<T> s = dd_two_sum(a.hi, b);
+    s.lo += a.lo;
+    return dd_quick_two_sum(s.hi, s.lo);
+}
+
+template<typename T>
+static inline dd_t<T> dd_sub( const dd_t<T> &a, const dd_t<T> &b )
+{
+    return dd_add(a, dd_t<T>{ -b.hi, -b.lo });
+}
+
+template<typename T>
+static inline dd_t<T> dd_mul( const dd_t<T> &a, const dd_t<T> &b )
+{
+    dd_t<T> p = dd_two_prod(a.hi, b.hi);
+    p.lo += a.hi*b.lo + a.lo*b.hi;
+    return dd_quick_two_sum(p.hi, p.lo);
+}
+
+template<typename T>
+static inline dd_t<T> dd_sqr( const dd_t<T> &a )
+{
+    dd_t<T> p = dd_two_prod(a.hi, a.hi);
+    p.lo += 2.0*a.hi*a.lo;
+    return dd_quick_two_sum(p.hi, p.lo);
+}
+
+// a / b for a small divisor, used for parsing only
+static inline dd_t<double> dd_div( const dd_t<double> &a, double b )
+{
+    const double q1 = a.hi / b;
+    const dd_t<double> p = dd_two_prod(q1, b);
+    dd_t<double> s = dd_two_sum(a.hi, -p.hi);
+    s.lo -= p.lo;
+    s.lo += a.lo;
+    return dd_quick_two_sum(q1, (s.hi + s.lo) / b);
+}
+
+/**
+ * @brief Parses a decimal number like "-0.7436438870371587047521915" to the nearest double-double
+ * (within a few units of the last place)
+ * @param str The nullterminated string to parse
+ * @param out The parsed number
+ * @return false if the string is no valid decimal number
+ */
+static inline bool dd_parse( const char *str, dd_t<double> &out )
+{
+
+    while (isspace(*str)) str++;
+    const bool negative = *str == '-';
+    if (*str == '-' || *str == '+') str++;
+
+    // integer part
+    dd_t<double> integer = { 0.0, 0.0 };
+    unsigned int num_digits = 0u;
+    for (; isdigit(*str); str++, num_digits++) {
+        integer = dd_add(dd_t<double>{ integer.hi*10.0, integer.lo*10.0 }, (double)(*str - '0'));
+        if (integer.hi > 15.0) return false; // everything interesting is within |c| <= 2
+    }
+
+    // fractional part, accumulated from the last digit to the first one like fixed_t::parse()
+    dd_t<double> fraction = { 0.0, 0.0 };
+    if (*str == '.') {
+        const char *begin = ++str;
+        while (isdigit(*str)) str++;
+        num_digits += str - begin;
+        for (const char *digit = str-1; digit >= begin; digit--) fraction = dd_div(dd_add(fraction, (double)(*digit - '0')), 10.0);
+    }
+    if (num_digits == 0u || *str != '\0') return false;
+
+    out = dd_add(integer, fraction);
+    if (negative) out = { -out.hi, -out.lo };
+    return true;
+
+}
+
+#endif
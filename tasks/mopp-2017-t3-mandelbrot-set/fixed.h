@@ -0,0 +1,51 @@
+#ifndef __HEADER_FIXED__
+#define __HEADER_FIXED__
+
+#include <stdint.h>
+
+/**
+ * @brief Signed fixed point number with LIMBS 32bit limbs in two's complement.
+ * The most significant limb holds the integer part, all others the fraction.
+ * Only used for the reference orbit of the deep zoom, so speed is secondary.
+ */
+template<uint32_t LIMBS>
+struct fixed_t {
+
+    static_assert(LIMBS >= 2, "fixed_t needs at least one integer and one fractional limb");
+
+    uint32_t limbs[LIMBS] = {0u}; // little endian, limbs[LIMBS-1] is the integer part
+
+    fixed_t() {}
+    fixed_t( int32_t value );
+
+    /**
+     * @brief Parses a decimal number like "-0.7436438870371587047521915"
+     * @param str The nullterminated string to parse
+     * @param out The parsed number
+     * @return false if the string is no valid decimal number
+     */
+    static bool parse( const char *str, fixed_t<LIMBS> &out );
+
+    bool is_negative() const;
+    double to_double() const;
+    fixed_t<LIMBS> operator-() const;
+    fixed_t<LIMBS> operator+( const fixed_t<LIMBS> &other ) const;
+    fixed_t<LIMBS> operator-( const fixed_t<LIMBS> &other ) const;
+    fixed_t<LIMBS> operator*( const fixed_t<LIMBS> &other ) const;
+
+    /**
+     * @brief Divides the (non negative) number by a small integer in place
+     * @param divisor The divisor
+     */
+    void divide( uint32_t divisor );
+
+    /**
+     * @brief Number of fractional bits this type can represent
+     */
+    static constexpr uint32_t precision_bits() { return 32u*(LIMBS-1u); }
+
+};
+
+#include "fixed.hpp"
+
+#endif
@@ -0,0 +1,120 @@
+#include <ctype.h>
+#include <math.h>
+
+template<uint32_t LIMBS>
+fixed_t<LIMBS>::fixed_t( int32_t value ) {
+    limbs[LIMBS-1u] = (uint32_t)value;
+    if (value < 0) for (uint32_t i = 0u; i < LIMBS-1u; i++) limbs[i] = 0u;
+}
+
+template<uint32_t LIMBS>
+bool fixed_t<LIMBS>::parse( const char *str, fixed_t<LIMBS> &out ) {
+
+    while (isspace(*str)) str++;
+    bool negative = *str == '-';
+    if (*str == '-' || *str == '+') str++;
+
+    // integer part
+    int32_t integer = 0;
+    uint32_t num_digits = 0u;
+    for (; isdigit(*str); str++, num_digits++) {
+        integer = integer*10 + (*str - '0');
+        if (integer > 15) return false; // everything interesting is within |c| <= 2
+    }
+
+    // fractional part, accumulated from the last digit to the first one
+    fixed_t<LIMBS> fraction;
+    if (*str == '.') {
+        const char *begin = ++str;
+        while (isdigit(*str)) str++;
+        num_digits += str - begin;
+        for (const char *digit = str-1; digit >= begin; digit--) {
+            fraction.limbs[LIMBS-1u] += *digit - '0';
+            fraction.divide(10u);
+        }
+    }
+    if (num_digits == 0u || *str != '\0') return false;
+
+    out = fraction + fixed_t<LIMBS>(integer);
+    if (negative) out = -out;
+    return true;
+
+}
+
+template<uint32_t LIMBS>
+bool fixed_t<LIMBS>::is_negative() const {
+    return (int32_t)limbs[LIMBS-1u] < 0;
+}
+
+template<uint32_t LIMBS>
+double fixed_t<LIMBS>::to_double() const {
+    if (is_negative()) return -(-*this).to_double();
+    double value = 0.0;
+    for (uint32_t i = 0u; i < LIMBS; i++) value = value/4294967296.0 + limbs[i];
+    return value;
+}
+
+template<uint32_t LIMBS>
+fixed_t<LIMBS> fixed_t<LIMBS>::operator-() const {
+    fixed_t<LIMBS> result;
+    uint64_t carry = 1u;
+    for (uint32_t i = 0u; i < LIMBS; i++) {
+        carry += (uint32_t)~limbs[i];
+        result.limbs[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    return result;
+}
+
+template<uint32_t LIMBS>
+fixed_t<LIMBS> fixed_t<LIMBS>::operator+( const fixed_t<LIMBS> &other ) const {
+    fixed_t<LIMBS> result;
+    uint64_t carry = 0u;
+    for (uint32_t i = 0u; i < LIMBS; i++) {
+        carry += (uint64_t)limbs[i] + other.limbs[i];
+        result.limbs[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    return result;
+}
+
+template<uint32_t LIMBS>
+fixed_t<LIMBS> fixed_t<LIMBS>::operator-( const fixed_t<LIMBS> &other ) const {
+    return *this + (-other);
+}
+
+template<uint32_t LIMBS>
+fixed_t<LIMBS> fixed_t<LIMBS>::operator*( const fixed_t<LIMBS> &other ) const {
+
+    // multiply the magnitudes and fix the sign afterwards
+    const bool negative = is_negative() != other.is_negative();
+    const fixed_t<LIMBS> a = is_negative() ? -*this : *this;
+    const fixed_t<LIMBS> b = other.is_negative() ? -other : other;
+
+    uint32_t product[2u*LIMBS] = {0u};
+    for (uint32_t i = 0u; i < LIMBS; i++) {
+        uint64_t carry = 0u;
+        for (uint32_t j = 0u; j < LIMBS; j++) {
+            carry += (uint64_t)a.limbs[i]*b.limbs[j] + product[i+j];
+            product[i+j] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        product[i+LIMBS] = (uint32_t)carry;
+    }
+
+    // drop the fractional limbs that are out of precision
+    fixed_t<LIMBS> result;
+    for (uint32_t i = 0u; i < LIMBS; i++) result.limbs[i] = product[i+LIMBS-1u];
+    return negative ? -result : result;
+
+}
+
+template<uint32_t LIMBS>
+void fixed_t<LIMBS>::divide( uint32_t divisor ) {
+    uint64_t remainder = 0u;
+    for (uint32_t i = LIMBS; i-- > 0u;) {
+        remainder = (remainder << 32) | limbs[i];
+        limbs[i] = (uint32_t)(remainder / divisor);
+        remainder %= divisor;
+    }
+}
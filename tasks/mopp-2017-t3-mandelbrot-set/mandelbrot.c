@@ -8,19 +8,18 @@
 #include <sched.h>
 #include <string.h>
 
+#include "dispenser.h"
+
 #ifdef MEASURE_TIMING
 #include "common.h"
 #endif
 
 // TYPEDEFS
+#define MIN_CHUNK_SIZE 10u
+
 typedef unsigned int uint;
 typedef unsigned char byte;
 
-typedef struct {
-    uint value;
-    pthread_mutex_t mutex;
-} atomic_uint_t;
-
 typedef struct {
     byte padding_front[64];
     uint thread_number;
@@ -30,7 +29,7 @@ typedef struct {
     float cols_f;
     uint num_iterations;
     u_char num_cores;
-    atomic_uint_t *next_pixel;
+    chunk_dispenser_t *dispenser;
     char *img;
     uint _p_begin;
     uint _p_end;
@@ -49,14 +48,14 @@ typedef struct {
 // GLOBAL VARS
 
 #ifdef MEASURE_TIMING
-clock_t ts_begin;
-clock_t ts_calculation;
+int64_t ts_begin;
+int64_t ts_calculation;
 
-clock_t time_full;
-clock_t time_preparation;
-clock_t time_calculation;
+int64_t time_full;
+int64_t time_preparation;
+int64_t time_calculation;
 
-clock_t *time_threads;
+int64_t *time_threads;
 #endif
 
 // FUNCTIONS
@@ -65,7 +64,7 @@ void *work( void *params_uncasted )
 {
 
     #ifdef MEASURE_TIMING
-    clock_t ts_begin_thread = get_timestamp();
+    int64_t ts_begin_thread = get_timestamp();
     #endif
 
     // cast to function parameters and variables
@@ -81,11 +80,10 @@ void *work( void *params_uncasted )
         fprintf(stderr, "Running thread %u on CPU %d\n", p->thread_number, sched_getcpu());
     }
 
-    p->_p_begin = p->thread_number*p->rows*(p->cols+1u)/(p->num_cores*2u);
-    p->_p_end = (p->thread_number+1u)*p->rows*(p->cols+1u)/(p->num_cores*2u);
-    
-    do {
+    // take chunks until the image is done
+    while (dispenser_next(p->dispenser, &p->_p_begin, &p->_p_end)) {
 
+        TRACE_SPAN_BEGIN(ts_chunk);
         p->_row = p->_p_begin / (p->cols+1u);
         p->_col = p->_p_begin % (p->cols+1u);
 
@@ -125,14 +123,9 @@ void *work( void *params_uncasted )
 
         }
 
-        // get more work
-        pthread_mutex_lock(&p->next_pixel->mutex);
-        p->_p_end = (p->next_pixel->value += 10u);
-        pthread_mutex_unlock(&p->next_pixel->mutex);
-        p->_p_begin = p->_p_end - 10u;
-        if (p->_p_end > p->rows*(p->cols+1u)) p->_p_end = p->rows*(p->cols+1u);
+        TRACE_SPAN_END(ts_chunk, "chunk", p->_p_begin);
 
-    } while(p->_p_begin < p->_p_end);
+    }
 
     #ifdef MEASURE_TIMING
     time_threads[p->thread_number] = get_timediff(ts_begin_thread);
@@ -159,13 +152,13 @@ int main() {
     (void)! scanf("%u", &cols);
     (void)! scanf("%u", &max_iterations);
     char *img = malloc(rows*(cols+1) + 128lu) + 64lu;
-    atomic_uint_t worker_pixel = { 0u };
-    pthread_mutex_init(&worker_pixel.mutex, 0);
+    chunk_dispenser_t dispenser;
+    dispenser_init(&dispenser, rows*(cols+1), NUM_CORES, MIN_CHUNK_SIZE);
 
     #ifdef MEASURE_TIMING
     time_preparation = get_timediff(ts_begin);
     ts_calculation = get_timestamp();
-    time_threads = malloc(NUM_CORES * sizeof(clock_t));
+    time_threads = malloc(NUM_CORES * sizeof(int64_t));
     #endif
 
     // calculate mandelbrot set
@@ -182,7 +175,7 @@ int main() {
         params_arr[i].num_iterations = max_iterations;
         params_arr[i].num_cores = NUM_CORES;
         params_arr[i].img = img;
-        params_arr[i].next_pixel = &worker_pixel;
+        params_arr[i].dispenser = &dispenser;
         
         if (i == NUM_CORES-1)
             work(&params_arr[i]);
@@ -192,21 +185,27 @@ int main() {
     }
 
     // wait for them to finish
+    TRACE_SPAN_BEGIN(ts_join);
     for (i = 0u; i < NUM_CORES; i++) if (i != NUM_CORES-1) pthread_join(threads[i], NULL);
+    TRACE_SPAN_END(ts_join, "join wait", NUM_CORES);
 
     // print result
+    TRACE_SPAN_BEGIN(ts_output);
     fwrite(img, 1, rows*(cols+1), stdout);
+    fflush(stdout);
+    TRACE_SPAN_END(ts_output, "write output", rows*(cols+1));
+    dispenser_free(&dispenser);
 
     #ifdef MEASURE_TIMING
     time_calculation = get_timediff(ts_calculation);
     ts_calculation = get_timestamp();
     time_full = get_timediff(ts_begin);
 
-    fprintf(stderr, "Time full: %.3fms\n", time_full/1.0e4);
-    fprintf(stderr, "Time preparation: %.3fms (%.2f%%)\n", time_preparation/1.0e4, time_preparation*100.0/time_full);
-    fprintf(stderr, "Time mandelbrot: %.3fms (%.2f%%)\n", time_calculation/1.0e4, time_calculation*100.0/time_full);
+    fprintf(stderr, "Time full: %.3fms\n", time_full/1.0e6);
+    fprintf(stderr, "Time preparation: %.3fms (%.2f%%)\n", time_preparation/1.0e6, time_preparation*100.0/time_full);
+    fprintf(stderr, "Time mandelbrot: %.3fms (%.2f%%)\n", time_calculation/1.0e6, time_calculation*100.0/time_full);
 
-    for (uint i = 0u; i < NUM_CORES; i++) fprintf(stderr, "Time thread %u: %.3fms\n", i, time_threads[i]/1.0e4);
+    for (uint i = 0u; i < NUM_CORES; i++) fprintf(stderr, "Time thread %u: %.3fms\n", i, time_threads[i]/1.0e6);
     #endif
 
     return 0;
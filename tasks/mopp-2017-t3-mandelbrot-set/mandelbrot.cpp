@@ -5,45 +5,80 @@
 
 #include <pthread.h>
 #include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <limits.h>
 #include <unistd.h>
+#include <sys/types.h>
+
+#include "common.h"
+#include "output.h"
+#include "counts.h"
+#ifdef PIPELINED_OUTPUT
+#include "bands.h"
+#endif
+#include "../common/topology.h"
+#include "../common/trace.h"
 
 
 // TYPEDEFS
 #define CACHELINE_SIZE 64lu
-#define INPUT_BUFFER_SIZE 16u
-#define OUTPUT_BUFFER_SIZE 8u
-
-struct alignas(8) pixel_value {
-    uint32_t pixel_number = UINT32_MAX;
-    char pixel_value;
+#define INPUT_BUFFER_SIZE 4u         // grants queued per worker
+#define OUTPUT_BUFFER_SIZE 4u        // finished grants queued per worker
+#define GRANT_TIME_NS 200000.0       // a grant should keep its worker busy for 0.2ms
+#define INITIAL_GRANT_SIZE 64u       // pixels per grant until the worker has a rate
+#define MIN_GRANT_SIZE 8u
+#define MAX_GRANT_SIZE 65536u
+#define RATE_SMOOTHING 0.25          // weight of the last grant in the rate of a worker
+#define NO_GRANT UINT64_MAX
+#define GRANT_SIZE_BITS 20u          // a grant is its first pixel << GRANT_SIZE_BITS | number of pixels
+#define NO_PIXEL UINT64_MAX
+
+static_assert(MAX_GRANT_SIZE < (1u << GRANT_SIZE_BITS), "the grant size does not fit");
+
+// the pixels of a finished grant, handed to the collector as a whole
+struct alignas(CACHELINE_SIZE) grant_output_t {
+    std::atomic<uint64_t> first_pixel{NO_PIXEL};    // NO_PIXEL while the slot is free
+    uint32_t size = 0u;
+    alignas(CACHELINE_SIZE) char pixels[MAX_GRANT_SIZE];
 };
 
 struct alignas(CACHELINE_SIZE) mandelbrot_globals_t {
     uint8_t num_threads;
     uint32_t rows; 
     uint32_t cols;
-    uint32_t img_size;
     uint32_t num_iterations;
+    uint64_t img_size;
     bool done = false;
-    char *img;
-    uint8_t padding_back[CACHELINE_SIZE-sizeof(uint8_t)-4*sizeof(uint32_t)-sizeof(bool)-sizeof(char*)];
+    output_format_t output_format;
+    char *img;              // only used for the ascii output
+    packed_image_t packed;  // 1 bit per pixel for the pbm/rle output
+    count_image_t *counts;  // escape counts for the pgm/ppm output
+    uint8_t padding_back[CACHELINE_SIZE-sizeof(uint8_t)-3*sizeof(uint32_t)-sizeof(uint64_t)-sizeof(bool)-sizeof(output_format_t)-sizeof(char*)-sizeof(packed_image_t)-sizeof(count_image_t*)];
 };
 
 struct alignas(CACHELINE_SIZE) mandelbrot_params_t {
-    uint32_t input[INPUT_BUFFER_SIZE];
-    pixel_value output[OUTPUT_BUFFER_SIZE];
+    uint64_t input[INPUT_BUFFER_SIZE];  // grants (see GRANT_SIZE_BITS), NO_GRANT if empty
+    grant_output_t output[OUTPUT_BUFFER_SIZE];
     uint8_t thread_number;
+    uint32_t *histogram = nullptr; // escape counts of this worker, only for the pgm/ppm output
+    // throughput of the worker for the feeder, written after every grant
+    alignas(CACHELINE_SIZE) std::atomic<double> rate{0.0};  // iterations per nanosecond, 0 until the first grant is done
+    std::atomic<uint64_t> iterations{0u};                   // done so far
+    std::atomic<uint64_t> pixels{0u};                       // done so far
+#ifdef MEASURE_TIMING
+    int64_t time_busy = 0;      // calculating the grants
+    int64_t time_finished = 0;  // from the start of the calculation to the last pixel of the worker
+    uint32_t num_grants = 0u;
+#endif
     mandelbrot_params_t() {
         memset(input, -1, INPUT_BUFFER_SIZE*sizeof(input[0]));
     }
 };
 
 struct alignas(CACHELINE_SIZE) mandelbrot_vars_t {
-    uint8_t input_queue_begin = 0u;
-    uint8_t output_queue_end = 0u;
-    uint32_t p;     // current pixel number to work on
+    uint64_t p;     // current pixel number to work on
     uint32_t r;     // current row to work on (calculated from p)
     uint32_t c;     // current column to work on (calculated from p)
     uint32_t n;     // current iteration
@@ -54,18 +89,27 @@ struct alignas(CACHELINE_SIZE) mandelbrot_vars_t {
     float c_r;      // real part of the constant "c" for the current pixel
     float c_i;      // imaginative part of the constant "c" for the current pixel
     float tmp;
-    uint8_t padding[CACHELINE_SIZE-2*sizeof(uint8_t)-4*sizeof(uint32_t)-7*sizeof(float)];
+    uint8_t input_queue_begin = 0u;
+    uint8_t output_queue_end = 0u;
+    uint8_t padding[CACHELINE_SIZE-2*sizeof(uint8_t)-sizeof(uint64_t)-3*sizeof(uint32_t)-7*sizeof(float)];
 };
 
 
 // GLOBALS
 mandelbrot_globals_t g;
+std::vector<int> cpu_plan;  // CPU of every worker, see topology_t::thread_cpus()
+int64_t ts_calculation;     // start of the calculation
+#ifdef PIPELINED_OUTPUT
+band_ring_t bands;          // the ascii image, see bands.h
+#endif
 
 // FUNCTIONS
 
 bool set_on_cpu( const int &cpu )
 {
 
+    if (cpu < 0) return true;
+
     cpu_set_t cpuset;
     CPU_ZERO(&cpuset);
     CPU_SET(cpu, &cpuset);
@@ -85,54 +129,108 @@ void *work( void *params_uncasted )
     auto p = (mandelbrot_params_t *)params_uncasted;
 
     // set CPU affinity
-    set_on_cpu(p->thread_number);
+    set_on_cpu(cpu_plan[p->thread_number]);
 
     mandelbrot_vars_t v;
+    uint64_t p_end;             // end of the current grant
+    uint32_t grant_size;
+    uint64_t grant_iterations;  // iterations of the current grant
+    int64_t ts_grant;           // start of the current grant, after the wait for a free output slot
+    char *pixel_out;            // next pixel of the current grant in its output slot
 
     // work loop
     while ( true ) {
 
-        // check for new work
-        while ( p->input[v.input_queue_begin] == UINT32_MAX ) {
-            if (g.done) goto lbl_end;
-            std::this_thread::sleep_for(std::chrono::nanoseconds(1));
+        // check for a new grant
+        if ( p->input[v.input_queue_begin] == NO_GRANT ) {
+            TRACE_SPAN_BEGIN(ts_starved);
+            while ( p->input[v.input_queue_begin] == NO_GRANT ) {
+                if (g.done) goto lbl_end;
+                std::this_thread::sleep_for(std::chrono::nanoseconds(1));
+            }
+            TRACE_SPAN_END(ts_starved, "starved", p->thread_number);
         }
-        v.p = p->input[v.input_queue_begin];
-        p->input[v.input_queue_begin] = UINT32_MAX;
+        v.p = p->input[v.input_queue_begin] >> GRANT_SIZE_BITS;
+        grant_size = (uint32_t)(p->input[v.input_queue_begin] & ((1u << GRANT_SIZE_BITS) - 1u));
+        p_end = v.p + grant_size;
+        p->input[v.input_queue_begin] = NO_GRANT;
         v.input_queue_begin = (v.input_queue_begin + 1) % INPUT_BUFFER_SIZE;
+        grant_iterations = 0u;
+
+        // wait until the collector took the oldest grant of the output ring
+        grant_output_t &out = p->output[v.output_queue_end];
+        if ( out.first_pixel.load(std::memory_order_acquire) != NO_PIXEL ) {
+            TRACE_SPAN_BEGIN(ts_full);
+            while ( out.first_pixel.load(std::memory_order_acquire) != NO_PIXEL ) std::this_thread::sleep_for(std::chrono::nanoseconds(1));
+            TRACE_SPAN_END(ts_full, "output full", p->thread_number);
+        }
+        out.size = grant_size;
+        pixel_out = out.pixels;
+        ts_grant = get_timestamp();
 
-        // prepare vars
-        v.n = 0u;
-        v.r = v.p / g.cols;
-        v.c = v.p % g.cols;
+        for (; v.p < p_end; v.p++) {
 
-        v.z_r = 0.0f;
-        v.z_i = 0.0f;
-        v.c_r = v.c * 2.0f / g.cols - 1.5f;
-        v.c_i = v.r * 2.0f / g.rows - 1.0f;
-        
+            // prepare vars
+            v.n = 0u;
+            v.r = v.p / g.cols;
+            v.c = v.p % g.cols;
+
+            v.z_r = 0.0f;
+            v.z_i = 0.0f;
+            v.c_r = v.c * 2.0f / g.cols - 1.5f;
+            v.c_i = v.r * 2.0f / g.rows - 1.0f;
+
+            //fprintf(stderr, "Working on pixel %u (%u, %u)\n", v.p, v.r, v.c);
+
+            // calculate pixel
+            while (( (v.z_r_sqr = (v.z_r*v.z_r)) + (v.z_i_sqr = (v.z_i*v.z_i)) ) < 4.0f && ++v.n < g.num_iterations) {
+                v.tmp = v.z_r;
+                v.z_r = v.z_r_sqr - v.z_i_sqr + v.c_r;
+                v.z_i = v.z_i * 2.0f * v.tmp  + v.c_i;
+            }
+            grant_iterations += v.n;
+
+            // keep the escape count
+            if (g.counts != nullptr) {
+                count_image_set(*g.counts, v.p, v.n, v.z_r_sqr + v.z_i_sqr);
+                p->histogram[v.n]++;
+                std::atomic_thread_fence(std::memory_order_release);
+            }
+
+            // set pixel
+            *pixel_out++ = (v.n == g.num_iterations) ? '#' : '.';
 
-        //fprintf(stderr, "Working on pixel %u (%u, %u)\n", v.p, v.r, v.c);
-        
-        // calculate pixel
-        while (( (v.z_r_sqr = (v.z_r*v.z_r)) + (v.z_i_sqr = (v.z_i*v.z_i)) ) < 4.0f && ++v.n < g.num_iterations) {
-            v.tmp = v.z_r;
-            v.z_r = v.z_r_sqr - v.z_i_sqr + v.c_r;
-            v.z_i = v.z_i * 2.0f * v.tmp  + v.c_i;
         }
-        
-        // set pixel
-        while ( p->output[v.output_queue_end].pixel_number != UINT32_MAX ) std::this_thread::sleep_for(std::chrono::nanoseconds(1));
-        p->output[v.output_queue_end].pixel_value = (v.n == g.num_iterations) ? '#' : '.';
-        p->output[v.output_queue_end].pixel_number = v.p;
+
+        // hand the whole grant to the collector
+        out.first_pixel.store(p_end - grant_size, std::memory_order_release);
         v.output_queue_end = (v.output_queue_end + 1) % OUTPUT_BUFFER_SIZE;
-        //fprintf(stderr, "Finished pixel %u\n", v.p);
+
+        // publish the throughput of the grant, a worker that is throttled or shares its core with
+        // an SMT sibling gets a lower rate and so smaller grants
+        const int64_t ts_done = get_timestamp();
+        const double rate = grant_iterations / (double)std::max<int64_t>(ts_done - ts_grant, 1);
+        const double last_rate = p->rate.load(std::memory_order_relaxed);
+        p->rate.store(last_rate == 0.0 ? rate : last_rate + RATE_SMOOTHING * (rate - last_rate), std::memory_order_relaxed);
+        p->iterations.fetch_add(grant_iterations, std::memory_order_relaxed);
+        p->pixels.fetch_add(grant_size, std::memory_order_relaxed);
+        #ifdef MEASURE_TIMING
+        p->time_busy += ts_done - ts_grant;
+        p->time_finished = ts_done - ts_calculation;
+        p->num_grants++;
+        #endif
 
     }
 
     // done
     lbl_end:
     fprintf(stderr, "Thread %u finished!\n", p->thread_number);
+
+    // help writing the escape counts as soon as the histogram is equalised
+    if (g.counts != nullptr) {
+        while (!g.counts->ready) std::this_thread::sleep_for(std::chrono::nanoseconds(1));
+        if (g.counts->seekable) count_image_write_rows(*g.counts);
+    }
     return nullptr;
 
 }
@@ -140,33 +238,50 @@ void *work( void *params_uncasted )
 void *collect_output( void *thread_params_uncasted )
 {
 
-    // last CPU
-    set_on_cpu(g.num_threads-1);
+    // CPU of the last worker
+    set_on_cpu(cpu_plan[g.num_threads-1]);
 
     auto params_arr = (mandelbrot_params_t*) thread_params_uncasted;
 
-    uint32_t pixels_processed = 0u;
+    uint64_t pixels_processed = 0u;
     auto output_queues_begin = new uint8_t[g.num_threads];
     for (uint8_t i = 0u; i < g.num_threads; i++) output_queues_begin[i] = 0u;
     while (pixels_processed < g.img_size) {
 
+        bool collected = false;
         for (uint8_t i = 0u; i < g.num_threads; i++) {
 
-            // check for new pixels
-            while (params_arr[i].output[output_queues_begin[i]].pixel_number != UINT32_MAX) {
-
-                // read pixel result from worker
-                g.img[params_arr[i].output[output_queues_begin[i]].pixel_number] = params_arr[i].output[output_queues_begin[i]].pixel_value;
-                //fprintf(stderr, "Received pixel: %u\n", params_arr[i].output[output_queues_begin[i]].pixel_number);
-                params_arr[i].output[output_queues_begin[i]].pixel_number = UINT32_MAX;
+            // check for finished grants
+            grant_output_t *out;
+            while ((out = &params_arr[i].output[output_queues_begin[i]])->first_pixel.load(std::memory_order_acquire) != NO_PIXEL) {
+
+                // read the pixels of the grant
+                const uint64_t first_pixel = out->first_pixel.load(std::memory_order_relaxed);
+                if (g.counts != nullptr) {
+                    // the worker stored the escape counts already
+                } else if (g.output_format == OUTPUT_ASCII) {
+                    #ifdef PIPELINED_OUTPUT
+                    for (uint32_t k = 0u; k < out->size; k++) band_ring_set(bands, first_pixel + k, out->pixels[k]);
+                    #else
+                    memcpy(g.img + first_pixel, out->pixels, out->size);
+                    #endif
+                } else {
+                    for (uint32_t k = 0u; k < out->size; k++) {
+                        if (out->pixels[k] == '#') packed_image_set(g.packed, (first_pixel + k) / g.cols, (first_pixel + k) % g.cols);
+                    }
+                }
+                pixels_processed += out->size;
+                out->first_pixel.store(NO_PIXEL, std::memory_order_release);
                 output_queues_begin[i] = (output_queues_begin[i] + 1) % OUTPUT_BUFFER_SIZE;
-                
-                pixels_processed++;
+                collected = true;
 
             }
 
         }
 
+        // leave the CPU to the workers until they finish the next grants
+        if (!collected) std::this_thread::sleep_for(std::chrono::nanoseconds(1));
+
     }
 
     fprintf(stderr, "Finished collecting the outputs\n");
@@ -175,32 +290,76 @@ void *collect_output( void *thread_params_uncasted )
 
 }
 
+/**
+ * @brief Size of the next grant of a worker: as many pixels as it calculates in GRANT_TIME_NS at its
+ * measured rate, but at most its share (by rate) of half of the remaining pixels, so that all workers
+ * run out of pixels at about the same time
+ */
+uint32_t next_grant_size( const mandelbrot_params_t *params_arr, uint8_t worker, uint64_t remaining )
+{
+
+    const double rate = params_arr[worker].rate.load(std::memory_order_relaxed);
+    if (rate == 0.0) return (uint32_t)std::min<uint64_t>(INITIAL_GRANT_SIZE, remaining);
+
+    // iterations per pixel so far, the rates of workers without a grant yet count as the average
+    double sum_rate = 0.0;
+    uint64_t iterations = 0u, pixels = 0u;
+    uint8_t num_rates = 0u;
+    for (uint8_t i = 0u; i < g.num_threads; i++) {
+        const double rate_i = params_arr[i].rate.load(std::memory_order_relaxed);
+        if (rate_i != 0.0) {
+            sum_rate += rate_i;
+            num_rates++;
+        }
+        iterations += params_arr[i].iterations.load(std::memory_order_relaxed);
+        pixels += params_arr[i].pixels.load(std::memory_order_relaxed);
+    }
+    sum_rate *= (double)g.num_threads / num_rates;
+    const double iterations_per_pixel = std::max(1.0, iterations / (double)std::max<uint64_t>(pixels, 1u));
+
+    const double size = std::min(rate * GRANT_TIME_NS / iterations_per_pixel, remaining * 0.5 * rate / sum_rate);
+    return (uint32_t)std::min<uint64_t>((uint32_t)std::min(std::max(size, (double)MIN_GRANT_SIZE), (double)MAX_GRANT_SIZE), remaining);
+
+}
+
 void *provide_input( void *thread_params_uncasted )
 {
 
-    // first CPU
-    set_on_cpu(0);
+    // CPU of the first worker
+    set_on_cpu(cpu_plan[0]);
 
     auto params_arr = (mandelbrot_params_t*) thread_params_uncasted;
 
-    // feed the little threads
+    // feed the little threads with grants sized to their throughput
     uint8_t i;
-    uint32_t p = 0;
-    auto input_queues_end = new uint8_t[g.num_threads];
+    uint64_t p = 0, size, limit = g.img_size;
+    auto input_queues_end = new uint8_t[g.num_threads]();
     while ( true ) {
 
+        bool granted = false;
         for (i = 0u; i < g.num_threads && p < g.img_size; i++) {
 
             // provide new input for worker
-            while (params_arr[i].input[input_queues_end[i]] == UINT32_MAX) {
-                //fprintf(stderr, "Next pixel: %u\n", p);
-                params_arr[i].input[input_queues_end[i]] = p++;
+            if (params_arr[i].input[input_queues_end[i]] == NO_GRANT) TRACE_INSTANT("grant", i);
+            while (params_arr[i].input[input_queues_end[i]] == NO_GRANT) {
+                #ifdef PIPELINED_OUTPUT
+                // nothing beyond the bands in memory, the writer frees the oldest one
+                if (g.output_format == OUTPUT_ASCII) limit = band_ring_limit(bands);
+                if (p == limit) break;
+                #endif
+                size = std::min<uint64_t>(next_grant_size(params_arr, i, g.img_size - p), limit - p);
+                params_arr[i].input[input_queues_end[i]] = p << GRANT_SIZE_BITS | size;
+                p += size;
                 input_queues_end[i] = (input_queues_end[i] + 1) % INPUT_BUFFER_SIZE;
+                granted = true;
                 if (p == g.img_size) goto lbl_end;
             }
 
         }
 
+        // all input rings are full, leave the CPU to the workers
+        if (!granted) std::this_thread::sleep_for(std::chrono::nanoseconds(1));
+
     }
 
     lbl_end:
@@ -211,26 +370,49 @@ void *provide_input( void *thread_params_uncasted )
 
 int main() {
 
-    // let the main thread be on the first CPU
-    if (!set_on_cpu(0)) return 1;
+    #ifdef MEASURE_TIMING
+    const int64_t ts_begin = get_timestamp();
+    #endif
 
-    // get amount of cores
-    const char *NUM_CORES_STRING = getenv("MAX_CPUS");
-    g.num_threads = NUM_CORES_STRING == NULL ? 1 : strtoul(NUM_CORES_STRING, NULL, 10);
+    // get amount of cores and the CPUs that are granted, which need not start at 0
+    const topology_t &topology = system_topology();
+    g.num_threads = std::min(topology.threads(THREADS_ALL_CPUS), (unsigned int)UINT8_MAX);
+    cpu_plan = topology.thread_cpus(g.num_threads);
     fprintf(stderr, "Working with %u threads\n", g.num_threads);
 
+    // let the main thread be on the first CPU
+    if (!set_on_cpu(cpu_plan[0])) return 1;
+
     // read parameters
     (void)! scanf("%u", &g.rows);
     (void)! scanf("%u", &g.cols);
     (void)! scanf("%u", &g.num_iterations);
 
     // create image
-    g.img_size = g.rows*g.cols;
-    g.img = new char[g.img_size];
+    g.img_size = (uint64_t)g.rows*g.cols;
+    if (g.img_size >= 1ull << (64u - GRANT_SIZE_BITS)) {
+        fprintf(stderr, "The image of %u x %u pixels is too large, the grants address at most 2^%u pixels\n", g.rows, g.cols, 64u - GRANT_SIZE_BITS);
+        return 1;
+    }
+    g.output_format = get_output_format();
+    g.counts = nullptr;
+    if (g.output_format == OUTPUT_ASCII) {
+        #ifdef PIPELINED_OUTPUT
+        band_ring_init(bands, g.rows, g.cols);
+        #else
+        g.img = new char[g.img_size];
+        #endif
+    } else if (g.output_format == OUTPUT_PBM || g.output_format == OUTPUT_RLE) {
+        packed_image_init(g.packed, g.rows, g.cols);
+    } else {
+        g.counts = new count_image_t;
+        count_image_init(*g.counts, g.rows, g.cols, g.num_iterations, g.output_format);
+    }
     
     // create input feeder thread
     pthread_t input_thread, output_thread;
     auto params_arr = new mandelbrot_params_t[g.num_threads];
+    ts_calculation = get_timestamp();
     pthread_create(&input_thread, NULL, provide_input, params_arr);
 
     // let workers calculate
@@ -240,6 +422,7 @@ int main() {
 
         // set parameters for thread
         params_arr[i].thread_number = i;
+        if (g.counts != nullptr) params_arr[i].histogram = count_histogram_alloc(g.num_iterations);
         
         // create thread
         pthread_create(&threads[i], NULL, work, params_arr+i);
@@ -248,26 +431,96 @@ int main() {
 
     // create output collector and wait
     pthread_create(&output_thread, NULL, collect_output, params_arr);
+    #ifdef PIPELINED_OUTPUT
+    // write the bands while the workers calculate the next ones
+    bool pipeline_success = true;
+    if (g.output_format == OUTPUT_ASCII) pipeline_success = band_ring_write(bands, STDOUT_FILENO);
+    #endif
     pthread_join(input_thread, NULL);
     pthread_join(output_thread, NULL);
     g.done = true;
 
+    // merge the histograms of the workers and let them write the escape counts
+    if (g.counts != nullptr) {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        auto histograms = new uint32_t*[g.num_threads];
+        for (i = 0u; i < g.num_threads; i++) histograms[i] = params_arr[i].histogram;
+        count_image_equalise(*g.counts, histograms, g.num_threads);
+        delete[] histograms;
+        fflush(stdout);
+        if (!count_image_begin_write(*g.counts, STDOUT_FILENO)) g.counts->success = false;
+        g.counts->ready = true;
+        count_image_write_rows(*g.counts);
+    }
+
     // wait for them to finish
     fprintf(stderr, "All input distributed. Waiting for worker threads to finish...\n");
+    TRACE_SPAN_BEGIN(ts_join);
     for (i = 0u; i < g.num_threads; i++) {
         pthread_join(threads[i], NULL);
         fprintf(stderr, "Joined thread %u\n", i);
     }
+    TRACE_SPAN_END(ts_join, "join wait", g.num_threads);
+    #ifdef MEASURE_TIMING
+    const int64_t time_calculation = get_timediff(ts_calculation);
+    #endif
 
     // write result
     fprintf(stderr, "Printing result...\n");
-    for (auto img_ptr = g.img; img_ptr < g.img+g.img_size; img_ptr += g.cols) {
-        fwrite(img_ptr, sizeof(g.img[0u]), g.cols, stdout);
-        fputc('\n', stdout);
+    TRACE_SCOPE("write output", g.img_size);
+    if (g.counts != nullptr) {
+        if (!g.counts->success) {
+            fprintf(stderr, "Could not write the result: %s\n", strerror(errno));
+            return 1;
+        }
+    } else if (g.output_format == OUTPUT_ASCII) {
+        #ifdef PIPELINED_OUTPUT
+        if (!pipeline_success) {
+            fprintf(stderr, "Could not write the result: %s\n", strerror(errno));
+            return 1;
+        }
+        #else
+        for (auto img_ptr = g.img; img_ptr < g.img+g.img_size; img_ptr += g.cols) {
+            fwrite(img_ptr, sizeof(g.img[0u]), g.cols, stdout);
+            fputc('\n', stdout);
+        }
+        #endif
+    } else {
+        fflush(stdout);
+        if (!write_packed(STDOUT_FILENO, g.packed, g.output_format, g.num_threads)) {
+            fprintf(stderr, "Could not write the result: %s\n", strerror(errno));
+            return 1;
+        }
+    }
+
+    #ifdef MEASURE_TIMING
+    const int64_t time_full = get_timediff(ts_begin);
+    int64_t first_finished = INT64_MAX, last_finished = 0;
+    fprintf(stderr, "Time full: %.3fms\n", time_full/1.0e6);
+    fprintf(stderr, "Time mandelbrot: %.3fms (%.2f%%)\n", time_calculation/1.0e6, time_calculation*100.0/time_full);
+    for (i = 0u; i < g.num_threads; i++) {
+        fprintf(stderr, "Time thread %u: %.3fms (busy %.3fms, %u grants, %.1fM iterations/s)\n", i, params_arr[i].time_finished/1.0e6,
+            params_arr[i].time_busy/1.0e6, params_arr[i].num_grants, params_arr[i].rate.load()*1.0e3);
+        first_finished = std::min(first_finished, params_arr[i].time_finished);
+        last_finished = std::max(last_finished, params_arr[i].time_finished);
     }
+    fprintf(stderr, "Time tail: %.3fms (first to last thread finished)\n", (last_finished - first_finished)/1.0e6);
+    #endif
 
     // cleanup
-    delete[] g.img;
+    if (g.counts != nullptr) {
+        for (i = 0u; i < g.num_threads; i++) free(params_arr[i].histogram);
+        count_image_free(*g.counts);
+        delete g.counts;
+    } else if (g.output_format == OUTPUT_ASCII) {
+        #ifdef PIPELINED_OUTPUT
+        band_ring_free(bands);
+        #else
+        delete[] g.img;
+        #endif
+    } else {
+        delete[] g.packed.bits;
+    }
     delete[] params_arr;
     delete[] threads;
     return 0;
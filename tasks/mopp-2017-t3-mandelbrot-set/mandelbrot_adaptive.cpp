@@ -0,0 +1,254 @@
+/*
+ * Renderer with the precision chosen per tile (mandelbrot_kernel.h): most of an image is fine
+ * with float, only tiles where float is not enough get rendered again with double or
+ * double-double. A tile escalates when
+ *  - the pixels collapse: the distance of neighbouring pixels is not much larger than the
+ *    rounding step (ulp) of their c, so float (or double) cannot even tell them apart
+ *  - the escape counts of neighbouring pixels diverge: close to the boundary of the set a long
+ *    orbit amplifies the rounding errors, so a jump of the counts is where float goes wrong.
+ *    Only checked while the precision has less than MARGIN_BITS to spare, so with double at
+ *    the default view a tile does not escalate any further
+ * Every precision iterates the pixels of a row in GCC vectors of the native width (SSE 16 bytes,
+ * AVX 32 bytes), wider vectors would be split into scalar code.
+ */
+
+#include "mandelbrot_kernel.h"
+#include "double_double.h"
+
+#include <atomic>
+
+#include <math.h>
+#include <stdlib.h>
+
+// DEFINES
+#define TILE_SIZE 16u               // pixels per side of a tile
+#ifdef __AVX__
+    #define VECTOR_SIZE 32u
+#else
+    #define VECTOR_SIZE 16u
+#endif
+#define SPACING_GUARD_BITS 4        // the pixel distance must be 2^4 ulps of c at least
+#define MARGIN_BITS 24              // divergent counts escalate below 2^24 ulps per pixel distance
+
+// TYPEDEFS
+typedef float float_vec_t __attribute__((vector_size(VECTOR_SIZE)));
+typedef double double_vec_t __attribute__((vector_size(VECTOR_SIZE)));
+typedef int32_t int32_vec_t __attribute__((vector_size(VECTOR_SIZE)));
+typedef int64_t int64_vec_t __attribute__((vector_size(VECTOR_SIZE)));
+
+#define FLOAT_LANES (VECTOR_SIZE/sizeof(float))
+#define DOUBLE_LANES (VECTOR_SIZE/sizeof(double))
+
+// mantissa bits of the precisions
+static const int PRECISION_BITS[MANDELBROT_NUM_PRECISIONS] = { 24, 53, 106 };
+
+// FUNCTIONS
+
+template<typename M>
+static inline bool any_lane( const M &mask )
+{
+    for (unsigned int l = 0u; l < sizeof(M)/sizeof(mask[0]); l++) if (mask[l] != 0) return true;
+    return false;
+}
+
+// the same iteration as mandelbrot.cpp for every lane: n counts the successful checks of |z| < 2
+template<typename V, typename M, typename I>
+static void iterate_lanes( const V &c_r, const V &c_i, uint32_t num_iterations, uint32_t *counts )
+{
+    V z_r = {}, z_i = {}, z_r_sqr, z_i_sqr, tmp;
+    M n = {}, active = n - 1;
+    const M limit = n + (I)num_iterations;
+    while (true) {
+        z_r_sqr = z_r*z_r;
+        z_i_sqr = z_i*z_i;
+        active &= z_r_sqr + z_i_sqr < 4.0f;
+        n -= active;
+        active &= n < limit;
+        if (!any_lane(active)) break;
+        tmp = z_r;
+        z_r = z_r_sqr - z_i_sqr + c_r;
+        z_i = z_i * 2.0f * tmp + c_i;
+    }
+    for (unsigned int l = 0u; l < sizeof(V)/sizeof(c_r[0]); l++) counts[l] = n[l];
+}
+
+static void iterate_lanes_dd( const dd_t<double_vec_t> &c_r, const dd_t<double_vec_t> &c_i, uint32_t num_iterations, uint32_t *counts )
+{
+    dd_t<double_vec_t> z_r = {}, z_i = {}, z_r_sqr, z_i_sqr, z_ri;
+    int64_vec_t n = {}, active = n - 1;
+    const int64_vec_t limit = n + (int64_t)num_iterations;
+    while (true) {
+        z_r_sqr = dd_sqr(z_r);
+        z_i_sqr = dd_sqr(z_i);
+        active &= z_r_sqr.hi + z_i_sqr.hi < 4.0;
+        n -= active;
+        active &= n < limit;
+        if (!any_lane(active)) break;
+        z_ri = dd_mul(z_r, z_i);
+        z_i = dd_add(dd_t<double_vec_t>{ 2.0*z_ri.hi, 2.0*z_ri.lo }, c_i);
+        z_r = dd_add(dd_sub(z_r_sqr, z_i_sqr), c_r);
+    }
+    for (unsigned int l = 0u; l < DOUBLE_LANES; l++) counts[l] = n[l];
+}
+
+/**
+ * @brief Escape counts of a tile in the given precision
+ * @param c_r The real parts of the columns of the tile
+ * @param c_i The imaginary parts of the rows of the tile
+ * @param f_r The same in float, calculated like mandelbrot.cpp does
+ * @param f_i
+ */
+static void render_tile( mandelbrot_precision_t precision, const dd_t<double> *c_r, const dd_t<double> *c_i, const float *f_r, const float *f_i,
+                         uint32_t num_iterations, uint32_t *counts )
+{
+    for (unsigned int tr = 0u; tr < TILE_SIZE; tr++) {
+        uint32_t *out = counts + tr*TILE_SIZE;
+        if (precision == MANDELBROT_FLOAT) {
+            for (unsigned int tc = 0u; tc < TILE_SIZE; tc += FLOAT_LANES) {
+                float_vec_t v_r = {};
+                const float_vec_t v_i = v_r + f_i[tr];
+                for (unsigned int l = 0u; l < FLOAT_LANES; l++) v_r[l] = f_r[tc+l];
+                iterate_lanes<float_vec_t, int32_vec_t, int32_t>(v_r, v_i, num_iterations, out + tc);
+            }
+        } else if (precision == MANDELBROT_DOUBLE) {
+            for (unsigned int tc = 0u; tc < TILE_SIZE; tc += DOUBLE_LANES) {
+                double_vec_t v_r = {};
+                const double_vec_t v_i = v_r + (c_i[tr].hi + c_i[tr].lo);
+                for (unsigned int l = 0u; l < DOUBLE_LANES; l++) v_r[l] = c_r[tc+l].hi + c_r[tc+l].lo;
+                iterate_lanes<double_vec_t, int64_vec_t, int64_t>(v_r, v_i, num_iterations, out + tc);
+            }
+        } else {
+            for (unsigned int tc = 0u; tc < TILE_SIZE; tc += DOUBLE_LANES) {
+                const double_vec_t zero = {};
+                dd_t<double_vec_t> v_r = { zero, zero };
+                const dd_t<double_vec_t> v_i = { zero + c_i[tr].hi, zero + c_i[tr].lo };
+                for (unsigned int l = 0u; l < DOUBLE_LANES; l++) {
+                    v_r.hi[l] = c_r[tc+l].hi;
+                    v_r.lo[l] = c_r[tc+l].lo;
+                }
+                iterate_lanes_dd(v_r, v_i, num_iterations, out + tc);
+            }
+        }
+    }
+}
+
+static inline uint32_t distance( uint32_t a, uint32_t b )
+{
+    return a > b ? a - b : b - a;
+}
+
+// two neighbouring pixels of the tile whose counts differ by more than the threshold
+static bool counts_diverge( const uint32_t *counts, unsigned int height, unsigned int width, uint32_t num_iterations )
+{
+    const uint32_t threshold = num_iterations / 16u > 16u ? num_iterations / 16u : 16u;
+    for (unsigned int tr = 0u; tr < height; tr++) {
+        for (unsigned int tc = 0u; tc < width; tc++) {
+            const uint32_t n = counts[tr*TILE_SIZE + tc];
+            if (tc+1u < width && distance(n, counts[tr*TILE_SIZE + tc+1u]) > threshold) return true;
+            if (tr+1u < height && distance(n, counts[(tr+1u)*TILE_SIZE + tc]) > threshold) return true;
+        }
+    }
+    return false;
+}
+
+bool mandelbrot_parse_view( const char *centre_r, const char *centre_i, const char *zoom, mandelbrot_view_t &view )
+{
+    dd_t<double> r, i;
+    if (!dd_parse(centre_r, r) || !dd_parse(centre_i, i)) return false;
+    view.centre_r[0] = r.hi;
+    view.centre_r[1] = r.lo;
+    view.centre_i[0] = i.hi;
+    view.centre_i[1] = i.lo;
+    view.zoom = strtod(zoom, NULL);
+    return view.zoom > 0.0 && view.zoom < 1e300;
+}
+
+bool mandelbrot_view_resolvable( uint32_t rows, uint32_t cols, const mandelbrot_view_t &view )
+{
+    // like the margin of a tile, with the largest |c| of the whole view
+    const double max_r = fabs(view.centre_r[0]) + 1.0 / view.zoom, max_i = fabs(view.centre_i[0]) + 1.0 / view.zoom;
+    const double bits_r = log2(2.0 / cols / view.zoom / max_r) + PRECISION_BITS[MANDELBROT_DOUBLE_DOUBLE] - 1;
+    const double bits_i = log2(2.0 / rows / view.zoom / max_i) + PRECISION_BITS[MANDELBROT_DOUBLE_DOUBLE] - 1;
+    return bits_r >= SPACING_GUARD_BITS && bits_i >= SPACING_GUARD_BITS;
+}
+
+bool mandelbrot_render_adaptive( uint32_t rows, uint32_t cols, uint32_t num_iterations, const mandelbrot_view_t &view, char *img,
+                                 thread_pool_t &pool, mandelbrot_precision_stats_t *stats )
+{
+
+    if (!mandelbrot_view_resolvable(rows, cols, view)) return false;
+
+    const uint32_t tile_rows = (rows + TILE_SIZE - 1u) / TILE_SIZE, tile_cols = (cols + TILE_SIZE - 1u) / TILE_SIZE;
+    const dd_t<double> centre_r = { view.centre_r[0], view.centre_r[1] }, centre_i = { view.centre_i[0], view.centre_i[1] };
+    const double step_r = 2.0 / cols / view.zoom, step_i = 2.0 / rows / view.zoom;
+    // the left and top edge in float, -1.5 and -1 for the default view
+    const float left = (float)(view.centre_r[0] + view.centre_r[1] - 1.0 / view.zoom), top = (float)(view.centre_i[0] + view.centre_i[1] - 1.0 / view.zoom);
+    const float zoom = (float)view.zoom;
+    std::atomic<uint64_t> tiles[MANDELBROT_NUM_PRECISIONS], escalated{0u}, changed_pixels{0u};
+    for (auto &t : tiles) t.store(0u, std::memory_order_relaxed);
+
+    pool.run(tile_rows * tile_cols, [&]( unsigned int t, unsigned int ) {
+
+        const uint32_t r0 = t / tile_cols * TILE_SIZE, c0 = t % tile_cols * TILE_SIZE;
+        const unsigned int height = rows - r0 < TILE_SIZE ? rows - r0 : TILE_SIZE, width = cols - c0 < TILE_SIZE ? cols - c0 : TILE_SIZE;
+
+        // c of the pixels like the deep zoom renderer: centre + (-1..1) / zoom
+        // and in float with the expression of mandelbrot.cpp (c * 2.0f / cols - 1.5f at the default
+        // view, the division by a zoom of 1 is exact), so the float tiles match its pixels
+        dd_t<double> c_r[TILE_SIZE], c_i[TILE_SIZE];
+        float f_r[TILE_SIZE], f_i[TILE_SIZE];
+        double max_r = 0.0, max_i = 0.0;
+        for (unsigned int k = 0u; k < TILE_SIZE; k++) {
+            c_r[k] = dd_add(centre_r, ((c0 + k) * 2.0 / cols - 1.0) / view.zoom);
+            c_i[k] = dd_add(centre_i, ((r0 + k) * 2.0 / rows - 1.0) / view.zoom);
+            f_r[k] = (c0 + k) * 2.0f / cols / zoom + left;
+            f_i[k] = (r0 + k) * 2.0f / rows / zoom + top;
+            max_r = fmax(max_r, fabs(c_r[k].hi));
+            max_i = fmax(max_i, fabs(c_i[k].hi));
+        }
+
+        // bits between the rounding step of c and the pixel distance for every precision
+        int margin[MANDELBROT_NUM_PRECISIONS];
+        for (int p = 0; p < MANDELBROT_NUM_PRECISIONS; p++) {
+            const double bits_r = max_r > 0.0 ? log2(step_r / max_r) + PRECISION_BITS[p] - 1 : 1e9;
+            const double bits_i = max_i > 0.0 ? log2(step_i / max_i) + PRECISION_BITS[p] - 1 : 1e9;
+            margin[p] = (int)fmin(fmin(bits_r, bits_i), 1e9);
+        }
+
+        // the lowest precision that can tell the pixels apart
+        int precision = MANDELBROT_FLOAT;
+        while (precision < MANDELBROT_DOUBLE_DOUBLE && margin[precision] < SPACING_GUARD_BITS) precision++;
+        uint32_t counts[TILE_SIZE*TILE_SIZE], escalated_counts[TILE_SIZE*TILE_SIZE];
+        render_tile((mandelbrot_precision_t)precision, c_r, c_i, f_r, f_i, num_iterations, counts);
+
+        // again with more precision where the counts diverge
+        while (precision < MANDELBROT_DOUBLE_DOUBLE && margin[precision] < MARGIN_BITS && counts_diverge(counts, height, width, num_iterations)) {
+            precision++;
+            render_tile((mandelbrot_precision_t)precision, c_r, c_i, f_r, f_i, num_iterations, escalated_counts);
+            uint64_t changed = 0u;
+            for (unsigned int k = 0u; k < TILE_SIZE*TILE_SIZE; k++) {
+                if (k / TILE_SIZE < height && k % TILE_SIZE < width) changed += (counts[k] == num_iterations) != (escalated_counts[k] == num_iterations);
+                counts[k] = escalated_counts[k];
+            }
+            escalated.fetch_add(1u, std::memory_order_relaxed);
+            changed_pixels.fetch_add(changed, std::memory_order_relaxed);
+        }
+        tiles[precision].fetch_add(1u, std::memory_order_relaxed);
+
+        // the rows of the tile in the ascii image
+        for (unsigned int tr = 0u; tr < height; tr++) {
+            char *row = img + (size_t)(r0 + tr)*(cols+1u);
+            for (unsigned int tc = 0u; tc < width; tc++) row[c0 + tc] = counts[tr*TILE_SIZE + tc] == num_iterations ? '#' : '.';
+            if (c0 + width == cols) row[cols] = '\n';
+        }
+
+    });
+
+    if (stats != nullptr) {
+        for (int p = 0; p < MANDELBROT_NUM_PRECISIONS; p++) stats->tiles[p] = tiles[p].load(std::memory_order_relaxed);
+        stats->escalated = escalated.load(std::memory_order_relaxed);
+        stats->changed_pixels = changed_pixels.load(std::memory_order_relaxed);
+    }
+    return true;
+
+}
@@ -0,0 +1,199 @@
+/*
+ * Deep zoom renderer based on perturbation theory.
+ *
+ * Input (stdin): rows cols iterations [centre_r centre_i zoom]
+ * Without the optional extension the default view of mandelbrot.cpp is rendered
+ * (centre -0.5+0i, zoom 1). The centre is given as decimal string of arbitrary length,
+ * e.g. "-0.743643887037158704752191506114774 0.131825904205311970493132056385139 1e25".
+ *
+ * Only the centre pixel is iterated in high precision (the reference orbit Z_n). All other
+ * pixels are iterated as double deltas dz_n against it:
+ *     dz_{n+1} = 2*Z_n*dz_n + dz_n^2 + dc
+ * Once the delta becomes larger than the full value (|Z_n + dz_n| < |dz_n|) the delta lost its
+ * precision relative to the reference ("glitch"). In that case and when the reference orbit escaped
+ * already the pixel gets rebased onto the start of the reference orbit (dz = Z_n + dz_n, n_ref = 0).
+ */
+
+#include <atomic>
+#include <thread>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "fixed.h"
+#include "../common/topology.h"
+
+
+// TYPEDEFS
+#define CENTRE_STRING_SIZE 1024u
+#define PRECISION_GUARD_BITS 32u
+
+struct deepzoom_globals_t {
+    uint32_t num_threads;
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t num_iterations;
+    double zoom;
+    uint32_t ref_length;    // amount of valid elements in ref_r/ref_i
+    double *ref_r;          // real part of the reference orbit
+    double *ref_i;          // imaginative part of the reference orbit
+    char *img;
+    std::atomic<uint32_t> next_row;
+};
+
+
+// GLOBALS
+deepzoom_globals_t g;
+
+// FUNCTIONS
+
+template<uint32_t LIMBS>
+bool calculate_reference( const char *centre_r_string, const char *centre_i_string )
+{
+
+    fixed_t<LIMBS> c_r, c_i;
+    if (!fixed_t<LIMBS>::parse(centre_r_string, c_r) || !fixed_t<LIMBS>::parse(centre_i_string, c_i)) return false;
+    fprintf(stderr, "Calculating reference orbit with %u bits of precision\n", fixed_t<LIMBS>::precision_bits());
+
+    // same iteration as for every pixel but in full precision. The orbit is stored until it escapes
+    fixed_t<LIMBS> z_r, z_i, z_r_sqr, z_i_sqr;
+    g.ref_r[0u] = 0.0;
+    g.ref_i[0u] = 0.0;
+    for (g.ref_length = 1u; g.ref_length < g.num_iterations; g.ref_length++) {
+        z_r_sqr = z_r*z_r;
+        z_i_sqr = z_i*z_i;
+        z_i = (z_r+z_r)*z_i + c_i;
+        z_r = z_r_sqr - z_i_sqr + c_r;
+        g.ref_r[g.ref_length] = z_r.to_double();
+        g.ref_i[g.ref_length] = z_i.to_double();
+        if (g.ref_r[g.ref_length]*g.ref_r[g.ref_length] + g.ref_i[g.ref_length]*g.ref_i[g.ref_length] >= 4.0) {
+            g.ref_length++;
+            break;
+        }
+    }
+
+    fprintf(stderr, "Reference orbit has %u elements\n", g.ref_length);
+    return true;
+
+}
+
+uint32_t iterate_pixel( const double dc_r, const double dc_i )
+{
+
+    uint32_t n = 0u;    // iteration of the pixel
+    uint32_t m = 0u;    // position in the reference orbit
+    double dz_r = 0.0, dz_i = 0.0;
+    double z_r, z_i, z_sqr, tmp;
+
+    while (true) {
+
+        // full value of the pixel
+        z_r = g.ref_r[m] + dz_r;
+        z_i = g.ref_i[m] + dz_i;
+        z_sqr = z_r*z_r + z_i*z_i;
+        if (z_sqr >= 4.0 || ++n >= g.num_iterations) break;
+
+        // glitch detection and rebasing
+        if (z_sqr < dz_r*dz_r + dz_i*dz_i || m == g.ref_length-1u) {
+            dz_r = z_r;
+            dz_i = z_i;
+            m = 0u;
+        }
+
+        // perturbation step
+        tmp = 2.0*(g.ref_r[m]*dz_r - g.ref_i[m]*dz_i) + dz_r*dz_r - dz_i*dz_i + dc_r;
+        dz_i = 2.0*(g.ref_r[m]*dz_i + g.ref_i[m]*dz_r + dz_r*dz_i) + dc_i;
+        dz_r = tmp;
+        m++;
+
+    }
+
+    return n;
+
+}
+
+void work()
+{
+
+    uint32_t r, c;
+    char *row;
+    double dc_i;
+
+    while ((r = g.next_row++) < g.rows) {
+        row = g.img + r*(g.cols+1u);
+        dc_i = (r * 2.0 / g.rows - 1.0) / g.zoom;
+        for (c = 0u; c < g.cols; c++) row[c] = iterate_pixel((c * 2.0 / g.cols - 1.0) / g.zoom, dc_i) == g.num_iterations ? '#' : '.';
+        row[g.cols] = '\n';
+    }
+
+}
+
+int main() {
+
+    // get amount of cores
+    g.num_threads = system_topology().threads(THREADS_ALL_CPUS);
+    fprintf(stderr, "Working with %u threads\n", g.num_threads);
+
+    // read parameters
+    (void)! scanf("%u", &g.rows);
+    (void)! scanf("%u", &g.cols);
+    (void)! scanf("%u", &g.num_iterations);
+    if (g.num_iterations == 0u) g.num_iterations = 1u;
+
+    // optional centre/zoom extension
+    static char centre_r[CENTRE_STRING_SIZE] = "-0.5";
+    static char centre_i[CENTRE_STRING_SIZE] = "0";
+    char zoom[64] = "1";
+    const int num_extension = scanf("%1023s %1023s %63s", centre_r, centre_i, zoom);
+    if (num_extension == 1 || num_extension == 2) {
+        fprintf(stderr, "Expected centre_r centre_i zoom after the iterations!\n");
+        return 1;
+    }
+    g.zoom = strtod(zoom, NULL);
+    if (!(g.zoom > 0.0) || g.zoom > 1e290) {
+        fprintf(stderr, "Invalid zoom %s (must be in (0, 1e290])\n", zoom);
+        return 1;
+    }
+    fprintf(stderr, "Rendering %ux%u around (%s, %s) with zoom %g\n", g.rows, g.cols, centre_r, centre_i, g.zoom);
+
+    // the reference orbit needs enough bits to resolve neighbouring pixels
+    g.ref_r = new double[g.num_iterations];
+    g.ref_i = new double[g.num_iterations];
+    const uint32_t required_bits = (uint32_t)fmax(0.0, log2(g.zoom)) + (uint32_t)log2(fmax(g.rows, g.cols) + 1.0) + PRECISION_GUARD_BITS;
+    bool valid;
+    if (required_bits <= fixed_t<4>::precision_bits()) valid = calculate_reference<4>(centre_r, centre_i);
+    else if (required_bits <= fixed_t<8>::precision_bits()) valid = calculate_reference<8>(centre_r, centre_i);
+    else if (required_bits <= fixed_t<16>::precision_bits()) valid = calculate_reference<16>(centre_r, centre_i);
+    else if (required_bits <= fixed_t<32>::precision_bits()) valid = calculate_reference<32>(centre_r, centre_i);
+    else if (required_bits <= fixed_t<34>::precision_bits()) valid = calculate_reference<34>(centre_r, centre_i);
+    else {
+        // 1e290 and 2^32 pixels need 963 + 32 + PRECISION_GUARD_BITS bits, which 34 limbs have
+        fprintf(stderr, "The zoom %s needs %u bits of precision, at most %u are supported\n", zoom, required_bits, fixed_t<34>::precision_bits());
+        return 1;
+    }
+    if (!valid) {
+        fprintf(stderr, "Invalid centre (%s, %s)\n", centre_r, centre_i);
+        return 1;
+    }
+
+    // create image and let the threads take rows
+    g.img = new char[(size_t)g.rows*(g.cols+1u)];
+    g.next_row = 0u;
+    auto threads = new std::thread[g.num_threads-1u];
+    for (uint32_t i = 0u; i < g.num_threads-1u; i++) threads[i] = std::thread(work);
+    work();
+    for (uint32_t i = 0u; i < g.num_threads-1u; i++) threads[i].join();
+
+    // write result
+    fwrite(g.img, 1, (size_t)g.rows*(g.cols+1u), stdout);
+
+    // cleanup
+    delete[] g.img;
+    delete[] g.ref_r;
+    delete[] g.ref_i;
+    delete[] threads;
+    return 0;
+
+}
@@ -1,30 +1,41 @@
 #define _GNU_SOURCE
 
+#include <errno.h>
 #include <math.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
-#include <sched.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 
 // TYPEDEFS
+#define CACHELINE_SIZE 64lu
+#define ROWS_PER_CHUNK 1u
+
 typedef unsigned int uint;
 typedef unsigned char byte;
 
+// lives at the beginning of the shared mapping, the image follows on the next cacheline
+typedef struct {
+    _Alignas(CACHELINE_SIZE) atomic_uint next_row;
+    byte padding_back[CACHELINE_SIZE-sizeof(atomic_uint)];
+} shared_state_t;
+
 typedef struct {
     byte padding_front[64];
-    ushort rows;
-    ushort cols;
+    uint rows;
+    uint cols;
     float rows_f;
     float cols_f;
-    ushort num_iterations;
-    char *img_part;
-    uint p_begin;
-    uint p_end;
-    uint _p;
-    ushort _n;
-    ushort _row;
-    ushort _col;
+    uint num_iterations;
+    shared_state_t *state;
+    char *img;
+    uint _row;
+    uint _row_end;
+    uint _col;
+    uint _n;
     float _i_iterator;
     float _r_iterator;
     float _z_r;
@@ -33,66 +44,123 @@ typedef struct {
     byte padding_back[64];
 } mandelbrot_params_t;
 
-int main( int arc, char *argv[] ) {
+// FUNCTIONS
 
-    mandelbrot_params_t params;
+void work( mandelbrot_params_t *params )
+{
 
-    // read stdin
-    (void)! scanf("%hu", &params.rows);
-    (void)! scanf("%hu", &params.cols);
-    (void)! scanf("%hu", &params.num_iterations);
-    params.rows_f = params.rows;
-    params.cols_f = params.cols;
+    char *row_ptr;
+
+    // take chunks of rows until the image is done
+    while ((params->_row = atomic_fetch_add(&params->state->next_row, ROWS_PER_CHUNK)) < params->rows) {
 
-    u_char worker_id = strtoul(argv[1], NULL, 10);
-    u_char num_workers = strtoul(argv[2], NULL, 10);
+        params->_row_end = params->_row + ROWS_PER_CHUNK;
+        if (params->_row_end > params->rows) params->_row_end = params->rows;
 
-    params.p_begin = worker_id*params.rows*params.cols/num_workers;
-    params.p_end = (worker_id+1)*params.rows*params.cols/num_workers;
+        for (; params->_row < params->_row_end; params->_row++) {
 
-    params._row = params.p_begin / params.cols;
-    params._col = params.p_begin % params.cols;
+            row_ptr = params->img + params->_row*(params->cols+1u);
+            params->_i_iterator = params->_row * 2.0f / params->rows_f - 1.0f;
 
-    params.img_part = malloc((params.p_end - params.p_begin + 128u) * sizeof(params.img_part[0]))+64lu; // add 64byte before and after to make sure that no cache miss will happen
-    //memset(params.img_part-64lu, 0, (params.p_end - params.p_begin + 128u) * sizeof(params.img_part[0]));
+            for (params->_col = 0u; params->_col < params->cols; params->_col++) {
 
-    // iterate over all pixel that this thread has to calculate
-    for (params._p = params.p_begin; params._p < params.p_end; params._p++) {
+                // prepare variables for next iteration
+                params->_z_r = 0.0f;
+                params->_z_i = 0.0f;
+                params->_r_iterator = params->_col * 2.0f / params->cols_f - 1.5f;
+
+                // calculate next pixel
+                for (params->_n=0u; params->_n < params->num_iterations; params->_n++) {
+
+                    // square z and add offset
+                    params->_z_r_tmp = 2.0f*params->_z_r;
+                    params->_z_r = params->_z_r*params->_z_r - params->_z_i*params->_z_i + params->_r_iterator;
+                    params->_z_i = params->_z_i * params->_z_r_tmp + params->_i_iterator;
+
+                }
+
+                // set pixel
+                row_ptr[params->_col] = sqrtf(params->_z_r*params->_z_r + params->_z_i*params->_z_i) < 2.0f ? '#' : '.';
+
+            }
+
+            row_ptr[params->cols] = '\n';
 
-        // insert newline on column end
-        if (params._col == params.cols) {
-            fputc('\n', stdout);
-            params._col = 0u;
-            params._row++;
         }
 
-        // prepare variables for next iteration
-        params._z_r = 0.0f;
-        params._z_i = 0.0f;
-        params._r_iterator = params._col * 2.0f / params.cols_f - 1.5f;
-        params._i_iterator = params._row * 2.0f / params.rows_f - 1.0f;
+    }
 
-        // calculate next pixel
-        for (params._n=0u; params._n < params.num_iterations; params._n++) {
+}
+
+int main() {
 
-            // square z and add offset
-            params._z_r_tmp = 2.0f*params._z_r;
-            params._z_r = params._z_r*params._z_r - params._z_i*params._z_i + params._r_iterator;
-            params._z_i = params._z_i * params._z_r_tmp + params._i_iterator;
+    // get amount of worker processes
+    const char *NUM_CORES_STRING = getenv("MAX_CPUS");
+    uint num_workers = NUM_CORES_STRING == NULL ? 1u : strtoul(NUM_CORES_STRING, NULL, 10);
+    if (num_workers == 0u) num_workers = 1u;
+    fprintf(stderr, "Working with %u processes\n", num_workers);
+
+    // read stdin
+    mandelbrot_params_t params;
+    (void)! scanf("%u", &params.rows);
+    (void)! scanf("%u", &params.cols);
+    (void)! scanf("%u", &params.num_iterations);
+    params.rows_f = params.rows;
+    params.cols_f = params.cols;
 
+    // the counter and the image are shared with all workers, each one writes its rows directly
+    const size_t img_size = (size_t)params.rows*(params.cols+1u);
+    void *shared = mmap(NULL, sizeof(shared_state_t) + img_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        fprintf(stderr, "Could not map the shared image: %s\n", strerror(errno));
+        return 1;
+    }
+    params.state = (shared_state_t*) shared;
+    params.img = (char*) shared + sizeof(shared_state_t);
+    atomic_init(&params.state->next_row, 0u);
+
+    // start the workers
+    uint i;
+    pid_t pid;
+    for (i = 0u; i < num_workers; i++) {
+        pid = fork();
+        if (pid < 0) {
+            fprintf(stderr, "Could not fork worker %u: %s\n", i, strerror(errno));
+            break;
+        }
+        if (pid == 0) {
+            work(&params);
+            _exit(0);
         }
+    }
 
-        // set pixel
-        fputc( sqrtf(params._z_r*params._z_r + params._z_i*params._z_i) < 2.0f ? '#' : '.', stdout );
-        params._col++;
+    // the driver takes over if no worker could be started at all
+    if (i == 0u) work(&params);
 
+    // wait for them to finish
+    int status, failed = 0;
+    while ((pid = wait(&status)) > 0) if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed = 1;
+    if (failed) {
+        fprintf(stderr, "A worker did not finish properly!\n");
+        return 1;
     }
 
-    if (params._col == params.cols) fputc('\n', stdout);
+    // print result with a single write
+    const char *ptr = params.img;
+    size_t left = img_size;
+    ssize_t written;
+    while (left > 0u) {
+        written = write(STDOUT_FILENO, ptr, left);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+            fprintf(stderr, "Could not write the result: %s\n", strerror(errno));
+            return 1;
+        }
+        ptr += written;
+        left -= written;
+    }
 
-    // done
+    munmap(shared, sizeof(shared_state_t) + img_size);
     return 0;
 
 }
-
-
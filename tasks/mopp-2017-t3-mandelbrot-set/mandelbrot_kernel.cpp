@@ -0,0 +1,77 @@
+#include "mandelbrot_kernel.h"
+
+#include <algorithm>
+
+#include <string.h>
+
+// FUNCTIONS
+
+size_t mandelbrot_image_size( uint32_t rows, uint32_t cols )
+{
+    return (size_t)rows*(cols+1u);
+}
+
+// same iteration as the workers of mandelbrot.cpp
+static inline char render_pixel( uint32_t r, uint32_t c, uint32_t rows, uint32_t cols, uint32_t num_iterations )
+{
+
+    uint32_t n = 0u;
+    float z_r = 0.0f, z_i = 0.0f, z_r_sqr, z_i_sqr, tmp;
+    const float c_r = c * 2.0f / cols - 1.5f;
+    const float c_i = r * 2.0f / rows - 1.0f;
+
+    while (( (z_r_sqr = (z_r*z_r)) + (z_i_sqr = (z_i*z_i)) ) < 4.0f && ++n < num_iterations) {
+        tmp = z_r;
+        z_r = z_r_sqr - z_i_sqr + c_r;
+        z_i = z_i * 2.0f * tmp  + c_i;
+    }
+    return n == num_iterations ? '#' : '.';
+
+}
+
+static void render_row( uint32_t r, uint32_t rows, uint32_t cols, uint32_t num_iterations, char *row )
+{
+    for (uint32_t c = 0u; c < cols; c++) row[c] = render_pixel(r, c, rows, cols, num_iterations);
+    row[cols] = '\n';
+}
+
+void mandelbrot_render( uint32_t rows, uint32_t cols, uint32_t num_iterations, char *img, thread_pool_t &pool )
+{
+    pool.run(rows, [=]( unsigned int r, unsigned int ) {
+        render_row(r, rows, cols, num_iterations, img + (size_t)r*(cols+1u));
+    });
+}
+
+void mandelbrot_render_progressive( uint32_t rows, uint32_t cols, uint32_t num_iterations, unsigned int num_passes, char *img,
+                                    thread_pool_t &pool, const std::function<void( unsigned int pass, uint32_t step )> &on_pass )
+{
+
+    const size_t stride = cols + 1u;
+    num_passes = std::max(1u, std::min(num_passes, 16u));
+    for (uint32_t r = 0u; r < rows; r++) img[r*stride + cols] = '\n';
+
+    for (unsigned int pass = 0u; pass < num_passes; pass++) {
+
+        // the samples of this pass lie on the grid of the step, the ones on the grid of the step
+        // before (every second row and column) are done already
+        const uint32_t step = 1u << (num_passes - 1u - pass);
+        const uint32_t num_sample_rows = (rows + step - 1u) / step;
+        pool.run(num_sample_rows, [=]( unsigned int k, unsigned int ) {
+            const uint32_t r = k * step;
+            const bool done_row = pass > 0u && r % (2u*step) == 0u;
+            const uint32_t block_rows = std::min(step, rows - r);
+            char *row = img + r*stride;
+            for (uint32_t c = done_row ? step : 0u; c < cols; c += done_row ? 2u*step : step) {
+                // every sample stands for the block to its lower right until that gets refined
+                const char pixel = render_pixel(r, c, rows, cols, num_iterations);
+                const uint32_t block_cols = std::min(step, cols - c);
+                for (uint32_t b = 0u; b < block_rows; b++) memset(row + b*stride + c, pixel, block_cols);
+            }
+        });
+
+        TRACE_INSTANT("pass", pass);
+        on_pass(pass, step);
+
+    }
+
+}
@@ -0,0 +1,85 @@
+#ifndef __HEADER_MANDELBROT_KERNEL__
+#define __HEADER_MANDELBROT_KERNEL__
+
+#include "../common/thread_pool.h"
+
+#include <functional>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The renderer as library (mandelbrot_kernel.cpp). Same pixels as mandelbrot.cpp, but every row
+ * is a unit of work for a thread pool of the caller instead of the feeder/collector pipeline.
+ */
+
+// TYPEDEFS
+
+enum mandelbrot_precision_t {
+    MANDELBROT_FLOAT,
+    MANDELBROT_DOUBLE,
+    MANDELBROT_DOUBLE_DOUBLE,
+    MANDELBROT_NUM_PRECISIONS
+};
+
+/**
+ * @brief The part of the complex plane to render: c = centre + (-1..1)/zoom in both directions,
+ * the centre as double-double (hi, lo). The default view is the one of mandelbrot.cpp
+ */
+struct mandelbrot_view_t {
+    double centre_r[2] = { -0.5, 0.0 };
+    double centre_i[2] = { 0.0, 0.0 };
+    double zoom = 1.0;
+};
+
+struct mandelbrot_precision_stats_t {
+    uint64_t tiles[MANDELBROT_NUM_PRECISIONS];  // tiles that got rendered in the precision in the end
+    uint64_t escalated;                         // renders again because of diverging counts
+    uint64_t changed_pixels;                    // pixels that changed between inside and outside by that
+};
+
+// FUNCTIONS
+
+/**
+ * @brief Size of the ascii image: rows lines of cols pixels and a newline
+ */
+size_t mandelbrot_image_size( uint32_t rows, uint32_t cols );
+
+/**
+ * @brief Renders the ascii image ('#' inside, '.' outside) into img (mandelbrot_image_size() bytes)
+ */
+void mandelbrot_render( uint32_t rows, uint32_t cols, uint32_t num_iterations, char *img, thread_pool_t &pool );
+
+/**
+ * @brief Renders the ascii image in num_passes passes from coarse to fine: the first pass calculates
+ * every 2^(num_passes-1)th pixel of every 2^(num_passes-1)th row, every pass after it the pixels
+ * that halve the step, so every pixel gets calculated once. Until then a pixel shows the sample to
+ * its upper left. After the last pass img is the same as after mandelbrot_render()
+ * @param on_pass Called on the calling thread after every pass, img is complete while it runs
+ */
+void mandelbrot_render_progressive( uint32_t rows, uint32_t cols, uint32_t num_iterations, unsigned int num_passes, char *img,
+                                    thread_pool_t &pool, const std::function<void( unsigned int pass, uint32_t step )> &on_pass );
+
+/**
+ * @brief Parses the centre (decimal strings of any length) and zoom of a view
+ * @return false if a number is invalid or the zoom not in (0, 1e300)
+ */
+bool mandelbrot_parse_view( const char *centre_r, const char *centre_i, const char *zoom, mandelbrot_view_t &view );
+
+/**
+ * @brief Whether double-double can still tell the neighbouring pixels of the view apart, deeper
+ * zooms (beyond ~1e27 for 1000 pixels) need the perturbation of the deep zoom renderer
+ */
+bool mandelbrot_view_resolvable( uint32_t rows, uint32_t cols, const mandelbrot_view_t &view );
+
+/**
+ * @brief Renders the ascii image of a view with the precision chosen per tile of 16x16 pixels
+ * (mandelbrot_adaptive.cpp): float where it is enough, double or double-double where the pixels
+ * cannot be told apart or the escape counts of neighbours diverge
+ * @param stats nullptr or where to store how many tiles needed which precision
+ * @return false if the view is not resolvable (mandelbrot_view_resolvable()), nothing is rendered then
+ */
+bool mandelbrot_render_adaptive( uint32_t rows, uint32_t cols, uint32_t num_iterations, const mandelbrot_view_t &view, char *img,
+                                 thread_pool_t &pool, mandelbrot_precision_stats_t *stats = nullptr );
+
+#endif
@@ -38,14 +38,14 @@ unsigned long NUM_CORES;
 pthread_mutex_t current_row_mutex;
 
 #ifdef MEASURE_TIMING
-clock_t ts_begin;
-clock_t ts_calculation;
+int64_t ts_begin;
+int64_t ts_calculation;
 
-clock_t time_full;
-clock_t time_preparation;
-clock_t time_calculation;
+int64_t time_full;
+int64_t time_preparation;
+int64_t time_calculation;
 
-clock_t *time_threads;
+int64_t *time_threads;
 #endif
 
 // FUNCTIONS
@@ -105,7 +105,7 @@ void *work( void *params_uncasted )
     }
 
     #ifdef MEASURE_TIMING
-    time_threads[params->thread_number] = get_timestamp(ts_begin_thread);
+    time_threads[params->thread_number] = get_timediff(ts_begin_thread);
     #endif
 
     return NULL;
@@ -130,9 +130,9 @@ int main() {
     (void)! scanf("%u", &max_iterations);
 
     #ifdef MEASURE_TIMING
-    time_preparation = get_timestamp(ts_begin);
+    time_preparation = get_timediff(ts_begin);
     ts_calculation = get_timestamp();
-    time_threads = new clock_t[NUM_CORES];
+    time_threads = new int64_t[NUM_CORES];
     #endif
 
     // calculate mandelbrot set
@@ -159,15 +159,15 @@ int main() {
     }
 
     #ifdef MEASURE_TIMING
-    time_calculation = get_timestamp(ts_calculation);
+    time_calculation = get_timediff(ts_calculation);
     ts_calculation = get_timestamp();
-    time_full = get_timestamp(ts_begin);
+    time_full = get_timediff(ts_begin);
 
-    fprintf(stderr, "Time full: %.3fms\n", time_full/1.0e4);
-    fprintf(stderr, "Time preparation: %.3fms (%.2f%%)\n", time_preparation/1.0e4, time_preparation*100.0/time_full);
-    fprintf(stderr, "Time mandelbrot: %.3fms (%.2f%%)\n", time_calculation/1.0e4, time_calculation*100.0/time_full);
+    fprintf(stderr, "Time full: %.3fms\n", time_full/1.0e6);
+    fprintf(stderr, "Time preparation: %.3fms (%.2f%%)\n", time_preparation/1.0e6, time_preparation*100.0/time_full);
+    fprintf(stderr, "Time mandelbrot: %.3fms (%.2f%%)\n", time_calculation/1.0e6, time_calculation*100.0/time_full);
 
-    for (uint i = 0u; i < NUM_CORES; i++) fprintf(stderr, "Time thread %u: %.3fms\n", i, time_threads[i]/1.0e4);
+    for (uint i = 0u; i < NUM_CORES; i++) fprintf(stderr, "Time thread %u: %.3fms\n", i, time_threads[i]/1.0e6);
     #endif
 
     return 0;
@@ -0,0 +1,103 @@
+#include <chrono>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mandelbrot_kernel.h"
+
+/*
+ * Thin command line wrapper around the library renderer (mandelbrot_kernel.h)
+ *
+ * With ADAPTIVE_PRECISION (make adaptive) the precision is chosen per tile and the input may
+ * be extended by a view like for the deep zoom: rows cols iterations [centre_r centre_i zoom]
+ *
+ * With PROGRESSIVE_PASSES (make progressive) the image is rendered from coarse to fine and every
+ * pass is written to stdout as a full frame as soon as it is done, the last frame is the image
+ */
+
+// FUNCTIONS
+
+static bool write_all( const char *ptr, size_t left )
+{
+    ssize_t written;
+    while (left > 0u) {
+        written = write(STDOUT_FILENO, ptr, left);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        ptr += written;
+        left -= written;
+    }
+    return true;
+}
+
+int main() {
+
+    // get amount of cores
+    const topology_t &topology = system_topology();
+    const unsigned int num_threads = topology.threads(THREADS_ALL_CPUS);
+    const std::vector<int> cpus = topology.thread_cpus(num_threads);
+    pin_thread(cpus[0]);
+    fprintf(stderr, "Working with %u threads\n", num_threads);
+
+    // read stdin
+    uint32_t rows, cols, num_iterations;
+    (void)! scanf("%u", &rows);
+    (void)! scanf("%u", &cols);
+    (void)! scanf("%u", &num_iterations);
+
+    #ifdef ADAPTIVE_PRECISION
+        static char centre_r[1024] = "-0.5", centre_i[1024] = "0";
+        char zoom[64] = "1";
+        const int num_extension = scanf("%1023s %1023s %63s", centre_r, centre_i, zoom);
+        mandelbrot_view_t view;
+        if (num_extension == 1 || num_extension == 2 || !mandelbrot_parse_view(centre_r, centre_i, zoom, view)) {
+            fprintf(stderr, "Expected a valid centre_r centre_i zoom after the iterations!\n");
+            return 1;
+        }
+        if (!mandelbrot_view_resolvable(rows, cols, view)) {
+            fprintf(stderr, "The zoom %g is too deep for double-double at %u x %u pixels, use the deep zoom renderer!\n", view.zoom, rows, cols);
+            return 1;
+        }
+    #endif
+
+    thread_pool_t pool(num_threads, cpus);
+    const size_t img_size = mandelbrot_image_size(rows, cols);
+    char *img = new char[img_size];
+    #ifdef ADAPTIVE_PRECISION
+        mandelbrot_precision_stats_t stats;
+        mandelbrot_render_adaptive(rows, cols, num_iterations, view, img, pool, &stats);
+        fprintf(stderr, "Tiles in float: %lu, double: %lu, double-double: %lu (%lu escalated for diverging counts, %lu pixels changed)\n",
+            (unsigned long)stats.tiles[MANDELBROT_FLOAT], (unsigned long)stats.tiles[MANDELBROT_DOUBLE], (unsigned long)stats.tiles[MANDELBROT_DOUBLE_DOUBLE],
+            (unsigned long)stats.escalated, (unsigned long)stats.changed_pixels);
+    #elif defined(PROGRESSIVE_PASSES)
+        const auto ts_begin = std::chrono::steady_clock::now();
+        bool success = true;
+        mandelbrot_render_progressive(rows, cols, num_iterations, PROGRESSIVE_PASSES, img, pool, [&]( unsigned int pass, uint32_t step ) {
+            const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - ts_begin).count();
+            fprintf(stderr, "Pass %u (every %u. pixel) done after %.3fms\n", pass, step, ms);
+            TRACE_SCOPE("write frame", pass);
+            if (success && !write_all(img, img_size)) {
+                fprintf(stderr, "Could not write the frame: %s\n", strerror(errno));
+                success = false;
+            }
+        });
+        delete[] img;
+        return success ? 0 : 1;
+    #else
+        mandelbrot_render(rows, cols, num_iterations, img, pool);
+    #endif
+
+    // print result with a single write
+    TRACE_SCOPE("write output", img_size);
+    if (!write_all(img, img_size)) {
+        fprintf(stderr, "Could not write the result: %s\n", strerror(errno));
+        return 1;
+    }
+
+    delete[] img;
+    return 0;
+
+}
@@ -0,0 +1,225 @@
+#ifndef __HEADER_OUTPUT__
+#define __HEADER_OUTPUT__
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// TYPEDEFS
+#define RLE_ROW_BATCH 64u // rows that get encoded/written by a thread at once
+
+enum output_format_t : uint8_t {
+    OUTPUT_ASCII,   // one '#' or '.' per pixel, newline after each row (default)
+    OUTPUT_PBM,     // binary portable bitmap (P4), 1 bit per pixel and '#' is black
+    OUTPUT_RLE,     // "<rows> <cols>" header, then every row as runs "<length><'#'|'.'>" and a newline
+    OUTPUT_PGM,     // binary greymap (P5) of the histogram equalised escape counts, see counts.h
+    OUTPUT_PPM      // binary pixmap (P6) of the histogram equalised escape counts, see counts.h
+};
+
+struct packed_image_t {
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t row_bytes;     // bytes per row, rows are padded to full bytes like in PBM
+    uint8_t *bits;          // MSB first, set bit means '#'
+};
+
+// FUNCTIONS
+
+/**
+ * @brief Reads the output format from the environment variable OUTPUT_FORMAT (ascii, pbm, rle, pgm or ppm)
+ * @return The output format, ascii if the variable is not set
+ */
+output_format_t get_output_format()
+{
+    const char *format = getenv("OUTPUT_FORMAT");
+    if (format == NULL || strcmp(format, "ascii") == 0) return OUTPUT_ASCII;
+    if (strcmp(format, "pbm") == 0) return OUTPUT_PBM;
+    if (strcmp(format, "rle") == 0) return OUTPUT_RLE;
+    if (strcmp(format, "pgm") == 0) return OUTPUT_PGM;
+    if (strcmp(format, "ppm") == 0) return OUTPUT_PPM;
+    fprintf(stderr, "Unknown OUTPUT_FORMAT \"%s\", falling back to ascii\n", format);
+    return OUTPUT_ASCII;
+}
+
+void packed_image_init( packed_image_t &img, uint32_t rows, uint32_t cols )
+{
+    img.rows = rows;
+    img.cols = cols;
+    img.row_bytes = (cols + 7u) / 8u;
+    img.bits = new uint8_t[(size_t)rows*img.row_bytes]();
+}
+
+inline void packed_image_set( packed_image_t &img, uint32_t r, uint32_t c )
+{
+    img.bits[(size_t)r*img.row_bytes + c/8u] |= 0x80u >> (c%8u);
+}
+
+inline bool packed_image_get( const packed_image_t &img, uint32_t r, uint32_t c )
+{
+    return img.bits[(size_t)r*img.row_bytes + c/8u] & (0x80u >> (c%8u));
+}
+
+/**
+ * @brief Writes the whole buffer, retrying on partial writes
+ * @return false if writing failed
+ */
+bool write_all( int fd, const void *buffer, size_t size )
+{
+    auto ptr = (const char*)buffer;
+    ssize_t written;
+    while (size > 0u) {
+        written = write(fd, ptr, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        ptr += written;
+        size -= written;
+    }
+    return true;
+}
+
+/**
+ * @brief Same as write_all() but at an absolute file offset
+ * @return false if writing failed (e.g. with ESPIPE if fd is a pipe)
+ */
+bool pwrite_all( int fd, const void *buffer, size_t size, off_t offset )
+{
+    auto ptr = (const char*)buffer;
+    ssize_t written;
+    while (size > 0u) {
+        written = pwrite(fd, ptr, size, offset);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        ptr += written;
+        offset += written;
+        size -= written;
+    }
+    return true;
+}
+
+/**
+ * @brief Encodes one row as runs of equal pixels
+ * @param out The buffer to write into, can be nullptr to only count the bytes
+ * @return The amount of bytes the encoded row takes (including the newline)
+ */
+size_t rle_encode_row( const packed_image_t &img, uint32_t r, char *out )
+{
+
+    const uint8_t *row = img.bits + (size_t)r*img.row_bytes;
+    char number[16];
+    size_t size = 0u, number_size;
+    uint32_t c = 0u, run;
+    bool value;
+
+    while (c < img.cols) {
+
+        // measure the run, whole bytes of equal pixels are skipped at once
+        value = row[c/8u] & (0x80u >> (c%8u));
+        run = c;
+        while (c < img.cols) {
+            if (c%8u == 0u && c+8u <= img.cols && row[c/8u] == (value ? 0xFFu : 0x00u)) c += 8u;
+            else if ((bool)(row[c/8u] & (0x80u >> (c%8u))) == value) c++;
+            else break;
+        }
+        run = c - run;
+
+        number_size = snprintf(number, sizeof(number), "%u", run);
+        if (out != nullptr) {
+            memcpy(out+size, number, number_size);
+            out[size+number_size] = value ? '#' : '.';
+        }
+        size += number_size + 1u;
+
+    }
+
+    if (out != nullptr) out[size] = '\n';
+    return size + 1u;
+
+}
+
+/**
+ * @brief Writes the image as PBM or RLE to fd. Rows get written in parallel with pwrite() at
+ * their precalculated offsets. If fd is not seekable (e.g. a pipe) it is written sequentially
+ * @return false if writing failed
+ */
+bool write_packed( int fd, const packed_image_t &img, output_format_t format, uint32_t num_threads )
+{
+
+    std::string header = format == OUTPUT_PBM
+        ? "P4\n" + std::to_string(img.cols) + " " + std::to_string(img.rows) + "\n"
+        : std::to_string(img.rows) + " " + std::to_string(img.cols) + "\n";
+    const off_t base = lseek(fd, 0, SEEK_CUR);
+    const bool seekable = base >= 0 && !(fcntl(fd, F_GETFL) & O_APPEND); // pwrite() ignores the offset with O_APPEND
+
+    // pipes get everything in order from a single thread
+    if (!seekable || num_threads <= 1u) {
+        if (!write_all(fd, header.data(), header.size())) return false;
+        if (format == OUTPUT_PBM) return write_all(fd, img.bits, (size_t)img.rows*img.row_bytes);
+        std::string buffer;
+        for (uint32_t r = 0u; r < img.rows; r++) {
+            const size_t offset = buffer.size();
+            buffer.resize(offset + rle_encode_row(img, r, nullptr));
+            rle_encode_row(img, r, &buffer[offset]);
+            if (buffer.size() >= (1u << 20) || r == img.rows-1u) {
+                if (!write_all(fd, buffer.data(), buffer.size())) return false;
+                buffer.clear();
+            }
+        }
+        return true;
+    }
+
+    // calculate the offset of every row (PBM rows have a fixed size)
+    auto offsets = new off_t[(size_t)img.rows+1u];
+    offsets[0u] = base + header.size();
+    if (format == OUTPUT_PBM) {
+        for (uint32_t r = 0u; r < img.rows; r++) offsets[r+1u] = offsets[r] + img.row_bytes;
+    } else {
+        std::atomic<uint32_t> next_row(0u);
+        auto count = [&]() {
+            uint32_t r;
+            while ((r = next_row++) < img.rows) offsets[r+1u] = rle_encode_row(img, r, nullptr);
+        };
+        auto threads = new std::thread[num_threads];
+        for (uint32_t i = 0u; i < num_threads; i++) threads[i] = std::thread(count);
+        for (uint32_t i = 0u; i < num_threads; i++) threads[i].join();
+        delete[] threads;
+        for (uint32_t r = 0u; r < img.rows; r++) offsets[r+1u] += offsets[r];
+    }
+
+    // let every thread write batches of rows
+    std::atomic<uint32_t> next_batch(0u);
+    std::atomic<bool> success(pwrite_all(fd, header.data(), header.size(), base));
+    auto write_rows = [&]() {
+        std::string buffer;
+        uint32_t r_begin, r_end;
+        while (success && (r_begin = (next_batch++) * RLE_ROW_BATCH) < img.rows) {
+            r_end = std::min(r_begin + RLE_ROW_BATCH, img.rows);
+            if (format == OUTPUT_PBM) {
+                if (!pwrite_all(fd, img.bits + (size_t)r_begin*img.row_bytes, (size_t)(r_end-r_begin)*img.row_bytes, offsets[r_begin])) success = false;
+                continue;
+            }
+            buffer.resize(offsets[r_end] - offsets[r_begin]);
+            for (uint32_t r = r_begin; r < r_end; r++) rle_encode_row(img, r, &buffer[offsets[r] - offsets[r_begin]]);
+            if (!pwrite_all(fd, buffer.data(), buffer.size(), offsets[r_begin])) success = false;
+        }
+    };
+    auto threads = new std::thread[num_threads];
+    for (uint32_t i = 0u; i < num_threads; i++) threads[i] = std::thread(write_rows);
+    for (uint32_t i = 0u; i < num_threads; i++) threads[i].join();
+    delete[] threads;
+
+    // pwrite() does not move the file offset
+    lseek(fd, offsets[img.rows], SEEK_SET);
+    delete[] offsets;
+    return success;
+
+}
+
+#endif
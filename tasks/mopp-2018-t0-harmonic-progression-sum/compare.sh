@@ -0,0 +1,20 @@
+#!/bin/bash
+# compares the limb engine with the digit engine
+set -e;
+make clean
+make digits
+mv harmonic-progression-sum harmonic-progression-sum-digits
+make clean
+make
+
+failed=0
+for input in "1 1" "5 7" "20 1000" "26 3" "100 12345" "300 5000" "17 99999" "8 1000000"
+do
+    expected=$(echo $input | ./harmonic-progression-sum-digits 2>/dev/null)
+    result=$(echo $input | ./harmonic-progression-sum 2>/dev/null)
+    if [ "$expected" != "$result" ]; then echo "Incorrect result for \"$input\"!"; failed=1; fi
+done
+
+rm -f harmonic-progression-sum-digits
+if [ $failed -eq 0 ]; then echo "All results correct!"; fi
+exit $failed
@@ -0,0 +1,66 @@
+#ifndef __HEADER_DIVIDER__
+#define __HEADER_DIVIDER__
+
+#include <stdint.h>
+
+typedef unsigned __int128 uint128_t;
+
+/*
+ * Division of a 128bit numerator by an invariant 64bit divisor with a precomputed reciprocal
+ * (N. Möller, T. Granlund: "Improved division by invariant integers", 2011). One division
+ * costs two multiplications and some additions instead of a (very slow) 128bit division.
+ */
+struct divider_t {
+    uint64_t d;         // divisor shifted so that its highest bit is set
+    uint64_t v;         // floor((2^128-1) / d) - 2^64
+    uint32_t shift;     // amount of bits the divisor got shifted
+};
+
+/**
+ * @brief Precomputes the reciprocal of the given divisor
+ * @param divisor The divisor, must not be 0
+ */
+inline divider_t divider_init( uint64_t divisor )
+{
+    divider_t div;
+    div.shift = __builtin_clzll(divisor);
+    div.d = divisor << div.shift;
+    div.v = (uint64_t)((((uint128_t)~div.d) << 64 | ~(uint64_t)0u) / div.d);
+    return div;
+}
+
+/**
+ * @brief Divides u by the divisor
+ * @param div The precomputed divisor
+ * @param u The numerator, must be smaller than divisor*2^(64-shift) so the quotient fits in 64bit
+ * @param remainder The remainder of the division
+ * @return The quotient
+ */
+inline uint64_t divider_divide( const divider_t &div, uint128_t u, uint64_t &remainder )
+{
+
+    // normalize the numerator the same way as the divisor
+    u <<= div.shift;
+    const uint64_t u1 = (uint64_t)(u >> 64);
+    const uint64_t u0 = (uint64_t)u;
+
+    // estimate the quotient with the reciprocal, it is off by at most one in each direction
+    const uint128_t q = (uint128_t)div.v * u1 + u;
+    uint64_t q1 = (uint64_t)(q >> 64) + 1u;
+    const uint64_t q0 = (uint64_t)q;
+    uint64_t r = u0 - q1*div.d;
+    if (r > q0) {
+        q1--;
+        r += div.d;
+    }
+    if (r >= div.d) {
+        q1++;
+        r -= div.d;
+    }
+
+    remainder = r >> div.shift;
+    return q1;
+
+}
+
+#endif
@@ -1,77 +1,35 @@
 #include <iostream>
-#include <sstream>
+#include <vector>
 #include <assert.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <pthread.h>
-#include <sys/sysinfo.h>
+#include <string.h>
+#include <unistd.h>
 
-using namespace std;
-
-struct thread_work_t{
-    long unsigned d;
-    long unsigned start_n;
-    long unsigned end_n;
-    long unsigned int *digits;
-};
-
-void *sum(void *thread_work_uncasted) {
-    struct thread_work_t *thread_work = (struct thread_work_t*)thread_work_uncasted;
-    const long unsigned int d = thread_work->d;
-    const long unsigned int start_n = thread_work->start_n;
-    const long unsigned int end_n = thread_work->end_n;
-    long unsigned int *digits = thread_work->digits;
+#include "harmonic_kernel.h"
 
-    // intermediate value
-    for (long unsigned int digit = 0; digit < d + 11; ++digit) {
-        digits[digit] = 0;
-    }
-    // main loop, calculate for each i the value of 1/i to a precesion of d
-    for (long unsigned int i = start_n; i <= end_n; ++i) {
-        long unsigned int remainder = 1;
-        for (long unsigned int digit = 0; digit < d + 11 && remainder; ++digit) {
-            long unsigned int div = remainder / i;
-            long unsigned int mod = remainder % i;
-            digits[digit] += div;
-            remainder = mod * 10;
-        }
-    }
-}
+using namespace std;
 
-void generate_output(long unsigned int *digits, int d, char* output) {
-    // move values bigger than 10 up
-    for (long unsigned int i = d + 11 - 1; i > 0; --i) {
-        digits[i - 1] += digits[i] / 10;
-        digits[i] %= 10;
-    }
-    // round last digit
-    if (digits[d + 1] >= 5) {
-        ++digits[d];
-    }
-    // move values bigger than 10 up
-    for (long unsigned int i = d; i > 0; --i) {
-        digits[i - 1] += digits[i] / 10;
-        digits[i] %= 10;
+// writes the whole buffer, returns false on errors
+bool write_all(int fd, const char *buffer, long unsigned int size) {
+    while (size > 0) {
+        const ssize_t written = write(fd, buffer, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        buffer += written;
+        size -= written;
     }
-    // print result into output
-    stringstream stringstreamA;
-    stringstreamA << digits[0] << ".";
-    for (long unsigned int i = 1; i <= d; ++i) {
-        stringstreamA << digits[i];
-    }
-    stringstreamA << '\0';
-    string stringA = stringstreamA.str();
-    stringA.copy(output, stringA.size());
+    return true;
 }
 
 int main() {
-    // Determine the amount of available CPUs
-    int cpus = get_nprocs();
-    // nprocs() might return wrong amount inside of a container.
-    // Use MAX_CPUS instead, if available.
-    if (getenv("MAX_CPUS")) {
-        cpus = atoi(getenv("MAX_CPUS"));
-    }
+    // Determine the amount of available CPUs: MAX_CPUS if set, else the CPUs the container
+    // grants (cpuset and quota), get_nprocs() would count all CPUs of the host
+    const topology_t &topology = system_topology();
+    int cpus = topology.threads(THREADS_ALL_CPUS);
+    const vector<int> cpu_plan = topology.thread_cpus(cpus);
+    pin_thread(cpu_plan[0]);
     // Sanity-check
     assert(cpus > 0 && cpus <= 64);
     fprintf(stderr, "Running on %d CPUs\n", cpus);
@@ -79,46 +37,24 @@ int main() {
     long unsigned int d = 1, n = 1;
 
     // read input
+    TRACE_SPAN_BEGIN(ts_input);
     cin >> d >> n;
+    TRACE_SPAN_END(ts_input, "read input", 0);
+    fprintf(stderr, "Summing up %ld terms\n", n);
 
-    long unsigned int digits[cpus][d+11];
-    struct thread_work_t tw[cpus];
-    pthread_t thread[cpus];
-
-    for (int i=0; i < cpus; i++) {
-        tw[i].digits  = digits[i];
-        tw[i].start_n = (n/cpus)* i    + 1;
-        tw[i].end_n   = (n/cpus)*(i+1);
-        tw[i].d       = d;
+    thread_pool_t pool(cpus, cpu_plan);
+    char *output = new char[harmonic_output_size(d)];
+    long unsigned int length = harmonic_sum(d, n, output, pool);
 
-        fprintf(stderr, "Starting thread %d from %ld to %ld\n", i, tw[i].start_n, tw[i].end_n);
-    
-        pthread_create(&thread[i], NULL, sum, (void*)&tw[i]);
+    // print result with a single write
+    output[length++] = '\n';
+    TRACE_SPAN_BEGIN(ts_output);
+    if (!write_all(STDOUT_FILENO, output, length)) {
+        fprintf(stderr, "Could not write the result: %s\n", strerror(errno));
+        return 1;
     }
+    TRACE_SPAN_END(ts_output, "write output", length);
 
-    // main thread takes care of the leftover
-    struct thread_work_t maintw;
-    long unsigned int mdigits[d+11] = {0};
-    maintw.digits  = mdigits;
-    maintw.start_n = (n/cpus) * cpus + 1;
-    maintw.end_n   = n;
-    maintw.d       = d;
-
-    sum((void*)&maintw);
-
-    for (int i=0; i<cpus; i++) {
-        // wait for all threads
-        pthread_join(thread[i], NULL);
-        for (int j=0; j<=d+11; j++) {
-            mdigits[j] += tw[i].digits[j];
-        }
-    }
-
-    // allocate output buffer
-    char output[d + 10]; // extra precision due to possible error
-    generate_output(mdigits, d, output);
-
-    cout << output << endl;
-
+    delete[] output;
     return 0;
 }
@@ -0,0 +1,326 @@
+#include <algorithm>
+#include <atomic>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "harmonic_kernel.h"
+#include "divider.h"
+
+using namespace std;
+
+// decimal digits per limb of the limb engine
+#define LIMB_DIGITS 18
+#define LIMB_BASE 1000000000000000000ull
+
+#define CACHELINE_SIZE 64
+// every thread takes about this many chunks of terms from the work queue
+#define CHUNKS_PER_THREAD 64
+
+#ifdef USE_DIGIT_ENGINE
+typedef long unsigned int accumulator_t;
+#define ACCUMULATOR_BASE 10
+#else
+typedef uint128_t accumulator_t;
+#define ACCUMULATOR_BASE LIMB_BASE
+#endif
+
+struct alignas(CACHELINE_SIZE) thread_work_t{
+    int index;
+    int cpus;
+    long unsigned d;
+    long unsigned n;
+    long unsigned chunk_size;
+    atomic<long unsigned> *next_n;  // first term of the next chunk in the work queue
+    accumulator_t *accumulators;    // accumulators of all threads, stride apart. The first ones receive the sum
+    long unsigned stride;
+    accumulator_t *digits;          // own accumulators: single digits or limbs, depending on the engine
+    accumulator_t *carries;         // carry out of the block of every thread
+    long unsigned *result;          // the d+11 final digits
+    char *output;
+    long unsigned *fraction_offset; // position of the first fractional digit in output
+};
+
+// limb 0 holds the integer part, the others LIMB_DIGITS fractional digits each.
+// The last limb only holds the remaining digits up to the d+10th fractional digit.
+long unsigned int num_limbs(long unsigned int d) {
+    return 1 + (d + 10 + LIMB_DIGITS - 1) / LIMB_DIGITS;
+}
+
+uint64_t last_limb_base(long unsigned int d) {
+    uint64_t base = 1;
+    for (long unsigned int i = 0; i < d + 10 - (num_limbs(d) - 2) * LIMB_DIGITS; ++i) base *= 10;
+    return base;
+}
+
+long unsigned int num_accumulators(long unsigned int d) {
+#ifdef USE_DIGIT_ENGINE
+    return d + 11;
+#else
+    return num_limbs(d);
+#endif
+}
+
+// accumulators of one thread padded to full cachelines, so no two threads write to the same cacheline
+long unsigned int accumulator_stride(long unsigned int d) {
+    const long unsigned int per_cacheline = CACHELINE_SIZE / sizeof(accumulator_t);
+    return (num_accumulators(d) + per_cacheline - 1) / per_cacheline * per_cacheline;
+}
+
+// base of accumulator k, only the last limb of the limb engine has a smaller one
+uint64_t accumulator_base(long unsigned int d, long unsigned int k) {
+#ifdef USE_DIGIT_ENGINE
+    return ACCUMULATOR_BASE;
+#else
+    return k == num_limbs(d) - 1 ? last_limb_base(d) : ACCUMULATOR_BASE;
+#endif
+}
+
+// heap buffer of count elements, aligned and padded to full cachelines
+template<typename T> T *alloc_aligned(long unsigned int count) {
+    const long unsigned int size = (count * sizeof(T) + CACHELINE_SIZE - 1) / CACHELINE_SIZE * CACHELINE_SIZE;
+    T *buffer = (T*)aligned_alloc(CACHELINE_SIZE, size);
+    if (buffer == NULL) {
+        fprintf(stderr, "Could not allocate %lu bytes\n", size);
+        exit(1);
+    }
+    return buffer;
+}
+
+// range [begin, end) of the count items handled by the thread, the boundaries are multiples of granularity
+void thread_range(const struct thread_work_t *thread_work, long unsigned int count, long unsigned int granularity, long unsigned int &begin, long unsigned int &end) {
+    const long unsigned int units = (count + granularity - 1) / granularity;
+    begin = min(count, units * thread_work->index / thread_work->cpus * granularity);
+    end = min(count, units * (thread_work->index + 1) / thread_work->cpus * granularity);
+}
+
+// takes the next chunk [start_n, end_n] of terms, returns false if all terms are taken
+bool next_chunk(struct thread_work_t *thread_work, long unsigned int &start_n, long unsigned int &end_n) {
+    start_n = thread_work->next_n->fetch_add(thread_work->chunk_size, memory_order_relaxed);
+    if (start_n > thread_work->n) return false;
+    end_n = start_n + thread_work->chunk_size - 1;
+    if (end_n > thread_work->n) end_n = thread_work->n;
+    return true;
+}
+
+#ifdef USE_DIGIT_ENGINE
+void sum(struct thread_work_t *thread_work) {
+    const long unsigned int d = thread_work->d;
+    long unsigned int *digits = thread_work->digits;
+    long unsigned int start_n, end_n;
+
+    // intermediate value
+    for (long unsigned int digit = 0; digit < d + 11; ++digit) {
+        digits[digit] = 0;
+    }
+    // main loop, calculate for each i the value of 1/i to a precesion of d
+    while (next_chunk(thread_work, start_n, end_n)) {
+        for (long unsigned int i = start_n; i <= end_n; ++i) {
+            long unsigned int remainder = 1;
+            for (long unsigned int digit = 0; digit < d + 11 && remainder; ++digit) {
+                long unsigned int div = remainder / i;
+                long unsigned int mod = remainder % i;
+                digits[digit] += div;
+                remainder = mod * 10;
+            }
+        }
+    }
+}
+#else
+void sum(struct thread_work_t *thread_work) {
+    const long unsigned int limbs_count = num_limbs(thread_work->d);
+    const uint64_t last_base = last_limb_base(thread_work->d);
+    uint128_t *limbs = thread_work->digits;
+    long unsigned int start_n, end_n;
+
+    // intermediate value
+    for (long unsigned int limb = 0; limb < limbs_count; ++limb) {
+        limbs[limb] = 0;
+    }
+    // main loop, same long division as the digit engine but LIMB_DIGITS digits per step.
+    // Each 1/i is truncated after the d+10th digit just like in the digit engine, so the sums are identical
+    while (next_chunk(thread_work, start_n, end_n)) {
+        for (long unsigned int i = start_n; i <= end_n; ++i) {
+            const divider_t divider = divider_init(i);
+            uint64_t remainder = 1 % i;
+            limbs[0] += 1 / i;
+            for (long unsigned int limb = 1; limb < limbs_count - 1 && remainder; ++limb) {
+                limbs[limb] += divider_divide(divider, (uint128_t)remainder * LIMB_BASE, remainder);
+            }
+            if (remainder) {
+                limbs[limbs_count - 1] += divider_divide(divider, (uint128_t)remainder * last_base, remainder);
+            }
+        }
+    }
+}
+
+// spreads the (already carried) limbs of the thread to single digits for generate_output()
+void limbs_to_digits(struct thread_work_t *thread_work) {
+    const long unsigned int d = thread_work->d;
+    const long unsigned int limbs_count = num_limbs(d);
+    const uint128_t *limbs = thread_work->accumulators;
+    long unsigned int *digits = thread_work->result;
+    long unsigned int begin, end;
+    thread_range(thread_work, limbs_count, 1, begin, end);
+    // every limb holds its digits most significant first
+    for (long unsigned int limb = begin; limb < end; ++limb) {
+        if (limb == 0) {
+            digits[0] = (long unsigned int)limbs[0];
+            continue;
+        }
+        const long unsigned int first = (limb - 1) * LIMB_DIGITS + 1;
+        long unsigned int digit = limb == limbs_count - 1 ? d + 10 : first + LIMB_DIGITS - 1;
+        uint64_t value = (uint64_t)limbs[limb];
+        for (; digit >= first; --digit) {
+            digits[digit] = value % 10;
+            value /= 10;
+        }
+    }
+}
+#endif
+
+// adds the accumulators of all threads into the first ones. Every thread sums up its own
+// slice (whole cachelines) over all threads, so the merge is done in a single parallel pass
+void merge(struct thread_work_t *thread_work) {
+    const long unsigned int stride = thread_work->stride;
+    accumulator_t *total = thread_work->accumulators;
+    long unsigned int begin, end;
+    thread_range(thread_work, num_accumulators(thread_work->d), CACHELINE_SIZE / sizeof(accumulator_t), begin, end);
+    for (int i = 1; i < thread_work->cpus; ++i) {
+        const accumulator_t *other = thread_work->accumulators + i * stride;
+        for (long unsigned int k = begin; k < end; ++k) {
+            total[k] += other[k];
+        }
+    }
+}
+
+// moves values bigger than the base up within the block of the thread.
+// The carry out of the block is left in carries for carry_fixup()
+void carry_block(struct thread_work_t *thread_work) {
+    const long unsigned int d = thread_work->d;
+    accumulator_t *total = thread_work->accumulators;
+    long unsigned int begin, end;
+    // accumulator 0 is the integer part and has no base, it only receives carries
+    thread_range(thread_work, num_accumulators(d) - 1, 1, begin, end);
+    accumulator_t carry = 0;
+    for (long unsigned int k = end; k > begin; --k) {
+        const uint64_t base = accumulator_base(d, k);
+        const accumulator_t value = total[k] + carry;
+        carry = value / base;
+        total[k] = value - carry * base;
+    }
+    thread_work->carries[thread_work->index] = carry;
+}
+
+// adds the carry out of every block to the block in front of it, from the last block to the first.
+// All accumulators are below their base already, so a carry only ripples through a few of them
+void carry_fixup(struct thread_work_t *thread_work) {
+    const long unsigned int d = thread_work->d;
+    accumulator_t *total = thread_work->accumulators;
+    struct thread_work_t previous = *thread_work;
+    long unsigned int begin, end;
+    for (int i = thread_work->cpus - 1; i > 0; --i) {
+        accumulator_t carry = thread_work->carries[i];
+        previous.index = i - 1;
+        thread_range(&previous, num_accumulators(d) - 1, 1, begin, end);
+        for (long unsigned int k = end; carry && k > begin; --k) {
+            const uint64_t base = accumulator_base(d, k);
+            const accumulator_t value = total[k] + carry;
+            carry = value / base;
+            total[k] = value - carry * base;
+        }
+        thread_work->carries[i - 1] += carry;
+    }
+    total[0] += thread_work->carries[0];
+}
+
+// digits must be carried already, see carry_block() and carry_fixup().
+// Rounds the digits and prints the integer part and the point into output, the fractional
+// digits follow at the returned position
+long unsigned int generate_integer_part(long unsigned int *digits, long unsigned int d, char *output) {
+    // round last digit, the carry stops at the first digit that is not a 9
+    if (digits[d + 1] >= 5) {
+        ++digits[d];
+        for (long unsigned int i = d; i > 0 && digits[i] >= 10; --i) {
+            digits[i - 1] += digits[i] / 10;
+            digits[i] %= 10;
+        }
+    }
+    return sprintf(output, "%lu.", digits[0]);
+}
+
+// prints the fractional digits of the block of the thread into output
+void generate_fraction(struct thread_work_t *thread_work) {
+    const long unsigned int *digits = thread_work->result + 1;
+    char *fraction = thread_work->output + *thread_work->fraction_offset;
+    long unsigned int begin, end;
+    thread_range(thread_work, thread_work->d, CACHELINE_SIZE, begin, end);
+    for (long unsigned int i = begin; i < end; ++i) {
+        fraction[i] = '0' + digits[i];
+    }
+}
+
+long unsigned int harmonic_output_size(long unsigned int d) {
+    return d + 32; // integer part, point, fractional digits and a spare byte for a newline
+}
+
+long unsigned int harmonic_sum(long unsigned int d, long unsigned int n, char *output, thread_pool_t &pool) {
+    const int cpus = pool.size();
+
+    // every thread takes chunks of terms from the work queue, then all of them merge and
+    // carry the accumulators together. Every step is one fork-join on the pool
+    const long unsigned int stride = accumulator_stride(d);
+    accumulator_t *accumulators = alloc_aligned<accumulator_t>(cpus * stride);
+    accumulator_t *carries = alloc_aligned<accumulator_t>(cpus);
+#ifdef USE_DIGIT_ENGINE
+    long unsigned int *mdigits = accumulators;
+#else
+    long unsigned int *mdigits = alloc_aligned<long unsigned int>(d + 11);
+#endif
+    long unsigned int fraction_offset = 0;
+    struct thread_work_t *tw = new thread_work_t[cpus];
+    atomic<long unsigned> next_n(1);
+    long unsigned int chunk_size = n / (cpus * CHUNKS_PER_THREAD);
+    if (chunk_size == 0) chunk_size = 1;
+
+    for (int i=0; i < cpus; i++) {
+        tw[i].index        = i;
+        tw[i].cpus         = cpus;
+        tw[i].accumulators = accumulators;
+        tw[i].stride       = stride;
+        tw[i].digits       = accumulators + i * stride;
+        tw[i].carries      = carries;
+        tw[i].result       = mdigits;
+        tw[i].output       = output;
+        tw[i].fraction_offset = &fraction_offset;
+        tw[i].n            = n;
+        tw[i].chunk_size   = chunk_size;
+        tw[i].next_n       = &next_n;
+        tw[i].d            = d;
+    }
+
+    // every phase is one span in the trace, the chunks of the threads are below it
+    TRACE_SPAN_BEGIN(ts_sum);
+    pool.run(cpus, [tw](unsigned int i, unsigned int) { sum(&tw[i]); });
+    TRACE_SPAN_END(ts_sum, "sum", n);
+    TRACE_SPAN_BEGIN(ts_merge);
+    pool.run(cpus, [tw](unsigned int i, unsigned int) { merge(&tw[i]); });
+    pool.run(cpus, [tw](unsigned int i, unsigned int) { carry_block(&tw[i]); });
+    carry_fixup(&tw[0]);
+    TRACE_SPAN_END(ts_merge, "merge and carry", cpus);
+    TRACE_SPAN_BEGIN(ts_digits);
+#ifndef USE_DIGIT_ENGINE
+    pool.run(cpus, [tw](unsigned int i, unsigned int) { limbs_to_digits(&tw[i]); });
+#endif
+    fraction_offset = generate_integer_part(mdigits, d, output);
+    pool.run(cpus, [tw](unsigned int i, unsigned int) { generate_fraction(&tw[i]); });
+    TRACE_SPAN_END(ts_digits, "digits", d);
+
+#ifndef USE_DIGIT_ENGINE
+    free(mdigits);
+#endif
+    free(carries);
+    free(accumulators);
+    delete[] tw;
+
+    return fraction_offset + d;
+}
@@ -0,0 +1,13 @@
+#ifndef __HEADER_HARMONIC_KERNEL__
+#define __HEADER_HARMONIC_KERNEL__
+
+#include "../common/thread_pool.h"
+
+// size of the output buffer harmonic_sum() needs for d digits
+long unsigned int harmonic_output_size(long unsigned int d);
+
+// calculates 1/1 + 1/2 + ... + 1/n rounded to d decimal digits on all threads of the pool and
+// prints it into output (harmonic_output_size(d) bytes, not null terminated). Returns the length
+long unsigned int harmonic_sum(long unsigned int d, long unsigned int n, char *output, thread_pool_t &pool);
+
+#endif
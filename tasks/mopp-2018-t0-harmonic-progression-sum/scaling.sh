@@ -0,0 +1,29 @@
+#!/bin/bash
+# measures the speedup over the amount of threads for several (d, n)
+# usage: MAX_CPUS=56 ./scaling.sh
+set -e;
+make clean >/dev/null
+make >/dev/null
+
+max_cpus=${MAX_CPUS:-$(nproc)}
+
+# 1, 2, 4, ... and max_cpus itself
+cpu_counts=""
+cpus=1
+while [ $cpus -lt $max_cpus ]; do cpu_counts="$cpu_counts $cpus"; cpus=$((cpus*2)); done
+cpu_counts="$cpu_counts $max_cpus"
+
+printf "%8s %10s %5s %10s %8s\n" "d" "n" "cpus" "ms" "speedup"
+for input in "100 10000000" "1000 1000000" "10000 100000" "100000 10000"
+do
+    base=""
+    for cpus in $cpu_counts
+    do
+        begin=$(date +%s%N)
+        echo $input | MAX_CPUS=$cpus ./harmonic-progression-sum >/dev/null 2>&1
+        end=$(date +%s%N)
+        ms=$(( (end - begin) / 1000000 ))
+        if [ -z "$base" ]; then base=$ms; fi
+        printf "%8s %10s %5s %10s %8s\n" $input $cpus $ms $(awk "BEGIN { printf \"%.2f\", $base / ($ms > 0 ? $ms : 1) }")
+    done
+done
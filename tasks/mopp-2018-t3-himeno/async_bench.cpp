@@ -0,0 +1,145 @@
+/*
+ * Convergence versus throughput of the asynchronous jacobi updates
+ *
+ * Usage: ./async_bench [--grid 65,65,129] [--iterations 50] [--threads 1,2,4] [--staleness 0,1,2,4,8]
+ *
+ * For every thread count runs
+ *  - sync: jacobi_update() of the library
+ *  - barrier: the rows of the asynchronous updates, but one update per run of the pool, so all
+ *    threads join after every iteration like with sync (the baseline of the speedups)
+ *  - async-K: jacobi_update_async() with a staleness of K
+ * and prints:
+ *  - the time per update and the speedup over barrier
+ *  - the gosa after the iterations, stale edges slow the convergence down
+ *  - the iterations needed to get to the gosa of barrier and the speedup with those, which is
+ *    what a solver that iterates until a residual gets
+ * The gosa is calculated on one thread, so equal fields give equal results. The asynchronous
+ * updates are not deterministic, the numbers vary a bit from run to run.
+ */
+
+#include "himeno.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+// DEFINES
+#define SYNCHRONOUS ((uint)-1)
+#define BARRIER ((uint)-2)
+
+// FUNCTIONS
+
+static vector<uint> parse_list( const string &text )
+{
+    vector<uint> list;
+    for (size_t begin = 0u, end; begin < text.size(); begin = end + 1u) {
+        end = text.find(',', begin);
+        if (end == string::npos) end = text.size();
+        list.push_back(strtoul(text.substr(begin, end - begin).c_str(), NULL, 10));
+    }
+    return list;
+}
+
+/**
+ * @brief Runs num_iterations iterations from the initial field (the best time of three runs)
+ * @param staleness SYNCHRONOUS for jacobi_update(), BARRIER for single asynchronous updates
+ * @return The gosa of the last iteration
+ */
+static float run( const vec3_uint_t &size, uint num_iterations, uint staleness, float *p, float *wrk, thread_pool_t &pool, double &seconds )
+{
+    float gosa = 0.0f;
+    seconds = 1.0e30;
+    for (int repetition = 0; repetition < 3; repetition++) {
+        himeno_init(size, p, pool);
+        himeno_init(size, wrk, pool);
+        const auto ts_begin = chrono::steady_clock::now();
+        float *result = p, *other = wrk;
+        if (staleness == SYNCHRONOUS) {
+            result = jacobi_update(size, num_iterations-1, p, wrk, pool);
+        } else if (staleness == BARRIER) {
+            for (uint n = 0; n + 1u < num_iterations; n++) {
+                if (jacobi_update_async(size, 1u, 0u, result, other, pool) != result) swap(result, other);
+            }
+        } else {
+            result = jacobi_update_async(size, num_iterations-1, staleness, p, wrk, pool);
+        }
+        seconds = min(seconds, chrono::duration<double>(chrono::steady_clock::now() - ts_begin).count());
+        thread_pool_t single(1u);
+        gosa = jacobi_gosa(size, result, single);
+    }
+    return gosa;
+}
+
+int main( int argc, char *argv[] ) {
+
+    const topology_t &topology = system_topology();
+    vector<uint> grid = { 65, 65, 129 }, thread_counts, stalenesses = { 0, 1, 2, 4, 8 };
+    uint num_iterations = 50;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--grid") == 0) grid = parse_list(argv[i+1]);
+        else if (strcmp(argv[i], "--iterations") == 0) num_iterations = max(2ul, strtoul(argv[i+1], NULL, 10));
+        else if (strcmp(argv[i], "--threads") == 0) thread_counts = parse_list(argv[i+1]);
+        else if (strcmp(argv[i], "--staleness") == 0) stalenesses = parse_list(argv[i+1]);
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (grid.size() != 3u) {
+        fprintf(stderr, "The grid needs rows,cols,deps\n");
+        return 1;
+    }
+    if (thread_counts.empty()) {
+        const uint cores = topology.threads(THREADS_PHYSICAL_CORES);
+        for (uint t = 1u; t < cores; t *= 2u) thread_counts.push_back(t);
+        thread_counts.push_back(cores);
+    }
+
+    const vec3_uint_t size(grid[0], grid[1], grid[2]);
+    vector<float> p(himeno_field_size(size)), wrk(himeno_field_size(size));
+    printf("Topology: %s\n", describe_topology(topology).c_str());
+    printf("Grid %ux%ux%u, %u iterations\n\n", size.x, size.y, size.z, num_iterations);
+    printf("%7s %-9s %10s %8s %10s %13s %10s\n", "threads", "mode", "ms_per_it", "speedup", "gosa", "its_to_match", "eff_speedup");
+
+    for (uint threads : thread_counts) {
+
+        thread_pool_t pool(threads, topology.thread_cpus(threads));
+        double sync_seconds, barrier_seconds, seconds;
+        const float sync_gosa = run(size, num_iterations, SYNCHRONOUS, p.data(), wrk.data(), pool, sync_seconds);
+        const float barrier_gosa = run(size, num_iterations, BARRIER, p.data(), wrk.data(), pool, barrier_seconds);
+        const double barrier_per_it = barrier_seconds / (num_iterations - 1u);
+        printf("%7u %-9s %10.3f %8.2f %10.6f %13u %10.2f\n", threads, "sync", sync_seconds / (num_iterations - 1u) * 1.0e3,
+            barrier_seconds / sync_seconds, sync_gosa, num_iterations, barrier_seconds / sync_seconds);
+        printf("%7u %-9s %10.3f %8.2f %10.6f %13u %10.2f\n", threads, "barrier", barrier_per_it * 1.0e3, 1.0, barrier_gosa, num_iterations, 1.0);
+
+        for (uint staleness : stalenesses) {
+
+            const float gosa = run(size, num_iterations, staleness, p.data(), wrk.data(), pool, seconds);
+            const double per_it = seconds / (num_iterations - 1u);
+
+            // more iterations until the gosa of barrier is reached (gosa falls monotonically)
+            uint needed = num_iterations;
+            double needed_seconds = seconds;
+            for (float g = gosa; g > barrier_gosa && needed < 4u * num_iterations; ) {
+                needed += max(1u, num_iterations / 20u);
+                g = run(size, needed, staleness, p.data(), wrk.data(), pool, needed_seconds);
+            }
+
+            char mode[16];
+            snprintf(mode, sizeof(mode), "async-%u", staleness);
+            printf("%7u %-9s %10.3f %8.2f %10.6f %13u %10.2f\n", threads, mode, per_it * 1.0e3, barrier_per_it / per_it, gosa, needed, barrier_seconds / needed_seconds);
+            fflush(stdout);
+
+        }
+    }
+
+    return 0;
+
+}
@@ -28,49 +28,33 @@
  P: pressure
 ********************************************************************/
 
+
 #include "himeno.h"
 
-#include <mutex>
-#include <thread>
-#include <atomic>
-#include <chrono>
+#include <string>
+#include <vector>
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <assert.h>
 
 using namespace std;
 
 // DEFINES
-#define OMEGA 0.8
-#define ONE_SIXTH 1.0/6.0
-
+#ifndef ROW_GOSA
+    #define ROW_GOSA 0      // 1: the streamed, hybrid and masked gosa per row, else the float sum of the lab
+#endif
+#define GOSA_SUM (ROW_GOSA ? HIMENO_GOSA_ROWS : HIMENO_GOSA_LAB)
 
 // GLOBAL VARS
 uint NUM_CORES;
-Matrix<FLOAT_TYPE_TO_USE> *p;
-Matrix<FLOAT_TYPE_TO_USE> *wrk;
-atomic<int> current_row(0);
-
-#ifdef USE_FLOAT64
-    #define GOSA_POINTER gosa_arr+i
-#else
-    mutex gosa_mutex;
-    #define GOSA_POINTER &gosa
-#endif
 
-#if MEASURE_TIME
+#ifdef MEASURE_TIME
     int64_t ts_beginning;
     int64_t ts_jacobi_beginning;
-    int64_t ts_temp;
 
-    int64_t time_calculation = 0;
-    int64_t time_copying = 0;
     int64_t time_preparation = 0;
     int64_t time_jacobi = 0;
     int64_t time_full = 0;
-
-    int64_t *times_threads;
 #endif
 
 // FUNCTIONS
@@ -83,8 +67,12 @@ int main( int argc, char *argv[] ) {
 
     uint num_iterations, num_rows, num_cols, num_deps;
 
-    // get amount of cores
-    NUM_CORES = atoi(getenv("MAX_CPUS"));
+    // get amount of cores, the solver is bound by the memory bandwidth, so SMT siblings only compete
+    const topology_t &topology = system_topology();
+    NUM_CORES = topology.threads(THREADS_PHYSICAL_CORES);
+    const vector<int> cpus = topology.thread_cpus(NUM_CORES);
+    pin_thread(cpus[0]);
+    fprintf(stderr, "Topology: %s\n", describe_topology(topology).c_str());
     fprintf(stderr, "Working with %u cores\n", NUM_CORES);
 
     if (argc == 5) {
@@ -93,31 +81,72 @@ int main( int argc, char *argv[] ) {
         num_deps = stoul(argv[3]);
         num_iterations = stoul(argv[4]);
     } else {
+        TRACE_SPAN_BEGIN(ts_input);
         (void)! scanf("%u", &num_rows);
         (void)! scanf("%u", &num_cols);
         (void)! scanf("%u", &num_deps);
         (void)! scanf("%u", &num_iterations);
+        TRACE_SPAN_END(ts_input, "read input", 0);
     }
 
     fprintf(stderr, "Matrix size is %ux%ux%u with %u iterations\n", num_rows, num_cols, num_deps, num_iterations);
 
-    // create matrices
-    p = new Matrix<FLOAT_TYPE_TO_USE>(num_rows-2, num_cols-2, num_deps-2, NUM_CORES);
-    wrk =  new Matrix<FLOAT_TYPE_TO_USE>(num_rows-2, num_cols-2, num_deps-2, NUM_CORES);
-
-    // initialize matrices
-    p->set_init();
-    Matrix<FLOAT_TYPE_TO_USE>::copy(p, wrk);
+    // create and initialize matrices, all work runs on the same threads
+    const vec3_uint_t size(num_rows, num_cols, num_deps);
+    #ifdef HYBRID
+        // the pool of process 0, jacobi_hybrid() forks the other processes, which have their own pools
+        const himeno_layout_t layout = himeno_choose_layout<FLOAT_TYPE_TO_USE>(size, topology);
+        thread_pool_t pool(layout.threads, himeno_layout_cpus(layout, topology, 0));
+        fprintf(stderr, "Hybrid layout: %u processes x %u threads, tiles of %ux%u\n", layout.processes, layout.threads, layout.tile_cols, layout.tile_deps);
+    #else
+        thread_pool_t pool(NUM_CORES, cpus);
+    #endif
+    #if defined(STREAM_BLOCK)
+        // the fields are files in $HIMENO_STREAM_DIR, the first pass generates the initial field
+        const char *directory = getenv("HIMENO_STREAM_DIR") != NULL ? getenv("HIMENO_STREAM_DIR") : "/tmp";
+        fprintf(stderr, "Streaming from %s, %u updates per pass, window of %.1f MiB\n", directory, (uint)STREAM_BLOCK,
+            himeno_stream_window<FLOAT_TYPE_TO_USE>(size, STREAM_BLOCK) / 1048576.0);
+    #elif !defined(HYBRID)
+        auto p = new FLOAT_TYPE_TO_USE[himeno_field_size(size)];
+        auto wrk = new FLOAT_TYPE_TO_USE[himeno_field_size(size)];
+        TRACE_SPAN_BEGIN(ts_init);
+        himeno_init(size, p, pool);
+        himeno_init(size, wrk, pool);
+        TRACE_SPAN_END(ts_init, "init", himeno_field_size(size));
+    #endif
+    #ifdef MASKED
+        // the full box as a domain, its fields are in the same order as the ones of himeno_init()
+        himeno_boundary_t boundaries[HIMENO_NUM_FACES];
+        himeno_domain_t<FLOAT_TYPE_TO_USE> domain;
+        himeno_domain_build(size, []( uint, uint, uint ) { return true; }, boundaries, domain, pool);
+        fprintf(stderr, "Masked solver on the full box, %zu segments\n", domain.segments.size());
+    #endif
 
     #ifdef MEASURE_TIME
         time_preparation = get_timestamp(ts_beginning);
         ts_jacobi_beginning = get_timestamp();
-        times_threads = new int64_t[NUM_CORES];
-        fill_n(times_threads, NUM_CORES, 0);
     #endif
 
-    // print result
-    printf("%.6f\n", jacobi(num_iterations));
+    // print result, the asynchronous updates only wait for neighbors that fall ASYNC_STALENESS iterations behind,
+    // the hybrid processes only for their neighbor slabs
+    #if defined(STREAM_BLOCK)
+        FLOAT_TYPE_TO_USE gosa;
+        if (!jacobi_stream(size, num_iterations, STREAM_BLOCK, directory, gosa, pool, GOSA_SUM)) return 1;
+    #elif defined(HYBRID)
+        FLOAT_TYPE_TO_USE gosa;
+        if (!jacobi_hybrid<FLOAT_TYPE_TO_USE>(size, num_iterations, layout, gosa, nullptr, pool, GOSA_SUM)) return 1;
+    #elif defined(MASKED)
+        const FLOAT_TYPE_TO_USE gosa = jacobi_domain(domain, num_iterations, p, wrk, pool, GOSA_SUM);
+    #elif defined(ASYNC_STALENESS)
+        fprintf(stderr, "Asynchronous updates with a staleness of %u\n", (uint)ASYNC_STALENESS);
+        const FLOAT_TYPE_TO_USE gosa = jacobi_async(size, num_iterations, ASYNC_STALENESS, p, wrk, pool);
+    #else
+        const FLOAT_TYPE_TO_USE gosa = jacobi(size, num_iterations, p, wrk, pool);
+    #endif
+    TRACE_SPAN_BEGIN(ts_output);
+    printf("%.6f\n", gosa);
+    fflush(stdout);
+    TRACE_SPAN_END(ts_output, "write output", 0);
 
     #ifdef MEASURE_TIME
         time_jacobi = get_timestamp(ts_jacobi_beginning);
@@ -126,125 +155,12 @@ int main( int argc, char *argv[] ) {
         fprintf(stderr, "Time full: %.3fms\n", time_full/1.0e6);
         fprintf(stderr, "Time preparation: %.3fms (%.2f%%)\n", time_preparation/1.0e6, time_preparation*100.0/time_full);
         fprintf(stderr, "Time jacobi: %.3fms (%.2f%%)\n", time_jacobi/1.0e6, time_jacobi*100.0/time_full);
-        /*fprintf(stderr, "  |--> Time calculated: %.3fms (%.2f%%)\n", time_calculation/1.0e6, time_calculation*100.0/time_jacobi);
-        fprintf(stderr, "  +--> Time copied: %.3fms (%.2f%%)\n", time_copying/1.0e6, time_copying*100.0/time_jacobi);*/
-
-        fprintf(stderr, "\n");
-        for (uint i = 0; i < NUM_CORES; i++) fprintf(stderr, "Time thread %u: %.3fms\n", i, times_threads[i]/1.0e6);
-        fprintf(stderr, "\n");
-        delete[] times_threads;
     #endif
 
-    return 0;
-
-}
-
-void calculate_part( uint thread_number, FLOAT_TYPE_TO_USE *gosa ) {
-
-    #ifdef MEASURE_TIME
-        const auto now = get_timestamp();
+    #if !defined(STREAM_BLOCK) && !defined(HYBRID)
+        delete[] p;
+        delete[] wrk;
     #endif
+    return 0;
 
-    // vars
-    FLOAT_TYPE_TO_USE value;
-    FLOAT_TYPE_TO_USE *ptr_p_data;
-    FLOAT_TYPE_TO_USE *ptr_wrk_data;
-    int r, c, d;
-
-    // iterate over the volume
-    while ((r = current_row++) < p->m_uiRows) {
-
-        // adjust pointers to fit the current row
-        ptr_p_data = p->m_pData + r*p->m_uiRowMemoryOffset;
-        ptr_wrk_data = wrk->m_pData + r*p->m_uiRowMemoryOffset;
-
-        for (c = 0; c < p->m_uiCols; c++) {
-            for (d = 0; d < p->m_uiDeps; d++) {
-
-                // sum up the neighboring values
-                value = (
-                      p->get(r+1,c,d) + p->get(r,c+1,d) + p->get(r,c,d+1)
-                    + p->get(r-1,c,d) + p->get(r,c-1,d) + p->get(r,c,d-1)
-                ) / 6.0 - (*ptr_p_data);
-
-                // check if it is last iteration
-                if (gosa == nullptr) {
-                    (*ptr_wrk_data) = (*ptr_p_data) + OMEGA*value;
-                } else {
-                    #ifndef USE_FLOAT64
-                        gosa_mutex.lock();
-                    #endif
-                    (*gosa) += value*value;
-                    #ifndef USE_FLOAT64
-                        gosa_mutex.unlock();
-                    #endif
-                }
-
-                // update pointers
-                ptr_p_data++;
-                ptr_wrk_data++;
-
-            }
-        }
-    }
-
-    #ifdef MEASURE_TIME
-        times_threads[thread_number] += get_timestamp(now);
-    #endif
-    
-}
-
-FLOAT_TYPE_TO_USE jacobi( uint num_iterations ) {
-
-    // for the final (combined) result
-    FLOAT_TYPE_TO_USE gosa = 0.0f;
-    Matrix<FLOAT_TYPE_TO_USE> *p_mat_tmp;
-    const auto NUM_CORES_MINUS_ONE = NUM_CORES-1;
-
-    // create thread array
-    auto thread_arr = new thread[NUM_CORES_MINUS_ONE];
-
-    // the partial results
-    #ifdef USE_FLOAT64
-        auto gosa_arr = new FLOAT_TYPE_TO_USE[NUM_CORES];
-        fill_n(gosa_arr, NUM_CORES, 0.0f);
-    #endif
-
-    // start to calculate
-    uint i;
-    for (uint n = 0; n < num_iterations; n++) {
-
-        #ifdef MEASURE_TIME
-            ts_temp = get_timestamp();
-        #endif
-
-        // calculate in parallel
-        for (i=0; i<NUM_CORES_MINUS_ONE; i++) thread_arr[i] = thread(calculate_part, i, n == num_iterations-1 ? GOSA_POINTER : nullptr);
-        calculate_part(i, n == num_iterations-1 ? GOSA_POINTER : nullptr);
-        for (i=0; i<NUM_CORES_MINUS_ONE; i++) thread_arr[i].join();
-        current_row = 0;
-
-        #ifdef MEASURE_TIME
-            time_calculation += get_timestamp(ts_temp);
-        #endif
-
-        // swap matrices (no copy needed)
-        p_mat_tmp = p;
-        p = wrk;
-        wrk = p_mat_tmp;
-        
-    }
-
-    // sum up partial gosa
-    #ifdef USE_FLOAT64
-        for (uint i=0; i<NUM_CORES; i++) gosa += gosa_arr[i];
-        delete[] gosa_arr;
-    #endif
-
-    // free ressources
-    delete[] thread_arr;
-
-    // done
-    return gosa;
 }
-
@@ -5,6 +5,9 @@
 #include "matrix.h"
 #include "common.h"
 
+#include <functional>
+#include <vector>
+
 #ifdef USE_FLOAT64
     #define FLOAT_TYPE_TO_USE double
 #else
@@ -14,6 +17,210 @@
 typedef Vector3<uint> vec3_uint_t;
 typedef Vector4<uint> vec4_uint_t;
 
-FLOAT_TYPE_TO_USE jacobi( uint nn );
+enum himeno_boundary_kind_t {
+    HIMENO_INITIAL,     // the pressure himeno_init() gives the boundary cell, the benchmark keeps it
+    HIMENO_DIRICHLET,   // the fixed pressure value
+    HIMENO_NEUMANN      // the boundary cell is value more than its neighbor inside, 0 for no flux
+};
+
+// the faces of the grid and the surface of the obstacles in it
+enum himeno_face_t {
+    HIMENO_FACE_ROW_BEGIN,
+    HIMENO_FACE_ROW_END,
+    HIMENO_FACE_COL_BEGIN,
+    HIMENO_FACE_COL_END,
+    HIMENO_FACE_DEP_BEGIN,
+    HIMENO_FACE_DEP_END,
+    HIMENO_FACE_OBSTACLE,
+    HIMENO_NUM_FACES
+};
+
+// how the solvers that sum the gosa on their own do it
+enum himeno_gosa_sum_t {
+    HIMENO_GOSA_LAB,    // one float sum in the order of the cells, the result of the lab with one thread
+    HIMENO_GOSA_ROWS    // per row or unit of work, then those in order, closer to the double result
+};
+
+struct himeno_boundary_t {
+    himeno_boundary_kind_t kind = HIMENO_INITIAL;
+    double value = 0.0;
+};
+
+/**
+ * @brief The active cells of a grid with holes and obstacles (himeno_masked.cpp). The fields of a
+ * domain hold the active cells only, run after run along the deps. Every run is split into segments
+ * in which each of the four neighbors in the rows and columns is either active all along or a
+ * boundary, so the inner loop of a segment has no branches
+ */
+template<typename T>
+struct himeno_domain_t {
+
+    struct segment_t {
+        uint r, c, d;           // first cell
+        uint length;
+        size_t offset;          // of the first cell in the fields
+        size_t neighbors[4];    // the neighbors r+1, c+1, r-1, c-1 of the first cell, offset for a boundary
+        T scale[4];             // a neighbor is scale*field[neighbor] + shift: 1 and 0 if it is active,
+        T shift[4];             // 0 and the value for Dirichlet, 1 and the value for Neumann on the cell itself
+        T run_scale[2];         // the same for d-1 of the first and d+1 of the last cell,
+        T run_shift[2];         // if the segment begins or ends its run
+        bool run_begin, run_end;
+    };
+
+    vec3_uint_t size;
+    size_t num_cells = 0;               // active cells, the values of a field
+    size_t num_runs = 0;
+    std::vector<segment_t> segments;
+    std::vector<size_t> chunks;         // first segment of every unit of work of the pool, about the same cells each
+
+};
+
+/*
+ * The solver as library (himeno_kernel.cpp, instantiated for float and double). The grid size
+ * is the one of the input (rows, cols, deps including the boundaries), the fields are buffers
+ * of himeno_field_size() values owned by the caller and hold the inner points only.
+ */
+
+size_t himeno_field_size( const vec3_uint_t &size );
+
+/**
+ * @brief Fills the field with the initial pressure
+ */
+template<typename T>
+void himeno_init( const vec3_uint_t &size, T *p, thread_pool_t &pool );
+
+/**
+ * @brief Applies num_updates jacobi updates
+ * @param p The current field
+ * @param wrk Scratch field, the two get swapped after every update
+ * @return The buffer (p or wrk) that holds the updated field
+ */
+template<typename T>
+T *jacobi_update( const vec3_uint_t &size, uint num_updates, T *p, T *wrk, thread_pool_t &pool );
+
+/**
+ * @brief Calculates the residual (gosa) of the field without changing it
+ */
+template<typename T>
+T jacobi_gosa( const vec3_uint_t &size, T *p, thread_pool_t &pool );
+
+/**
+ * @brief Runs the benchmark on the initialized field p: num_iterations-1 updates, then the
+ * gosa of the last iteration
+ */
+template<typename T>
+T jacobi( const vec3_uint_t &size, uint num_iterations, T *p, T *wrk, thread_pool_t &pool );
+
+/**
+ * @brief Applies num_updates jacobi updates without a barrier between them (chaotic relaxation).
+ * The field is split into one slab of rows per thread, every slab advances on its own epoch
+ * counter and reads the edge rows its neighbors published. A slab only waits when a neighbor
+ * falls more than staleness epochs behind, it then uses the neighbor's older edge instead of
+ * waiting for the current one. With staleness 0 the result equals the one of jacobi_update()
+ * @return The buffer (p or wrk) that holds the updated field
+ */
+template<typename T>
+T *jacobi_update_async( const vec3_uint_t &size, uint num_updates, uint staleness, T *p, T *wrk, thread_pool_t &pool );
+
+/**
+ * @brief jacobi() with the updates of jacobi_update_async()
+ */
+template<typename T>
+T jacobi_async( const vec3_uint_t &size, uint num_iterations, uint staleness, T *p, T *wrk, thread_pool_t &pool );
+
+/**
+ * @brief Runs the benchmark out of core (himeno_stream.cpp): the fields are files in the given
+ * directory and only a window of himeno_stream_window() bytes of rows is in the memory. Every
+ * pass over the files applies temporal_block updates, the gosa is part of the last pass
+ * @param gosa The gosa of the last iteration
+ * @param gosa_sum HIMENO_GOSA_LAB prints what the judged binary prints, HIMENO_GOSA_ROWS sums per
+ * row of columns
+ * @return false if the files could not be created
+ */
+template<typename T>
+bool jacobi_stream( const vec3_uint_t &size, uint num_iterations, uint temporal_block, const char *directory, T &gosa, thread_pool_t &pool,
+                    himeno_gosa_sum_t gosa_sum = HIMENO_GOSA_LAB );
+
+/**
+ * @brief The memory jacobi_stream() keeps rows in
+ */
+template<typename T>
+size_t himeno_stream_window( const vec3_uint_t &size, uint temporal_block );
+
+/**
+ * @brief How jacobi_hybrid() splits the work: one process per slab of rows, a pool of threads
+ * per process over tiles of columns and deps, vector lanes along the deps inside a tile
+ */
+struct himeno_layout_t {
+    uint processes = 1;     // slabs of rows, the halos are read from the shared fields
+    uint threads = 1;       // threads per process
+    uint tile_cols = 1;     // a tile is the unit of work of a pool, it goes through all rows of the slab
+    uint tile_deps = 1;
+};
+
+/**
+ * @brief The layout for the machine: a process per NUMA node (or per L3 if there is only one node),
+ * as long as every slab gets a few rows, the physical cores split among them and tiles whose
+ * rows fit into the L2
+ */
+template<typename T>
+himeno_layout_t himeno_choose_layout( const vec3_uint_t &size, const topology_t &topology );
+
+/**
+ * @brief The CPUs of the threads of a process of the layout, cores of the same node next to each other
+ */
+std::vector<int> himeno_layout_cpus( const himeno_layout_t &layout, const topology_t &topology, uint process );
+
+/**
+ * @brief Runs the benchmark with the hybrid layout (himeno_hybrid.cpp). The calling process is
+ * process 0 and uses the pool for its tiles, the others get forked and create their own pools
+ * on himeno_layout_cpus(). The fields are in memory shared by all processes, every process
+ * initializes its slab itself, so the pages are on its node. The updates are the ones of
+ * jacobi_update()
+ * @param gosa The gosa of the last iteration
+ * @param result nullptr or a buffer of himeno_field_size() values for the last field
+ * @param gosa_sum HIMENO_GOSA_LAB: the squares of the residuals go to the unused field and process 0
+ * sums them in order, HIMENO_GOSA_ROWS: summed per row of a tile, then per tile and process in order
+ * @return false if a process could not be started or failed
+ */
+template<typename T>
+bool jacobi_hybrid( const vec3_uint_t &size, uint num_iterations, const himeno_layout_t &layout, T &gosa, T *result, thread_pool_t &pool,
+                    himeno_gosa_sum_t gosa_sum = HIMENO_GOSA_LAB );
+
+/**
+ * @brief Builds the domain of the grid size (including the boundaries like for the other solvers)
+ * @param is_active Whether the inner cell is part of the domain or an obstacle, only called once per cell
+ * @param boundaries The boundary conditions of the faces, all HIMENO_INITIAL for the benchmark
+ */
+template<typename T>
+void himeno_domain_build( const vec3_uint_t &size, const std::function<bool( uint r, uint c, uint d )> &is_active,
+                          const himeno_boundary_t (&boundaries)[HIMENO_NUM_FACES], himeno_domain_t<T> &domain, thread_pool_t &pool );
+
+/**
+ * @brief Fills a field of domain.num_cells values with the initial pressure
+ */
+template<typename T>
+void himeno_domain_init( const himeno_domain_t<T> &domain, T *p, thread_pool_t &pool );
+
+/**
+ * @brief jacobi_update() on the active cells, vectorized along the segments
+ */
+template<typename T>
+T *jacobi_domain_update( const himeno_domain_t<T> &domain, uint num_updates, T *p, T *wrk, thread_pool_t &pool );
+
+/**
+ * @brief The gosa of the active cells, the result does not depend on the number of threads
+ * @param gosa_sum HIMENO_GOSA_LAB: one sum in the order of the fields, for the full box the one of
+ * the lab, HIMENO_GOSA_ROWS: summed per unit of work and then in order
+ */
+template<typename T>
+T jacobi_domain_gosa( const himeno_domain_t<T> &domain, const T *p, thread_pool_t &pool, himeno_gosa_sum_t gosa_sum = HIMENO_GOSA_LAB );
+
+/**
+ * @brief jacobi() on the active cells
+ */
+template<typename T>
+T jacobi_domain( const himeno_domain_t<T> &domain, uint num_iterations, T *p, T *wrk, thread_pool_t &pool,
+                 himeno_gosa_sum_t gosa_sum = HIMENO_GOSA_LAB );
 
 #endif
\ No newline at end of file
@@ -0,0 +1,329 @@
+/*
+ * Hybrid solver for machines with several NUMA nodes, see himeno.h for the interface.
+ *
+ * Three levels of parallelism:
+ *  - processes: every process owns a slab of rows of the two fields. The fields are one mapping
+ *    shared by all processes, a process initializes its slab itself, so the pages of the slab are
+ *    on the node of its threads. The halo of a slab is the edge row of each neighbor slab, read
+ *    directly from the shared fields. Every process counts its epochs (updates done) in a shared
+ *    slot and before an update only waits until its two neighbors are done with the one before,
+ *    there is no barrier over all processes.
+ *  - threads: the pool of a process takes tiles of columns and deps, a tile goes down all rows of
+ *    the slab, so the three input rows of the tile stay in the L2.
+ *  - vector lanes: inside a tile the loop along the deps has no branches, the neighbors outside of
+ *    the field are lines of boundary values instead of checks.
+ *
+ * A neighbor writes the buffer a process reads from only in its next update, and it waits for
+ * the process to be done first, so the updates are exactly the ones of jacobi_update().
+ * For the gosa like the lab sums it, the squares of the residuals are written to the field that
+ * is not needed anymore and process 0 sums them in the order of the cells at the end.
+ */
+
+#include "himeno.h"
+#include "himeno_row.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+// DEFINES
+#define MIN_SLAB_ROWS 8u                // rows a process gets at least
+#define MAX_TILE_DEPS 1024u             // longer lines get split into tiles along the deps
+#define TILES_PER_THREAD 4u             // tiles per thread of a process at least, for the balance
+#define DEFAULT_TILE_CACHE (1u << 18)   // if the size of the L2 is not known
+#define CHECK_SPINS 4096u               // process 0 looks for failed processes this often while it waits
+#define CHILD_POLL_US 100u              // and this often once its slab is done
+
+// TYPEDEFS
+
+// the state of a process in the shared mapping, one cache line each
+struct alignas(64) hybrid_slot_t {
+    atomic<uint> epoch;     // 1 once the slab is initialized, then +1 per update
+    atomic<uint> failed;    // only the one of process 0, stops all processes
+    double gosa;
+};
+
+// FUNCTIONS
+
+/**
+ * @brief Updates a tile in the rows [r_begin, r_end) or adds its residual to gosa
+ * @param wrk The updated field, or with GOSA nullptr or the field for the squares of the residuals
+ * @param lines Three lines of deps values for the neighbors outside of the field
+ */
+template<typename T, bool GOSA>
+static void tile_update( const T *p, T *__restrict wrk, int r_begin, int r_end, int rows, int cols, int deps,
+                         int c_begin, int c_end, int d_begin, int d_end, T *lines, T &gosa ) {
+
+    const size_t plane = (size_t)cols * deps;
+    const T *lower_line = lines, *upper_line = lines + deps;
+    T *side_line = lines + 2*deps;
+
+    for (int r = r_begin; r < r_end; r++) {
+
+        // the values of Matrix::get() outside of the field
+        const T side = (T)((r+1)*(r+1)) / (T)((rows+1)*(rows+1));
+        fill(side_line + d_begin, side_line + d_end, side);
+        T sum = 0.0;
+
+        for (int c = c_begin; c < c_end; c++) {
+
+            const size_t line = r*plane + (size_t)c*deps;
+            const T *self = p + line;
+            const T *up = r+1 < rows ? self + plane : upper_line, *down = r > 0 ? self - plane : lower_line;
+            const T *right = c+1 < cols ? self + deps : side_line, *left = c > 0 ? self - deps : side_line;
+            T *out = wrk + line;
+
+            // the same order of the neighbors as update_row()
+            auto cell = [&]( int d, T d_above, T d_below ) {
+                const T value = (up[d] + right[d] + d_above + down[d] + left[d] + d_below) / 6.0 - self[d];
+                if (!GOSA) out[d] = self[d] + OMEGA*value;
+                else if (wrk != nullptr) out[d] = value*value;
+                else sum += value*value;
+            };
+
+            // only the first and the last dep of the line have the boundary along d
+            const int inner_begin = max(d_begin, 1), inner_end = min(d_end, deps-1);
+            if (d_begin == 0) cell(0, deps > 1 ? self[1] : side, side);
+            for (int d = inner_begin; d < inner_end; d++) cell(d, self[d+1], self[d-1]);
+            if (d_end == deps && deps-1 >= inner_begin) cell(deps-1, side, self[deps-2]);
+
+        }
+
+        // a sum per row, a float sum over the whole tile would lose the small residuals
+        if (GOSA) gosa += sum;
+
+    }
+
+}
+
+template<typename T>
+himeno_layout_t himeno_choose_layout( const vec3_uint_t &size, const topology_t &topology ) {
+
+    const uint rows = size.x-2, cols = size.y-2, deps = size.z-2;
+    const uint cores = topology.threads(THREADS_PHYSICAL_CORES);
+    himeno_layout_t layout;
+
+    // a process per node, on a single node one per L3 (chiplets)
+    const uint num_cpus = topology.cpus.size();
+    uint domains = max(1u, topology.num_nodes);
+    if (domains == 1u && topology.l3_cpus > 0u && topology.l3_cpus < num_cpus) domains = (num_cpus + topology.l3_cpus - 1u) / topology.l3_cpus;
+    layout.processes = max(1u, min(min(domains, cores), rows / MIN_SLAB_ROWS));
+    layout.threads = max(1u, cores / layout.processes);
+
+    // the rows r-1, r and r+1 of the input and r of the output of a tile in half of the L2
+    layout.tile_deps = max(1u, min(deps, MAX_TILE_DEPS));
+    const size_t cache = (topology.l2_size > 0u ? topology.l2_size : DEFAULT_TILE_CACHE) / 2u;
+    layout.tile_cols = max<size_t>(1u, min<size_t>(cols, cache / (4u * layout.tile_deps * sizeof(T))));
+    const uint dep_tiles = (deps + layout.tile_deps - 1u) / layout.tile_deps;
+    while (layout.tile_cols > 1u && (cols + layout.tile_cols - 1u) / layout.tile_cols * dep_tiles < TILES_PER_THREAD * layout.threads) {
+        layout.tile_cols = (layout.tile_cols + 1u) / 2u;
+    }
+
+    return layout;
+
+}
+
+vector<int> himeno_layout_cpus( const himeno_layout_t &layout, const topology_t &topology, uint process ) {
+
+    // one CPU per core with the cores of a node next to each other, then the SMT siblings
+    vector<cpu_info_t> by_node(topology.cpus);
+    stable_sort(by_node.begin(), by_node.end(), []( const cpu_info_t &a, const cpu_info_t &b ) { return a.node < b.node; });
+    vector<int> order, siblings;
+    set<int> cores;
+    for (const cpu_info_t &info : by_node) {
+        if (cores.insert(info.core).second) order.push_back(info.cpu);
+        else siblings.push_back(info.cpu);
+    }
+    order.insert(order.end(), siblings.begin(), siblings.end());
+
+    vector<int> cpus(layout.threads, -1);
+    for (uint t = 0u; t < layout.threads && !order.empty(); t++) cpus[t] = order[((size_t)process * layout.threads + t) % order.size()];
+    return cpus;
+
+}
+
+template<typename T>
+bool jacobi_hybrid( const vec3_uint_t &size, uint num_iterations, const himeno_layout_t &layout, T &gosa, T *result, thread_pool_t &pool,
+                    himeno_gosa_sum_t gosa_sum ) {
+
+    gosa = 0.0;
+    const int rows = size.x-2, cols = size.y-2, deps = size.z-2;
+    if (num_iterations == 0 || rows <= 0) return true;
+    const uint num_updates = num_iterations - 1;
+    const uint processes = max(1u, min(layout.processes, (uint)rows));
+    const size_t plane = (size_t)cols * deps, field_size = himeno_field_size(size);
+
+    // the slots of the processes, then the two fields on the next page
+    const size_t page = sysconf(_SC_PAGESIZE);
+    const size_t slots_bytes = (processes * sizeof(hybrid_slot_t) + page - 1u) / page * page;
+    const size_t bytes = slots_bytes + 2u * field_size * sizeof(T);
+    void *shared = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        fprintf(stderr, "Could not map the shared fields: %s\n", strerror(errno));
+        return false;
+    }
+    hybrid_slot_t *slots = (hybrid_slot_t*)shared;
+    for (uint i = 0; i < processes; i++) new (slots + i) hybrid_slot_t();
+    T *fields[2] = { (T*)((char*)shared + slots_bytes), (T*)((char*)shared + slots_bytes) + field_size };
+
+    const uint tile_cols = max(1u, min(layout.tile_cols, (uint)cols)), tile_deps = max(1u, min(layout.tile_deps, (uint)deps));
+    const uint dep_tiles = (deps + tile_deps - 1u) / tile_deps;
+    const uint num_tiles = (cols + tile_cols - 1u) / tile_cols * dep_tiles;
+
+    vector<pid_t> children;
+    vector<bool> reaped;
+
+    // process 0 notices a process that died and stops the others
+    auto check_children = [&]() {
+        size_t running = 0u;
+        for (size_t i = 0; i < children.size(); i++) {
+            if (reaped[i]) continue;
+            int status;
+            const pid_t pid = waitpid(children[i], &status, WNOHANG);
+            if (pid == 0) {
+                running++;
+                continue;
+            }
+            reaped[i] = true;
+            if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) slots[0].failed.store(1u, memory_order_relaxed);
+        }
+        return running;
+    };
+
+    // waits until the neighbors of the process are done with the epoch
+    auto wait_neighbors = [&]( uint process, uint epoch ) {
+        TRACE_SPAN_BEGIN(ts_wait);
+        for (uint neighbor = process > 0u ? process-1u : 0u; neighbor <= process+1u && neighbor < processes; neighbor++) {
+            if (neighbor == process) continue;
+            for (uint spins = 0; slots[neighbor].epoch.load(memory_order_acquire) < epoch; spins++) {
+                if (slots[0].failed.load(memory_order_relaxed) != 0u) return false;
+                if (spins < 64u) continue;
+                this_thread::yield();
+                if (process == 0u && spins % CHECK_SPINS == 0u) check_children();
+            }
+        }
+        TRACE_SPAN_END(ts_wait, "halo wait", epoch);
+        return true;
+    };
+
+    // everything a process does with its slab
+    auto run_slab = [&]( uint process, thread_pool_t &slab_pool ) {
+
+        const int r_begin = (int)((long)rows * process / processes), r_end = (int)((long)rows * (process+1u) / processes);
+        vector<vector<T>> lines(slab_pool.size());
+        for (vector<T> &thread_lines : lines) {
+            thread_lines.assign(3u * deps, 0.0);
+            fill_n(thread_lines.begin() + deps, deps, 1.0);
+        }
+
+        // the first touch of the slab by the threads that work on it
+        slab_pool.run(r_end - r_begin, [&]( uint i, uint ) {
+            const int r = r_begin + i;
+            const T value = (T)((r+1)*(r+1)) / (T)((rows+1)*(rows+1));
+            fill_n(fields[0] + r*plane, plane, value);
+            fill_n(fields[1] + r*plane, plane, value);
+        });
+        slots[process].epoch.store(1u, memory_order_release);
+
+        auto run_tiles = [&]( const T *p, T *wrk, T *partial_gosa ) {
+            slab_pool.run(num_tiles, [&]( uint k, uint thread_number ) {
+                const int c_begin = k / dep_tiles * tile_cols, d_begin = k % dep_tiles * tile_deps;
+                const int c_end = min(c_begin + (int)tile_cols, cols), d_end = min(d_begin + (int)tile_deps, deps);
+                if (partial_gosa == nullptr) {
+                    T unused;
+                    tile_update<T, false>(p, wrk, r_begin, r_end, rows, cols, deps, c_begin, c_end, d_begin, d_end, lines[thread_number].data(), unused);
+                } else {
+                    tile_update<T, true>(p, wrk, r_begin, r_end, rows, cols, deps, c_begin, c_end, d_begin, d_end, lines[thread_number].data(), partial_gosa[k]);
+                }
+            });
+        };
+
+        for (uint n = 0; n < num_updates; n++) {
+            if (!wait_neighbors(process, n+1u)) return false;
+            TRACE_SPAN_BEGIN(ts_update);
+            run_tiles(fields[n % 2u], fields[(n+1u) % 2u], nullptr);
+            TRACE_SPAN_END(ts_update, "slab update", n);
+            slots[process].epoch.store(n+2u, memory_order_release);
+        }
+
+        // the same order of the sums for every number of threads, the squares go to the field the neighbors are done reading
+        if (!wait_neighbors(process, num_updates+1u)) return false;
+        vector<T> partial_gosa(num_tiles, 0.0);
+        run_tiles(fields[num_updates % 2u], gosa_sum == HIMENO_GOSA_LAB ? fields[(num_updates+1u) % 2u] : nullptr, partial_gosa.data());
+        T slab_gosa = 0.0;
+        for (T partial : partial_gosa) slab_gosa += partial;
+        slots[process].gosa = slab_gosa;
+        return true;
+
+    };
+
+    // the other processes, with their own pools on the CPUs of their slabs
+    const topology_t &topology = system_topology();
+    for (uint process = 1u; process < processes; process++) {
+        const pid_t pid = fork();
+        if (pid < 0) {
+            fprintf(stderr, "Could not fork process %u: %s\n", process, strerror(errno));
+            slots[0].failed.store(1u, memory_order_relaxed);
+            break;
+        }
+        if (pid == 0) {
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            const vector<int> cpus = himeno_layout_cpus(layout, topology, process);
+            pin_thread(cpus[0]);
+            bool success;
+            {
+                thread_pool_t slab_pool(layout.threads, cpus);
+                success = run_slab(process, slab_pool);
+            }
+            _exit(success ? 0 : 1);
+        }
+        children.push_back(pid);
+        reaped.push_back(false);
+    }
+
+    const bool success = slots[0].failed.load(memory_order_relaxed) == 0u && run_slab(0u, pool);
+    if (!success) {
+        slots[0].failed.store(1u, memory_order_relaxed);
+        for (size_t i = 0; i < children.size(); i++) if (!reaped[i]) kill(children[i], SIGKILL);
+    }
+    // in any order, a process waiting for one that died only stops once the failure is noticed
+    while (check_children() > 0u) this_thread::sleep_for(chrono::microseconds(CHILD_POLL_US));
+
+    const bool failed = slots[0].failed.load(memory_order_relaxed) != 0u;
+    if (failed) {
+        fprintf(stderr, "A process of the hybrid solver did not finish properly!\n");
+    } else {
+        if (gosa_sum == HIMENO_GOSA_LAB) {
+            const T *squares = fields[(num_updates+1u) % 2u];
+            for (size_t i = 0; i < field_size; i++) gosa += squares[i];
+        } else {
+            for (uint process = 0; process < processes; process++) gosa += (T)slots[process].gosa;
+        }
+        if (result != nullptr) copy_n(fields[num_updates % 2u], field_size, result);
+    }
+
+    munmap(shared, bytes);
+    return !failed;
+
+}
+
+// the library provides both precisions
+template himeno_layout_t himeno_choose_layout<float>( const vec3_uint_t&, const topology_t& );
+template himeno_layout_t himeno_choose_layout<double>( const vec3_uint_t&, const topology_t& );
+template bool jacobi_hybrid<float>( const vec3_uint_t&, uint, const himeno_layout_t&, float&, float*, thread_pool_t&, himeno_gosa_sum_t );
+template bool jacobi_hybrid<double>( const vec3_uint_t&, uint, const himeno_layout_t&, double&, double*, thread_pool_t&, himeno_gosa_sum_t );
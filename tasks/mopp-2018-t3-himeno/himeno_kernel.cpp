@@ -0,0 +1,217 @@
+/*
+ * The jacobi solver of himeno.cpp as library, see himeno.h for the interface. Every row of the
+ * field is a unit of work for the thread pool, so the threads still work on rows close to each
+ * other as with the former atomic row counter.
+ */
+
+#include "himeno.h"
+#include "himeno_row.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+
+// FUNCTIONS
+
+/**
+ * @brief Calculates one row of the field
+ * @param gosa nullptr to write the updated row to wrk, else the residual of the row gets added to it
+ */
+template<typename T>
+static void calculate_row( Matrix<T> &p, Matrix<T> &wrk, int r, T *gosa, mutex *gosa_mutex ) {
+
+    // vars
+    T value;
+    T *ptr_p_data = p.m_pData + r*p.m_uiRowMemoryOffset;
+    T *ptr_wrk_data = wrk.m_pData + r*p.m_uiRowMemoryOffset;
+    int c, d;
+
+    for (c = 0; c < p.m_uiCols; c++) {
+        for (d = 0; d < p.m_uiDeps; d++) {
+
+            // sum up the neighboring values
+            value = (
+                  p.get(r+1,c,d) + p.get(r,c+1,d) + p.get(r,c,d+1)
+                + p.get(r-1,c,d) + p.get(r,c-1,d) + p.get(r,c,d-1)
+            ) / 6.0 - (*ptr_p_data);
+
+            // check if it is last iteration
+            if (gosa == nullptr) {
+                (*ptr_wrk_data) = (*ptr_p_data) + OMEGA*value;
+            } else if (gosa_mutex != nullptr) {
+                gosa_mutex->lock();
+                (*gosa) += value*value;
+                gosa_mutex->unlock();
+            } else {
+                (*gosa) += value*value;
+            }
+
+            // update pointers
+            ptr_p_data++;
+            ptr_wrk_data++;
+
+        }
+    }
+
+}
+
+size_t himeno_field_size( const vec3_uint_t &size ) {
+    return (size_t)(size.x-2) * (size.y-2) * (size.z-2);
+}
+
+template<typename T>
+void himeno_init( const vec3_uint_t &size, T *p, thread_pool_t &pool ) {
+    Matrix<T> m(size.x-2, size.y-2, size.z-2, p);
+    m.set_init(pool);
+}
+
+template<typename T>
+T *jacobi_update( const vec3_uint_t &size, uint num_updates, T *p, T *wrk, thread_pool_t &pool ) {
+
+    for (uint n = 0; n < num_updates; n++) {
+
+        Matrix<T> p_mat(size.x-2, size.y-2, size.z-2, p);
+        Matrix<T> wrk_mat(size.x-2, size.y-2, size.z-2, wrk);
+        TRACE_SPAN_BEGIN(ts_update);
+        pool.run(p_mat.m_uiRows, [&]( uint r, uint ) {
+            calculate_row<T>(p_mat, wrk_mat, r, nullptr, nullptr);
+        });
+        TRACE_SPAN_END(ts_update, "update", n);
+
+        // swap matrices (no copy needed)
+        swap(p, wrk);
+
+    }
+
+    return p;
+
+}
+
+template<typename T>
+T jacobi_gosa( const vec3_uint_t &size, T *p, thread_pool_t &pool ) {
+
+    Matrix<T> p_mat(size.x-2, size.y-2, size.z-2, p);
+    T gosa = 0.0f;
+    TRACE_SCOPE("gosa", p_mat.m_uiRows);
+
+    // float sums into a single gosa (keeps the result of the original), double into one partial result per thread
+    if (is_same<T, float>::value) {
+        mutex gosa_mutex;
+        pool.run(p_mat.m_uiRows, [&]( uint r, uint ) {
+            calculate_row<T>(p_mat, p_mat, r, &gosa, &gosa_mutex);
+        });
+    } else {
+        auto gosa_arr = new T[pool.size()];
+        fill_n(gosa_arr, pool.size(), 0.0f);
+        pool.run(p_mat.m_uiRows, [&]( uint r, uint thread_number ) {
+            calculate_row<T>(p_mat, p_mat, r, gosa_arr + thread_number, nullptr);
+        });
+        for (uint i = 0; i < pool.size(); i++) gosa += gosa_arr[i];
+        delete[] gosa_arr;
+    }
+
+    return gosa;
+
+}
+
+template<typename T>
+T *jacobi_update_async( const vec3_uint_t &size, uint num_updates, uint staleness, T *p, T *wrk, thread_pool_t &pool ) {
+
+    const int rows = size.x-2, cols = size.y-2, deps = size.z-2;
+    const size_t plane = (size_t)cols * deps;
+    const uint num_slabs = min<uint>(pool.size(), rows);
+    if (num_updates == 0 || rows <= 0) return p;
+
+    // a neighbor is at most staleness+1 epochs ahead of the one it reads and at most staleness
+    // behind, so the edges of 2*staleness+2 epochs are enough that a slot is never written while read
+    const uint num_slots = 2u*staleness + 2u;
+    vector<T> edges((size_t)num_slabs * 2u * num_slots * plane);
+    vector<atomic<uint>> epochs(num_slabs);
+    vector<int> first_row(num_slabs + 1u);
+    for (uint s = 0; s <= num_slabs; s++) first_row[s] = (int)((long)rows * s / num_slabs);
+
+    // edge 0 is the first row of a slab, edge 1 the last one
+    auto edge = [&]( uint slab, uint side, uint epoch ) {
+        return edges.data() + (((size_t)slab * 2u + side) * num_slots + epoch % num_slots) * plane;
+    };
+    for (uint s = 0; s < num_slabs; s++) {
+        epochs[s].store(0u, memory_order_relaxed);
+        copy_n(p + first_row[s]*plane, plane, edge(s, 0u, 0u));
+        copy_n(p + (first_row[s+1]-1)*plane, plane, edge(s, 1u, 0u));
+    }
+
+    // one slab per thread, every thread that holds a slab waits only for its two neighbors
+    pool.run(num_slabs, [&]( uint s, uint ) {
+
+        const int begin = first_row[s], end = first_row[s+1];
+        T *current = p, *next = wrk;
+
+        for (uint epoch = 0; epoch < num_updates; epoch++) {
+
+            // the newest epoch of a neighbor that is not newer than the own one, the neighbors
+            // may not fall back more than staleness epochs
+            uint neighbor_epoch[2] = { epoch, epoch };
+            TRACE_SPAN_BEGIN(ts_wait);
+            for (uint side = 0; side < 2u; side++) {
+                if ((side == 0u && s == 0u) || (side == 1u && s+1u == num_slabs)) continue;
+                const atomic<uint> &other = epochs[side == 0u ? s-1u : s+1u];
+                uint observed;
+                for (uint spins = 0; (observed = other.load(memory_order_acquire)) + staleness < epoch; spins++) {
+                    if (spins >= 64u) this_thread::yield();
+                }
+                neighbor_epoch[side] = min(observed, epoch);
+            }
+            TRACE_SPAN_END(ts_wait, "stale wait", epoch);
+
+            const T *below_edge = s > 0u ? edge(s-1u, 1u, neighbor_epoch[0]) : nullptr;
+            const T *above_edge = s+1u < num_slabs ? edge(s+1u, 0u, neighbor_epoch[1]) : nullptr;
+            for (int r = begin; r < end; r++) {
+                const T *below = r > begin ? current + (r-1)*plane : below_edge;
+                const T *above = r+1 < end ? current + (r+1)*plane : above_edge;
+                update_row<T>(below, current + r*plane, above, next + r*plane, nullptr, r, rows, cols, deps, 0, cols);
+            }
+
+            // publish the edges, then the epoch
+            copy_n(next + begin*plane, plane, edge(s, 0u, epoch+1u));
+            copy_n(next + (end-1)*plane, plane, edge(s, 1u, epoch+1u));
+            epochs[s].store(epoch+1u, memory_order_release);
+            swap(current, next);
+
+        }
+
+    });
+
+    // every slab did the same amount of updates
+    return num_updates % 2u == 0u ? p : wrk;
+
+}
+
+template<typename T>
+T jacobi_async( const vec3_uint_t &size, uint num_iterations, uint staleness, T *p, T *wrk, thread_pool_t &pool ) {
+    if (num_iterations == 0) return 0.0f;
+    return jacobi_gosa(size, jacobi_update_async(size, num_iterations-1, staleness, p, wrk, pool), pool);
+}
+
+template<typename T>
+T jacobi( const vec3_uint_t &size, uint num_iterations, T *p, T *wrk, thread_pool_t &pool ) {
+    if (num_iterations == 0) return 0.0f;
+    return jacobi_gosa(size, jacobi_update(size, num_iterations-1, p, wrk, pool), pool);
+}
+
+// the library provides both precisions
+template void himeno_init<float>( const vec3_uint_t&, float*, thread_pool_t& );
+template void himeno_init<double>( const vec3_uint_t&, double*, thread_pool_t& );
+template float *jacobi_update<float>( const vec3_uint_t&, uint, float*, float*, thread_pool_t& );
+template double *jacobi_update<double>( const vec3_uint_t&, uint, double*, double*, thread_pool_t& );
+template float jacobi_gosa<float>( const vec3_uint_t&, float*, thread_pool_t& );
+template double jacobi_gosa<double>( const vec3_uint_t&, double*, thread_pool_t& );
+template float *jacobi_update_async<float>( const vec3_uint_t&, uint, uint, float*, float*, thread_pool_t& );
+template double *jacobi_update_async<double>( const vec3_uint_t&, uint, uint, double*, double*, thread_pool_t& );
+template float jacobi_async<float>( const vec3_uint_t&, uint, uint, float*, float*, thread_pool_t& );
+template double jacobi_async<double>( const vec3_uint_t&, uint, uint, double*, double*, thread_pool_t& );
+template float jacobi<float>( const vec3_uint_t&, uint, float*, float*, thread_pool_t& );
+template double jacobi<double>( const vec3_uint_t&, uint, double*, double*, thread_pool_t& );
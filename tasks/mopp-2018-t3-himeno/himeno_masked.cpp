@@ -0,0 +1,281 @@
+/*
+ * Solver for grids with holes and obstacles, see himeno.h for the interface.
+ *
+ * Only the active cells are stored, run after run along the deps (the runs of a line (r, c) in the
+ * order of d, the lines in the order of r and c). A run is split into segments at every point where
+ * one of the four lines next to it (r+1, c+1, r-1, c-1) starts or ends a run, so within a segment
+ * a neighbor is either the run next to it (at a fixed distance in the fields) or a boundary. Both get
+ * read as scale*field[i] + shift, which is exact for the scales 0 and 1, and the inner loop over a
+ * segment has no branches and gets vectorized. Only the first and the last cell of a run need the
+ * boundary along d. Compute and memory scale with the active cells and the runs, the bounding box
+ * only costs an index of the lines while building.
+ */
+
+#include "himeno.h"
+#include "himeno_row.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+// DEFINES
+#define CHUNK_CELLS 16384u  // active cells per unit of work of the pool
+
+// TYPEDEFS
+
+struct run_t {
+    uint c, d_begin, d_end;
+    size_t offset;
+};
+
+// FUNCTIONS
+
+// the initial pressure of the row like Matrix::get() and set_init(), 0 below and 1 above the field
+template<typename T>
+static inline T initial_pressure( int r, int rows ) {
+    return (T)((r+1)*(r+1)) / (T)((rows+1)*(rows+1));
+}
+
+/**
+ * @brief The scale and shift of a boundary cell, r is its row
+ */
+template<typename T>
+static void boundary( const himeno_boundary_t &spec, int r, int rows, T &scale, T &shift ) {
+    switch (spec.kind) {
+        case HIMENO_INITIAL: scale = 0.0; shift = initial_pressure<T>(r, rows); break;
+        case HIMENO_DIRICHLET: scale = 0.0; shift = spec.value; break;
+        case HIMENO_NEUMANN: scale = 1.0; shift = spec.value; break;
+    }
+}
+
+/**
+ * @brief Updates a segment or adds its residual to gosa
+ * @param wrk The updated field, or with GOSA nullptr or the field for the squares of the residuals
+ */
+template<typename T, bool GOSA>
+static void segment_update( const typename himeno_domain_t<T>::segment_t &s, const T *p, T *__restrict wrk, T &gosa ) {
+
+    // before and after the cell along d, a segment inside a run reads the cells of the segments next to it
+    const T *self = p + s.offset, *before = self - 1, *after = self + 1;
+    const T *up = p + s.neighbors[0], *right = p + s.neighbors[1], *down = p + s.neighbors[2], *left = p + s.neighbors[3];
+    const T up_scale = s.scale[0], right_scale = s.scale[1], down_scale = s.scale[2], left_scale = s.scale[3];
+    const T up_shift = s.shift[0], right_shift = s.shift[1], down_shift = s.shift[2], left_shift = s.shift[3];
+    T *out = wrk != nullptr ? wrk + s.offset : nullptr;
+    T sum = 0.0;
+
+    // the same order of the neighbors as update_row()
+    auto cell = [&]( uint k, T d_above, T d_below ) {
+        const T value = (
+              (up_scale*up[k] + up_shift) + (right_scale*right[k] + right_shift) + d_above
+            + (down_scale*down[k] + down_shift) + (left_scale*left[k] + left_shift) + d_below
+        ) / 6.0 - self[k];
+        if (!GOSA) out[k] = self[k] + OMEGA*value;
+        else if (out != nullptr) out[k] = value*value;
+        else sum += value*value;
+    };
+
+    // the cells at the ends of the run have the boundary along d
+    auto end_cell = [&]( uint k ) {
+        const T below = k == 0u && s.run_begin ? s.run_scale[0]*self[k] + s.run_shift[0] : before[k];
+        const T above = k+1u == s.length && s.run_end ? s.run_scale[1]*self[k] + s.run_shift[1] : after[k];
+        cell(k, above, below);
+    };
+
+    if (s.run_begin) end_cell(0u);
+    const uint last = s.run_end ? s.length - 1u : s.length;
+    for (uint k = s.run_begin ? 1u : 0u; k < last; k++) cell(k, after[k], before[k]);
+    if (s.run_end && (s.length > 1u || !s.run_begin)) end_cell(s.length - 1u);
+
+    if (GOSA) gosa += sum;
+
+}
+
+template<typename T>
+void himeno_domain_build( const vec3_uint_t &size, const function<bool( uint r, uint c, uint d )> &is_active,
+                          const himeno_boundary_t (&boundaries)[HIMENO_NUM_FACES], himeno_domain_t<T> &domain, thread_pool_t &pool ) {
+
+    typedef typename himeno_domain_t<T>::segment_t segment_t;
+    const int rows = size.x-2, cols = size.y-2, deps = size.z-2;
+    domain.size = size;
+    domain.segments.clear();
+    domain.chunks.clear();
+
+    // the runs of every row and the first run of every line
+    vector<vector<run_t>> row_runs(max(rows, 0));
+    vector<vector<uint>> line_begin(max(rows, 0));
+    pool.run(max(rows, 0), [&]( uint r, uint ) {
+        line_begin[r].resize(cols + 1);
+        for (int c = 0; c < cols; c++) {
+            line_begin[r][c] = row_runs[r].size();
+            for (int d = 0; d < deps; ) {
+                if (!is_active(r, c, d)) {
+                    d++;
+                    continue;
+                }
+                const uint d_begin = d;
+                while (d < deps && is_active(r, c, d)) d++;
+                row_runs[r].push_back({ (uint)c, d_begin, (uint)d, 0u });
+            }
+        }
+        line_begin[r][cols] = row_runs[r].size();
+    });
+
+    // the offsets in the fields
+    size_t offset = 0u;
+    domain.num_runs = 0u;
+    for (vector<run_t> &runs : row_runs) {
+        for (run_t &run : runs) {
+            run.offset = offset;
+            offset += run.d_end - run.d_begin;
+        }
+        domain.num_runs += runs.size();
+    }
+    domain.num_cells = offset;
+
+    // split the runs into segments
+    vector<vector<segment_t>> row_segments(max(rows, 0));
+    pool.run(max(rows, 0), [&]( uint r, uint ) {
+
+        const int dr[4] = { 1, 0, -1, 0 }, dc[4] = { 0, 1, 0, -1 };
+        const himeno_face_t faces[4] = { HIMENO_FACE_ROW_END, HIMENO_FACE_COL_END, HIMENO_FACE_ROW_BEGIN, HIMENO_FACE_COL_BEGIN };
+        vector<uint> cuts;
+
+        for (const run_t &run : row_runs[r]) {
+
+            // the runs of the neighbor lines, none if the line is outside of the grid
+            const run_t *neighbor_begin[4], *neighbor_end[4];
+            bool outside[4];
+            for (int k = 0; k < 4; k++) {
+                const int nr = r + dr[k], nc = run.c + dc[k];
+                outside[k] = nr < 0 || nr >= rows || nc < 0 || nc >= cols;
+                neighbor_begin[k] = neighbor_end[k] = nullptr;
+                if (outside[k]) continue;
+                neighbor_begin[k] = row_runs[nr].data() + line_begin[nr][nc];
+                neighbor_end[k] = row_runs[nr].data() + line_begin[nr][nc+1];
+            }
+
+            cuts.assign({ run.d_begin, run.d_end });
+            for (int k = 0; k < 4; k++) {
+                for (const run_t *n = neighbor_begin[k]; n != neighbor_end[k]; n++) {
+                    if (n->d_begin > run.d_begin && n->d_begin < run.d_end) cuts.push_back(n->d_begin);
+                    if (n->d_end > run.d_begin && n->d_end < run.d_end) cuts.push_back(n->d_end);
+                }
+            }
+            sort(cuts.begin(), cuts.end());
+            cuts.erase(unique(cuts.begin(), cuts.end()), cuts.end());
+
+            for (size_t i = 0; i + 1u < cuts.size(); i++) {
+
+                segment_t s;
+                s.r = r;
+                s.c = run.c;
+                s.d = cuts[i];
+                s.length = cuts[i+1] - cuts[i];
+                s.offset = run.offset + (s.d - run.d_begin);
+
+                for (int k = 0; k < 4; k++) {
+                    const run_t *n = neighbor_begin[k];
+                    while (n != neighbor_end[k] && n->d_end <= s.d) n++;
+                    if (n != neighbor_end[k] && n->d_begin <= s.d) {
+                        s.neighbors[k] = n->offset + (s.d - n->d_begin);
+                        s.scale[k] = 1.0;
+                        s.shift[k] = 0.0;
+                    } else {
+                        s.neighbors[k] = s.offset;
+                        boundary<T>(boundaries[outside[k] ? faces[k] : HIMENO_FACE_OBSTACLE], r + dr[k], rows, s.scale[k], s.shift[k]);
+                    }
+                }
+
+                s.run_begin = s.d == run.d_begin;
+                s.run_end = cuts[i+1] == run.d_end;
+                boundary<T>(boundaries[run.d_begin == 0u ? HIMENO_FACE_DEP_BEGIN : HIMENO_FACE_OBSTACLE], r, rows, s.run_scale[0], s.run_shift[0]);
+                boundary<T>(boundaries[run.d_end == (uint)deps ? HIMENO_FACE_DEP_END : HIMENO_FACE_OBSTACLE], r, rows, s.run_scale[1], s.run_shift[1]);
+                row_segments[r].push_back(s);
+
+            }
+        }
+
+    });
+
+    // the segments in the order of the fields, cut into units of work of about the same cells
+    size_t cells = 0u;
+    for (const vector<segment_t> &segments : row_segments) {
+        for (const segment_t &s : segments) {
+            if (domain.chunks.empty() || cells >= CHUNK_CELLS) {
+                domain.chunks.push_back(domain.segments.size());
+                cells = 0u;
+            }
+            domain.segments.push_back(s);
+            cells += s.length;
+        }
+    }
+    domain.chunks.push_back(domain.segments.size());
+
+}
+
+template<typename T>
+void himeno_domain_init( const himeno_domain_t<T> &domain, T *p, thread_pool_t &pool ) {
+    pool.run(domain.chunks.size() - 1u, [&]( uint k, uint ) {
+        for (size_t i = domain.chunks[k]; i < domain.chunks[k+1]; i++) {
+            const typename himeno_domain_t<T>::segment_t &s = domain.segments[i];
+            fill_n(p + s.offset, s.length, initial_pressure<T>(s.r, domain.size.x-2));
+        }
+    });
+}
+
+template<typename T>
+T *jacobi_domain_update( const himeno_domain_t<T> &domain, uint num_updates, T *p, T *wrk, thread_pool_t &pool ) {
+
+    for (uint n = 0; n < num_updates; n++) {
+        TRACE_SPAN_BEGIN(ts_update);
+        pool.run(domain.chunks.size() - 1u, [&]( uint k, uint ) {
+            T unused;
+            for (size_t i = domain.chunks[k]; i < domain.chunks[k+1]; i++) segment_update<T, false>(domain.segments[i], p, wrk, unused);
+        });
+        TRACE_SPAN_END(ts_update, "domain update", n);
+        swap(p, wrk);
+    }
+    return p;
+
+}
+
+template<typename T>
+T jacobi_domain_gosa( const himeno_domain_t<T> &domain, const T *p, thread_pool_t &pool, himeno_gosa_sum_t gosa_sum ) {
+
+    // the squares of the residuals in the order of the fields for the sum of the lab
+    vector<T> partial_gosa(domain.chunks.size() - 1u, 0.0);
+    vector<T> squares(gosa_sum == HIMENO_GOSA_LAB ? domain.num_cells : 0u);
+    TRACE_SCOPE("domain gosa", partial_gosa.size());
+    pool.run(partial_gosa.size(), [&]( uint k, uint ) {
+        T *out = squares.empty() ? nullptr : squares.data();
+        for (size_t i = domain.chunks[k]; i < domain.chunks[k+1]; i++) segment_update<T, true>(domain.segments[i], p, out, partial_gosa[k]);
+    });
+
+    T gosa = 0.0;
+    if (gosa_sum == HIMENO_GOSA_LAB) {
+        for (T square : squares) gosa += square;
+    } else {
+        for (T partial : partial_gosa) gosa += partial;
+    }
+    return gosa;
+
+}
+
+template<typename T>
+T jacobi_domain( const himeno_domain_t<T> &domain, uint num_iterations, T *p, T *wrk, thread_pool_t &pool, himeno_gosa_sum_t gosa_sum ) {
+    if (num_iterations == 0) return 0.0f;
+    return jacobi_domain_gosa(domain, jacobi_domain_update(domain, num_iterations-1, p, wrk, pool), pool, gosa_sum);
+}
+
+// the library provides both precisions
+template void himeno_domain_build<float>( const vec3_uint_t&, const function<bool( uint, uint, uint )>&, const himeno_boundary_t (&)[HIMENO_NUM_FACES], himeno_domain_t<float>&, thread_pool_t& );
+template void himeno_domain_build<double>( const vec3_uint_t&, const function<bool( uint, uint, uint )>&, const himeno_boundary_t (&)[HIMENO_NUM_FACES], himeno_domain_t<double>&, thread_pool_t& );
+template void himeno_domain_init<float>( const himeno_domain_t<float>&, float*, thread_pool_t& );
+template void himeno_domain_init<double>( const himeno_domain_t<double>&, double*, thread_pool_t& );
+template float *jacobi_domain_update<float>( const himeno_domain_t<float>&, uint, float*, float*, thread_pool_t& );
+template double *jacobi_domain_update<double>( const himeno_domain_t<double>&, uint, double*, double*, thread_pool_t& );
+template float jacobi_domain_gosa<float>( const himeno_domain_t<float>&, const float*, thread_pool_t&, himeno_gosa_sum_t );
+template double jacobi_domain_gosa<double>( const himeno_domain_t<double>&, const double*, thread_pool_t&, himeno_gosa_sum_t );
+template float jacobi_domain<float>( const himeno_domain_t<float>&, uint, float*, float*, thread_pool_t&, himeno_gosa_sum_t );
+template double jacobi_domain<double>( const himeno_domain_t<double>&, uint, double*, double*, thread_pool_t&, himeno_gosa_sum_t );
@@ -0,0 +1,49 @@
+#ifndef __HEADER_HIMENO_ROW__
+#define __HEADER_HIMENO_ROW__
+
+/*
+ * The stencil of one row (r-plane) on plain pointers, for the solvers that do not keep the
+ * whole field in one Matrix (himeno_kernel.cpp, himeno_stream.cpp). Gives the same values as
+ * calculate_row() with its Matrix::get().
+ */
+
+// DEFINES
+#define OMEGA 0.8
+
+// FUNCTIONS
+
+/**
+ * @brief Updates the columns [c_begin, c_end) of row r
+ * @param below The row r-1, nullptr for the boundary below the field
+ * @param above The row r+1, nullptr for the boundary above the field
+ * @param gosa nullptr to write the updated row to out, else the residual gets added to it, or its
+ * squares get written to out if out is given (for a sum in the order of the lab)
+ */
+template<typename T>
+static inline void update_row( const T *below, const T *row, const T *above, T *out, T *gosa, int r, int rows, int cols, int deps, int c_begin, int c_end ) {
+
+    // the values of Matrix::get() outside of the field
+    const T lower_boundary = 0.0, upper_boundary = 1.0;
+    const T side_boundary = (T)((r+1)*(r+1)) / (T)((rows+1)*(rows+1));
+    int c, d, i;
+
+    for (c = c_begin; c < c_end; c++) {
+        for (d = 0; d < deps; d++) {
+            i = c*deps + d;
+            const T value = (
+                  (above != nullptr ? above[i] : upper_boundary)
+                + (c+1 < cols ? row[i+deps] : side_boundary)
+                + (d+1 < deps ? row[i+1] : side_boundary)
+                + (below != nullptr ? below[i] : lower_boundary)
+                + (c > 0 ? row[i-deps] : side_boundary)
+                + (d > 0 ? row[i-1] : side_boundary)
+            ) / 6.0 - row[i];
+            if (gosa == nullptr) out[i] = row[i] + OMEGA*value;
+            else if (out != nullptr) out[i] = value*value;
+            else (*gosa) += value*value;
+        }
+    }
+
+}
+
+#endif
@@ -0,0 +1,248 @@
+/*
+ * Out of core solver for fields that do not fit into the memory, see himeno.h for the interface.
+ *
+ * The fields are files that are mapped as a whole, but only a window of rows (r-planes) is in
+ * memory at any time: the rows ahead of the window get requested from the kernel (readahead
+ * runs while the current rows are calculated), the rows behind it get written back and released.
+ *
+ * Every pass over the files applies up to temporal_block updates (temporal blocking). The pass
+ * streams the rows of its input once and keeps three rows of every update in between in memory:
+ * as soon as row i of the input is there, update 1 can calculate row i-1, update 2 row i-2 and
+ * so on, and the last update writes row i-temporal_block to the output file. The gosa of the
+ * last iteration is calculated in the last pass the same way, so its result never gets written.
+ * By default its squares are summed in the order of the cells like the lab (with one thread) does.
+ * The first pass generates the initial field instead of reading it.
+ */
+
+#include "himeno.h"
+#include "himeno_row.h"
+
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+using namespace std;
+
+// DEFINES
+#define PREFETCH_ROWS 4     // rows the readahead is ahead of the window
+
+// TYPEDEFS
+
+/**
+ * @brief A field in an unlinked file in the given directory, mapped as a whole
+ */
+template<typename T>
+class field_file_t {
+
+    public:
+
+        field_file_t( const string &directory, size_t row_size, size_t num_rows ) :
+            m_uiRowSize(row_size), m_uiNumRows(num_rows)
+        {
+            string path = directory + "/himeno-XXXXXX";
+            m_iFd = mkstemp(&path[0]);
+            if (m_iFd < 0) return;
+            unlink(path.c_str());
+            const size_t bytes = row_size * num_rows * sizeof(T);
+            if (ftruncate(m_iFd, bytes) != 0) return;
+            void *data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_iFd, 0);
+            if (data == MAP_FAILED) return;
+            m_pData = (T*)data;
+            madvise(data, bytes, MADV_SEQUENTIAL);
+        }
+
+        ~field_file_t()
+        {
+            if (m_pData != nullptr) munmap(m_pData, m_uiRowSize * m_uiNumRows * sizeof(T));
+            if (m_iFd >= 0) close(m_iFd);
+        }
+
+        field_file_t( const field_file_t& ) = delete;
+        field_file_t &operator=( const field_file_t& ) = delete;
+
+        bool is_open() const { return m_pData != nullptr; }
+
+        T *row( long r ) { return m_pData + r * m_uiRowSize; }
+
+        /**
+         * @brief Starts reading the row in the background
+         */
+        void prefetch( long r )
+        {
+            if (r >= 0 && (size_t)r < m_uiNumRows) madvise(page_begin(r), page_length(r), MADV_WILLNEED);
+        }
+
+        /**
+         * @brief Starts writing the row back to the file
+         */
+        void write_back( long r )
+        {
+            if (r >= 0 && (size_t)r < m_uiNumRows) sync_file_range(m_iFd, (char*)page_begin(r) - (char*)m_pData, page_length(r), SYNC_FILE_RANGE_WRITE);
+        }
+
+        /**
+         * @brief Drops the row from the memory of the process, the page cache keeps it as long as
+         * there is space
+         */
+        void release( long r )
+        {
+            if (r >= 0 && (size_t)r < m_uiNumRows) madvise(page_begin(r), page_length(r), MADV_DONTNEED);
+        }
+
+    private:
+
+        const size_t m_uiRowSize;
+        const size_t m_uiNumRows;
+        int m_iFd = -1;
+        T *m_pData = nullptr;
+
+        // the pages a row lies in, the first and last one may be shared with the rows next to it
+        void *page_begin( long r )
+        {
+            const uintptr_t page = sysconf(_SC_PAGESIZE);
+            return (void*)((uintptr_t)row(r) & ~(page - 1u));
+        }
+
+        size_t page_length( long r )
+        {
+            return (char*)row(r + 1) - (char*)page_begin(r);
+        }
+
+};
+
+// FUNCTIONS
+
+/**
+ * @brief One pass over the field: num_updates updates, then the gosa if gosa is given
+ * @param input nullptr for the initial field
+ * @param output nullptr if the pass ends with the gosa
+ */
+template<typename T>
+static void stream_pass( const vec3_uint_t &size, uint num_updates, field_file_t<T> *input, field_file_t<T> *output, T *gosa, himeno_gosa_sum_t gosa_sum,
+                         thread_pool_t &pool ) {
+
+    const int rows = size.x-2, cols = size.y-2, deps = size.z-2;
+    const size_t row_size = (size_t)cols * deps;
+    const int num_stages = num_updates + (gosa != nullptr ? 1 : 0);
+    const uint num_chunks = min<uint>(cols, pool.size() * 4u);
+
+    // three rows per stage, the first stage (the input) only if it gets generated
+    vector<T> window((size_t)(num_stages + 1) * 3u * row_size);
+    vector<T> partial_gosa(num_chunks);
+    vector<T> squares(gosa != nullptr && gosa_sum == HIMENO_GOSA_LAB ? row_size : 0u);
+    auto ring = [&]( int stage, int r ) { return window.data() + ((size_t)stage * 3u + r % 3) * row_size; };
+
+    // row r after the given amount of stages, nullptr for the boundaries
+    auto stage_row = [&]( int stage, int r ) -> T* {
+        if (r < 0 || r >= rows) return nullptr;
+        if (stage == 0 && input != nullptr) return input->row(r);
+        if (stage == (int)num_updates && output != nullptr) return output->row(r);
+        return ring(stage, r);
+    };
+
+    for (long i = 0; i < rows + num_stages; i++) {
+
+        // the next row of the input
+        if (i < rows) {
+            TRACE_SPAN_BEGIN(ts_input);
+            if (input == nullptr) fill_n(ring(0, i), row_size, (T)((i+1)*(i+1)) / (T)((rows+1)*(rows+1)));
+            else input->prefetch(i + PREFETCH_ROWS);
+            TRACE_SPAN_END(ts_input, "input row", i);
+        }
+
+        // every stage one row behind the one before
+        for (int stage = 1; stage <= num_stages; stage++) {
+            const int r = i - stage;
+            if (r < 0 || r >= rows) continue;
+            const T *below = stage_row(stage-1, r-1), *row = stage_row(stage-1, r), *above = stage_row(stage-1, r+1);
+            const bool is_gosa = stage > (int)num_updates;
+            T *out = is_gosa ? (squares.empty() ? nullptr : squares.data()) : stage_row(stage, r);
+            TRACE_SPAN_BEGIN(ts_stage);
+            pool.run(num_chunks, [&]( uint k, uint ) {
+                const int c_begin = (int)((long)cols * k / num_chunks), c_end = (int)((long)cols * (k+1) / num_chunks);
+                T chunk_gosa = 0.0;
+                update_row<T>(below, row, above, out, is_gosa ? &chunk_gosa : nullptr, r, rows, cols, deps, c_begin, c_end);
+                partial_gosa[k] = chunk_gosa;
+            });
+            TRACE_SPAN_END(ts_stage, "stage row", stage);
+
+            // the same order for every number of threads, the one of the lab with the squares
+            if (is_gosa && !squares.empty()) {
+                for (size_t k = 0; k < row_size; k++) (*gosa) += squares[k];
+            } else if (is_gosa) {
+                for (uint k = 0; k < num_chunks; k++) (*gosa) += partial_gosa[k];
+            } else if (stage == (int)num_updates && output != nullptr) {
+                output->write_back(r);
+                output->release(r - 1);
+            }
+        }
+
+        // the first stage does not need the row two below the new one anymore
+        if (input != nullptr) input->release(i - 2);
+
+    }
+
+    if (output != nullptr) output->release(rows - 1);
+
+}
+
+template<typename T>
+size_t himeno_stream_window( const vec3_uint_t &size, uint temporal_block ) {
+    // the rings of the stages, the rows of the input from the oldest one needed to the readahead, the last rows of the output,
+    // the squares of the gosa
+    return ((size_t)(max(temporal_block, 1u) + 2u) * 3u + 3u + PREFETCH_ROWS + 3u) * (size.y-2) * (size.z-2) * sizeof(T);
+}
+
+template<typename T>
+bool jacobi_stream( const vec3_uint_t &size, uint num_iterations, uint temporal_block, const char *directory, T &gosa, thread_pool_t &pool,
+                    himeno_gosa_sum_t gosa_sum ) {
+
+    gosa = 0.0;
+    if (num_iterations == 0) return true;
+    if (temporal_block == 0) temporal_block = 1;
+    const size_t row_size = (size_t)(size.y-2) * (size.z-2);
+    const uint num_updates = num_iterations - 1;
+
+    // two files, only needed if there is more than one pass
+    field_file_t<T> *files[2] = { nullptr, nullptr };
+    if (num_updates > temporal_block) {
+        for (int f = 0; f < 2; f++) {
+            files[f] = new field_file_t<T>(directory, row_size, size.x-2);
+            if (!files[f]->is_open()) {
+                fprintf(stderr, "Could not create a field in %s: %s\n", directory, strerror(errno));
+                delete files[0];
+                delete files[1];
+                return false;
+            }
+        }
+    }
+
+    // the last pass does the remaining updates and the gosa
+    field_file_t<T> *input = nullptr;
+    uint done = 0, pass = 0;
+    for (; num_updates - done > temporal_block; done += temporal_block, pass++) {
+        field_file_t<T> *output = files[pass % 2u];
+        stream_pass<T>(size, temporal_block, input, output, nullptr, gosa_sum, pool);
+        input = output;
+    }
+    stream_pass<T>(size, num_updates - done, input, nullptr, &gosa, gosa_sum, pool);
+
+    delete files[0];
+    delete files[1];
+    return true;
+
+}
+
+// the library provides both precisions
+template size_t himeno_stream_window<float>( const vec3_uint_t&, uint );
+template size_t himeno_stream_window<double>( const vec3_uint_t&, uint );
+template bool jacobi_stream<float>( const vec3_uint_t&, uint, uint, const char*, float&, thread_pool_t&, himeno_gosa_sum_t );
+template bool jacobi_stream<double>( const vec3_uint_t&, uint, uint, const char*, double&, thread_pool_t&, himeno_gosa_sum_t );
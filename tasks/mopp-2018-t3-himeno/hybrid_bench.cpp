@@ -0,0 +1,143 @@
+/*
+ * The hybrid solver (processes x threads x vector lanes, himeno_hybrid.cpp) against the flat one
+ *
+ * Usage: ./hybrid_bench [--grid 129,129,257] [--iterations 40] [--cores 56] [--layouts auto,1x56,2x28,4x14]
+ *
+ * Runs the whole benchmark (initialization, the updates and the gosa) for
+ *  - flat: himeno_init(), jacobi_update() and jacobi_gosa() of the library, one pool of --cores
+ *    threads over the rows (the former current_row counter)
+ *  - every layout: auto is the one of himeno_choose_layout(), PxT is P processes with T threads
+ *    each and the tiles of the auto layout
+ * and prints the time (best of three runs) and the gosa. The updates are timed apart from the
+ * initialization and the gosa, the float gosa of the lab takes a mutex per cell in flat, so the
+ * speedup is the one of the updates only. A layout runs once with all iterations and once with
+ * one (initialization and gosa only), its updates are the difference. The field of every layout
+ * is checked against the one of jacobi_update() bitwise. The gosa of flat is the float sum of the
+ * lab, the layouts sum it in the same order, so it matches the one of flat with one thread.
+ */
+
+#include "himeno.h"
+#include "../benchmark/split.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+// FUNCTIONS
+
+int main( int argc, char *argv[] ) {
+
+    const topology_t &topology = system_topology();
+    vector<uint> grid = { 129, 129, 257 };
+    vector<string> layouts;
+    uint num_iterations = 40, cores = topology.threads(THREADS_PHYSICAL_CORES);
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--grid") == 0) {
+            grid.clear();
+            for (const string &value : split(argv[i+1], ',')) grid.push_back(strtoul(value.c_str(), NULL, 10));
+        } else if (strcmp(argv[i], "--iterations") == 0) {
+            num_iterations = max(2ul, strtoul(argv[i+1], NULL, 10));
+        } else if (strcmp(argv[i], "--cores") == 0) {
+            cores = max(1ul, strtoul(argv[i+1], NULL, 10));
+        } else if (strcmp(argv[i], "--layouts") == 0) {
+            layouts = split(argv[i+1], ',');
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (grid.size() != 3u || *min_element(grid.begin(), grid.end()) < 3u) {
+        fprintf(stderr, "The grid needs rows,cols,deps of at least 3\n");
+        return 1;
+    }
+
+    // auto and the splits of the cores into powers of two processes
+    if (layouts.empty()) {
+        layouts.push_back("auto");
+        for (uint processes = 1u; processes <= cores; processes *= 2u) layouts.push_back(to_string(processes) + "x" + to_string(cores / processes));
+    }
+
+    const vec3_uint_t size(grid[0], grid[1], grid[2]);
+    const size_t field_size = himeno_field_size(size);
+    printf("Topology: %s\n", describe_topology(topology).c_str());
+    printf("Grid %ux%ux%u, %u iterations, %u cores\n\n", size.x, size.y, size.z, num_iterations, cores);
+
+    // the flat solver and the field to compare with, the same as jacobi() with the updates timed apart
+    vector<float> p(field_size), wrk(field_size), expected(field_size), field(field_size);
+    double flat_updates = 1.0e30, flat_rest = 1.0e30;
+    float flat_gosa = 0.0f;
+    {
+        thread_pool_t pool(cores, topology.thread_cpus(cores));
+        for (int repetition = 0; repetition < 3; repetition++) {
+            const auto ts_begin = chrono::steady_clock::now();
+            himeno_init(size, p.data(), pool);
+            himeno_init(size, wrk.data(), pool);
+            const auto ts_updates = chrono::steady_clock::now();
+            float *flat_field = jacobi_update(size, num_iterations-1, p.data(), wrk.data(), pool);
+            const auto ts_gosa = chrono::steady_clock::now();
+            flat_gosa = jacobi_gosa(size, flat_field, pool);
+            const auto ts_end = chrono::steady_clock::now();
+            flat_updates = min(flat_updates, chrono::duration<double>(ts_gosa - ts_updates).count());
+            flat_rest = min(flat_rest, chrono::duration<double>((ts_updates - ts_begin) + (ts_end - ts_gosa)).count());
+            copy_n(flat_field, field_size, expected.begin());
+        }
+    }
+    const uint num_updates = num_iterations - 1u;
+
+    printf("%-8s %9s %7s %10s %8s %13s %8s %12s %10s %s\n", "layout", "processes", "threads", "tile", "ms", "ms_per_update", "speedup",
+        "init_gosa_ms", "gosa", "field");
+    printf("%-8s %9u %7u %10s %8.1f %13.3f %8.2f %12.1f %10.6f %s\n", "flat", 1u, cores, "rows", (flat_updates + flat_rest) * 1.0e3,
+        flat_updates / num_updates * 1.0e3, 1.0, flat_rest * 1.0e3, flat_gosa, "-");
+
+    const himeno_layout_t chosen = himeno_choose_layout<float>(size, topology);
+    bool all_match = true;
+    for (const string &name : layouts) {
+
+        himeno_layout_t layout = chosen;
+        if (name != "auto") {
+            const vector<string> parts = split(name, 'x');
+            if (parts.size() != 2u || strtoul(parts[0].c_str(), NULL, 10) == 0u || strtoul(parts[1].c_str(), NULL, 10) == 0u) {
+                fprintf(stderr, "Invalid layout %s, expected processes x threads like 2x28\n", name.c_str());
+                return 1;
+            }
+            layout.processes = strtoul(parts[0].c_str(), NULL, 10);
+            layout.threads = strtoul(parts[1].c_str(), NULL, 10);
+        }
+
+        thread_pool_t pool(layout.threads, himeno_layout_cpus(layout, topology, 0));
+        double seconds = 1.0e30, rest = 1.0e30;
+        float gosa = 0.0f, unused;
+        for (int repetition = 0; repetition < 3; repetition++) {
+            auto ts_begin = chrono::steady_clock::now();
+            if (!jacobi_hybrid(size, num_iterations, layout, gosa, (float*)nullptr, pool)) return 1;
+            seconds = min(seconds, chrono::duration<double>(chrono::steady_clock::now() - ts_begin).count());
+            ts_begin = chrono::steady_clock::now();
+            if (!jacobi_hybrid(size, 1u, layout, unused, (float*)nullptr, pool)) return 1;
+            rest = min(rest, chrono::duration<double>(chrono::steady_clock::now() - ts_begin).count());
+        }
+        const double updates = max(seconds - rest, 0.0);
+
+        // the field the gosa of the last iteration is calculated on
+        float field_gosa;
+        if (!jacobi_hybrid(size, num_iterations, layout, field_gosa, field.data(), pool)) return 1;
+        const bool same = field == expected;
+        all_match = all_match && same;
+
+        char tile[32];
+        snprintf(tile, sizeof(tile), "%ux%u", layout.tile_cols, layout.tile_deps);
+        printf("%-8s %9u %7u %10s %8.1f %13.3f %8.2f %12.1f %10.6f %s\n", name.c_str(), layout.processes, layout.threads, tile,
+            seconds * 1.0e3, updates / num_updates * 1.0e3, flat_updates / updates, rest * 1.0e3, gosa, same ? "matches" : "DIFFERS");
+        fflush(stdout);
+
+    }
+
+    return all_match ? 0 : 1;
+
+}
@@ -0,0 +1,279 @@
+/*
+ * The solver for grids with holes and obstacles (himeno_masked.cpp) against the dense library solver
+ *
+ * Usage: ./masked_bench [--grid 65,65,129] [--iterations 50] [--threads 4] [--geometry box,spheres,pipe]
+ *                       [--face obstacle=neumann:0] ...
+ *
+ * Geometries (the active cells):
+ *  - box: all cells, with the default boundaries the field has to be the one of jacobi_update()
+ *    (checked bitwise) and the gosa the one of jacobi() with one thread
+ *  - spheres: a lattice of spherical obstacles every 16 cells
+ *  - pipe: a cylinder along the rows with a radius of a fifth of the smaller side, the rest is solid
+ * Faces: row-begin, row-end, col-begin, col-end, dep-begin, dep-end and obstacle, each with
+ * initial (default), dirichlet:<value> or neumann:<value>.
+ *
+ * Prints per geometry the active cells, the runs and segments, the memory of the two fields, the
+ * time per update (best of three runs) and the active cells updated per second.
+ *
+ * Before that the solver is checked bitwise against a brute force one on a small grid with
+ * obstacles of every size down to single cells, once with every kind of boundary on all faces.
+ */
+
+#include "himeno.h"
+#include "../benchmark/split.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+// FUNCTIONS
+
+static bool parse_face( const string &text, himeno_boundary_t (&boundaries)[HIMENO_NUM_FACES] )
+{
+    static const char *names[HIMENO_NUM_FACES] = { "row-begin", "row-end", "col-begin", "col-end", "dep-begin", "dep-end", "obstacle" };
+    const size_t equals = text.find('=');
+    if (equals == string::npos) return false;
+    const string name = text.substr(0, equals), kind = text.substr(equals + 1u);
+    const int face = find(names, names + HIMENO_NUM_FACES, name) - names;
+    if (face == HIMENO_NUM_FACES) return false;
+    himeno_boundary_t &boundary = boundaries[face];
+    if (kind == "initial") boundary.kind = HIMENO_INITIAL;
+    else if (kind.compare(0, 10, "dirichlet:") == 0) boundary.kind = HIMENO_DIRICHLET;
+    else if (kind.compare(0, 8, "neumann:") == 0) boundary.kind = HIMENO_NEUMANN;
+    else return false;
+    if (boundary.kind != HIMENO_INITIAL) boundary.value = atof(kind.c_str() + kind.find(':') + 1u);
+    return true;
+}
+
+static function<bool( uint, uint, uint )> geometry( const string &name, const vec3_uint_t &size )
+{
+    const double cols = size.y-2, deps = size.z-2;
+    if (name == "box") return []( uint, uint, uint ) { return true; };
+    if (name == "spheres") {
+        return []( uint r, uint c, uint d ) {
+            const double x = (int)(r % 16u) - 8, y = (int)(c % 16u) - 8, z = (int)(d % 16u) - 8;
+            return x*x + y*y + z*z > 6.0*6.0;
+        };
+    }
+    if (name == "pipe") {
+        const double radius = min(cols, deps) / 5.0;
+        return [=]( uint, uint c, uint d ) {
+            const double y = c - (cols-1.0) / 2.0, z = d - (deps-1.0) / 2.0;
+            return y*y + z*z <= radius*radius;
+        };
+    }
+    return nullptr;
+}
+
+/**
+ * @brief The geometry of the reference check: a sphere and a pattern of single solid cells, so there
+ * are runs and segments of every length and boundaries in all six directions
+ */
+static bool check_active( uint r, uint c, uint d )
+{
+    const double x = (int)r - 6, y = (int)c - 7, z = (int)d - 9;
+    return x*x + y*y + z*z > 4.0*4.0 && (r*7u + c*13u + d*5u) % 11u != 0u;
+}
+
+/**
+ * @brief The neighbor of a cell as the boundaries define it, r is the row of the neighbor
+ */
+static float reference_boundary( const himeno_boundary_t &spec, int r, int rows, float self )
+{
+    switch (spec.kind) {
+        case HIMENO_INITIAL: return (float)((r+1)*(r+1)) / (float)((rows+1)*(rows+1));
+        case HIMENO_DIRICHLET: return (float)spec.value;
+        case HIMENO_NEUMANN: return self + (float)spec.value;
+    }
+    return 0.0f;
+}
+
+/**
+ * @brief Runs num_updates updates of the domain solver and of a brute force one on the bounding box,
+ * which looks up every neighbor on its own, and compares the active cells bitwise
+ */
+static bool reference_check( const vec3_uint_t &size, uint num_updates, const himeno_boundary_t (&boundaries)[HIMENO_NUM_FACES], thread_pool_t &pool )
+{
+    const int rows = size.x-2, cols = size.y-2, deps = size.z-2;
+    const size_t plane = (size_t)cols * deps;
+    auto index = [&]( int r, int c, int d ) { return r*plane + (size_t)c*deps + d; };
+    auto active = [&]( int r, int c, int d ) {
+        return r >= 0 && r < rows && c >= 0 && c < cols && d >= 0 && d < deps && check_active(r, c, d);
+    };
+
+    // the cell or the boundary of the face the neighbor lies behind
+    vector<float> p(himeno_field_size(size)), wrk(p.size());
+    auto neighbor = [&]( int r, int c, int d, himeno_face_t face, float self ) {
+        if (active(r, c, d)) return p[index(r, c, d)];
+        const bool outside = r < 0 || r >= rows || c < 0 || c >= cols || d < 0 || d >= deps;
+        return reference_boundary(boundaries[outside ? face : HIMENO_FACE_OBSTACLE], r, rows, self);
+    };
+
+    for (int r = 0; r < rows; r++) fill_n(p.begin() + r*plane, plane, (float)((r+1)*(r+1)) / (float)((rows+1)*(rows+1)));
+    for (uint n = 0; n < num_updates; n++) {
+        for (int r = 0; r < rows; r++) {
+            for (int c = 0; c < cols; c++) {
+                for (int d = 0; d < deps; d++) {
+                    if (!active(r, c, d)) continue;
+                    const float self = p[index(r, c, d)];
+                    const float value = (
+                          neighbor(r+1, c, d, HIMENO_FACE_ROW_END, self) + neighbor(r, c+1, d, HIMENO_FACE_COL_END, self)
+                        + neighbor(r, c, d+1, HIMENO_FACE_DEP_END, self) + neighbor(r-1, c, d, HIMENO_FACE_ROW_BEGIN, self)
+                        + neighbor(r, c-1, d, HIMENO_FACE_COL_BEGIN, self) + neighbor(r, c, d-1, HIMENO_FACE_DEP_BEGIN, self)
+                    ) / 6.0 - self;
+                    wrk[index(r, c, d)] = self + 0.8*value;
+                }
+            }
+        }
+        swap(p, wrk);
+    }
+
+    himeno_domain_t<float> domain;
+    himeno_domain_build(size, check_active, boundaries, domain, pool);
+    vector<float> domain_p(domain.num_cells), domain_wrk(domain.num_cells);
+    himeno_domain_init(domain, domain_p.data(), pool);
+    const float *result = jacobi_domain_update(domain, num_updates, domain_p.data(), domain_wrk.data(), pool);
+
+    size_t cells = 0u;
+    for (const himeno_domain_t<float>::segment_t &s : domain.segments) {
+        if (memcmp(result + s.offset, &p[index(s.r, s.c, s.d)], s.length * sizeof(float)) != 0) return false;
+        cells += s.length;
+    }
+    size_t expected = 0u;
+    for (int r = 0; r < rows; r++) for (int c = 0; c < cols; c++) for (int d = 0; d < deps; d++) expected += active(r, c, d) ? 1u : 0u;
+    return cells == expected && domain.num_cells == expected;
+}
+
+/**
+ * @brief Best time of three runs of num_iterations-1 updates on the initial field
+ * @return The field after the updates (p or wrk)
+ */
+template<typename F>
+static float *timed( F update, float *p, float *wrk, double &seconds )
+{
+    float *result = p;
+    seconds = 1.0e30;
+    for (int repetition = 0; repetition < 3; repetition++) {
+        const auto ts_begin = chrono::steady_clock::now();
+        result = update();
+        seconds = min(seconds, chrono::duration<double>(chrono::steady_clock::now() - ts_begin).count());
+    }
+    return result;
+}
+
+int main( int argc, char *argv[] ) {
+
+    const topology_t &topology = system_topology();
+    vector<uint> grid = { 65, 65, 129 };
+    vector<string> geometries = { "box", "spheres", "pipe" };
+    uint num_iterations = 50, threads = topology.threads(THREADS_PHYSICAL_CORES);
+    himeno_boundary_t boundaries[HIMENO_NUM_FACES];
+    bool default_boundaries = true;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--grid") == 0) {
+            grid.clear();
+            for (const string &value : split(argv[i+1], ',')) grid.push_back(strtoul(value.c_str(), NULL, 10));
+        } else if (strcmp(argv[i], "--iterations") == 0) {
+            num_iterations = max(2ul, strtoul(argv[i+1], NULL, 10));
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            threads = max(1ul, strtoul(argv[i+1], NULL, 10));
+        } else if (strcmp(argv[i], "--geometry") == 0) {
+            geometries = split(argv[i+1], ',');
+        } else if (strcmp(argv[i], "--face") == 0 && parse_face(argv[i+1], boundaries)) {
+            default_boundaries = false;
+        } else {
+            fprintf(stderr, "Unknown or invalid option %s %s\n", argv[i], argv[i+1]);
+            return 1;
+        }
+    }
+    if (grid.size() != 3u || *min_element(grid.begin(), grid.end()) < 3u) {
+        fprintf(stderr, "The grid needs rows,cols,deps of at least 3\n");
+        return 1;
+    }
+
+    const vec3_uint_t size(grid[0], grid[1], grid[2]);
+    thread_pool_t pool(threads, topology.thread_cpus(threads));
+    printf("Topology: %s\n", describe_topology(topology).c_str());
+
+    // every kind of boundary on all faces, with the values the scales and shifts would get wrong
+    const char *kinds[3] = { "initial", "dirichlet", "neumann" };
+    printf("Reference check on 14x16x20:");
+    for (int kind = 0; kind < 3; kind++) {
+        himeno_boundary_t check_boundaries[HIMENO_NUM_FACES];
+        for (int face = 0; face < HIMENO_NUM_FACES; face++) {
+            check_boundaries[face].kind = kind == 0 ? HIMENO_INITIAL : kind == 1 ? HIMENO_DIRICHLET : HIMENO_NEUMANN;
+            check_boundaries[face].value = kind == 1 ? 0.125 * (face + 1) : 0.01 * (face - 3);
+        }
+        const bool same = reference_check(vec3_uint_t(14, 16, 20), 6u, check_boundaries, pool);
+        printf(" %s %s", kinds[kind], same ? "matches" : "DIFFERS");
+        if (!same) {
+            printf("\n");
+            return 1;
+        }
+    }
+    printf("\n");
+    printf("Grid %ux%ux%u, %u iterations, %u threads\n\n", size.x, size.y, size.z, num_iterations, threads);
+
+    // the dense solver on the bounding box
+    const size_t box_cells = himeno_field_size(size);
+    vector<float> dense_p(box_cells), dense_wrk(box_cells);
+    double dense_seconds;
+    const float *dense_result = timed([&]() {
+        himeno_init(size, dense_p.data(), pool);
+        return jacobi_update(size, num_iterations-1, dense_p.data(), dense_wrk.data(), pool);
+    }, dense_p.data(), dense_wrk.data(), dense_seconds);
+    const float dense_gosa = jacobi_gosa(size, const_cast<float*>(dense_result), pool);
+    const double dense_per_update = dense_seconds / (num_iterations-1);
+
+    printf("%-9s %7s %9s %9s %10s %9s %10s %10s %8s %10s\n", "geometry", "active", "runs", "segments", "build_ms",
+        "field_MiB", "ms_per_it", "Mcells/s", "speedup", "gosa");
+    printf("%-9s %6.1f%% %9s %9s %10s %9.2f %10.3f %10.1f %8.2f %10.6f\n", "dense", 100.0, "-", "-", "-",
+        2.0 * box_cells * sizeof(float) / 1048576.0, dense_per_update * 1.0e3, box_cells / dense_per_update / 1.0e6, 1.0, dense_gosa);
+
+    for (const string &name : geometries) {
+
+        const function<bool( uint, uint, uint )> is_active = geometry(name, size);
+        if (!is_active) {
+            fprintf(stderr, "Unknown geometry %s\n", name.c_str());
+            return 1;
+        }
+
+        himeno_domain_t<float> domain;
+        const auto ts_build = chrono::steady_clock::now();
+        himeno_domain_build(size, is_active, boundaries, domain, pool);
+        const double build_seconds = chrono::duration<double>(chrono::steady_clock::now() - ts_build).count();
+
+        vector<float> p(domain.num_cells), wrk(domain.num_cells);
+        double seconds;
+        const float *result = timed([&]() {
+            himeno_domain_init(domain, p.data(), pool);
+            return jacobi_domain_update(domain, num_iterations-1, p.data(), wrk.data(), pool);
+        }, p.data(), wrk.data(), seconds);
+        const float gosa = jacobi_domain_gosa(domain, result, pool);
+        const double per_update = seconds / (num_iterations-1);
+
+        printf("%-9s %6.1f%% %9zu %9zu %10.2f %9.2f %10.3f %10.1f %8.2f %10.6f\n", name.c_str(), 100.0 * domain.num_cells / box_cells,
+            domain.num_runs, domain.segments.size(), build_seconds * 1.0e3, 2.0 * domain.num_cells * sizeof(float) / 1048576.0,
+            per_update * 1.0e3, domain.num_cells / per_update / 1.0e6, dense_per_update / per_update, gosa);
+
+        // the full box has the fields in the same order as the dense solver
+        if (name == "box" && default_boundaries) {
+            const bool same = memcmp(result, dense_result, box_cells * sizeof(float)) == 0;
+            printf("%-9s field %s jacobi_update(), gosa %.6f vs %.6f\n", "", same ? "matches" : "DIFFERS from", gosa, dense_gosa);
+            if (!same) return 1;
+        }
+        fflush(stdout);
+
+    }
+
+    return 0;
+
+}
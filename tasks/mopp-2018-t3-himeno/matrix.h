@@ -2,10 +2,10 @@
 #define __HEADER_MATRIX__
 
 #include "common.h"
+#include "../common/thread_pool.h"
 
 #include <cstring>
 #include <algorithm>
-#include <thread>
 
 #include <stdio.h>
 #include <assert.h>
@@ -23,10 +23,15 @@ class Matrix {
         const int m_uiRowMemoryOffset = 0;
 
         Matrix() {}
-        Matrix( int rows, int cols, int deps, uint num_threads );
+
+        /**
+         * @brief Creates a matrix on the given memory or allocates its own
+         * @param data rows*cols*deps values owned by the caller, nullptr to allocate them
+         */
+        Matrix( int rows, int cols, int deps, T *data = nullptr );
         ~Matrix();
 
-        void set_init();
+        void set_init( thread_pool_t &pool );
 
         /**
          * @brief Access the matrix at the given position
@@ -47,13 +52,9 @@ class Matrix {
 
     private:
 
-        const uint m_uiNumThreads = 0;
-        std::thread* const m_pThreads = nullptr;
-        int* const m_pWorking_ranges = nullptr;
+        const bool m_bOwnsData = false;
         const T m_uiRowsSquared = 0;
 
-        static void set_init_partial( Matrix<T> *m, int r_begin, int r_end );
-
 };
 
 #include "matrix.hpp"
@@ -0,0 +1,362 @@
+/*
+ * Roofline benchmark of the Himeno kernels
+ *
+ * Usage: ./roofline [--threads 1,2,4] [--grid quick|full] [--variants update-float,...] [--min-time seconds]
+ *
+ * Measures the ceilings of the host first:
+ *  - peak GFLOP/s with independent multiply-add chains on vectors, float and double
+ *  - triad bandwidth a[i] = b[i] + s*c[i] with the working set of every grid size, so a grid in
+ *    L1, L2, L3 or DRAM is compared with the bandwidth of that level
+ * Then runs the kernel variants over the grid sizes and thread counts and prints the achieved
+ * GFLOP/s and GB/s and how close they get to the roofline min(peak, AI * bandwidth).
+ *
+ * The traffic model counts every value once (the neighbors of a point are in the cache) plus the
+ * write allocate of stored values, the same way for the triad:
+ *  - update: 9 flops, reads p and writes wrk: 3 values per point
+ *  - gosa:   9 flops, reads p: 1 value per point
+ *  - triad:  2 flops, reads b and c and writes a: 4 values per element
+ */
+
+#include "himeno.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+// DEFINES
+#define FLOPS_PER_POINT 9.0
+#define PEAK_CHAINS 8
+#define OMEGA 0.8
+
+// TYPEDEFS
+typedef float float8_t __attribute__((vector_size(32)));
+typedef double double4_t __attribute__((vector_size(32)));
+
+struct variant_t {
+    string name;
+    bool is_double;
+    double values_per_point;    // memory traffic in values of the type
+    // runs the kernel num_calls times on the prepared fields
+    function<void( const vec3_uint_t&, uint, thread_pool_t& )> run;
+};
+
+struct grid_t {
+    uint rows, cols, deps;
+};
+
+// GLOBALS
+float *g_p_float = nullptr, *g_wrk_float = nullptr, *g_padded_p = nullptr, *g_padded_wrk = nullptr;
+double *g_p_double = nullptr, *g_wrk_double = nullptr;
+float g_gosa_float;
+double g_gosa_double;
+
+// FUNCTIONS
+
+static double now()
+{
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Best time per call: the kernel runs in batches of at least min_time, three batches
+ */
+static double time_per_call( const function<void( uint )> &run, double min_time )
+{
+    uint calls = 1u;
+    double elapsed;
+    while (true) {
+        const double start = now();
+        run(calls);
+        elapsed = now() - start;
+        if (elapsed >= min_time / 4.0 || calls >= (1u << 30)) break;
+        calls *= 2u;
+    }
+    calls = max(1u, (uint)(calls * min_time / max(elapsed, 1.0e-9)));
+    double best = 1.0e30;
+    for (int batch = 0; batch < 3; batch++) {
+        const double start = now();
+        run(calls);
+        best = min(best, (now() - start) / calls);
+    }
+    return best;
+}
+
+// independent multiply-add chains, the compiler keeps them in registers
+template<typename V, typename E>
+static V peak_chains( uint loops )
+{
+    const V zero = {};
+    const V mul = zero + (E)0.999999, add = zero + (E)0.000001;
+    V acc[PEAK_CHAINS];
+    for (int i = 0; i < PEAK_CHAINS; i++) acc[i] = zero + (E)(0.5 + i * 0.01);
+    for (uint l = 0u; l < loops; l++) {
+        for (int i = 0; i < PEAK_CHAINS; i++) acc[i] = acc[i] * mul + add;
+    }
+    for (int i = 1; i < PEAK_CHAINS; i++) acc[0] += acc[i];
+    return acc[0];
+}
+
+template<typename V, typename E>
+static double measure_peak( thread_pool_t &pool, double min_time )
+{
+    const uint loops = 1u << 16;
+    const double lanes = sizeof(V) / sizeof(E);
+    vector<V> sink(pool.size() * 2u);
+    const double seconds = time_per_call([&]( uint calls ) {
+        pool.run(pool.size(), [&]( uint t, uint ) {
+            for (uint c = 0u; c < calls; c++) sink[t*2u] += peak_chains<V, E>(loops);
+        });
+    }, min_time);
+    return pool.size() * loops * PEAK_CHAINS * 2.0 * lanes / seconds / 1.0e9;
+}
+
+/**
+ * @brief Triad bandwidth in GB/s with a working set of the given size
+ */
+static double measure_triad( size_t working_set, thread_pool_t &pool, double min_time )
+{
+    const size_t n = max<size_t>(working_set / (3u * sizeof(float)), 1024u);
+    float *a = new float[n], *b = new float[n], *c = new float[n];
+    const uint num_chunks = pool.size() * 8u;
+    const size_t chunk = (n + num_chunks - 1u) / num_chunks;
+
+    // every thread touches the chunks it works on later (first touch)
+    pool.run(num_chunks, [&]( uint k, uint ) {
+        const size_t begin = k * chunk, end = min(n, begin + chunk);
+        for (size_t i = begin; i < end; i++) {
+            a[i] = 0.0f;
+            b[i] = 1.0f;
+            c[i] = 2.0f;
+        }
+    });
+
+    const double seconds = time_per_call([&]( uint calls ) {
+        for (uint call = 0u; call < calls; call++) {
+            pool.run(num_chunks, [&]( uint k, uint ) {
+                const size_t begin = k * chunk, end = min(n, begin + chunk);
+                for (size_t i = begin; i < end; i++) a[i] = b[i] + 0.5f * c[i];
+            });
+        }
+    }, min_time);
+
+    delete[] a;
+    delete[] b;
+    delete[] c;
+    return 4.0 * sizeof(float) * n / seconds / 1.0e9;
+}
+
+static const char *cache_level( size_t working_set )
+{
+    const topology_t &topology = system_topology();
+    if (working_set <= (topology.l1d_size != 0u ? topology.l1d_size : 32768u)) return "L1";
+    if (working_set <= (topology.l2_size != 0u ? topology.l2_size : 1048576u)) return "L2";
+    if (working_set <= (topology.l3_size != 0u ? topology.l3_size : 8388608u)) return "L3";
+    return "DRAM";
+}
+
+// the update of calculate_row() on a field with its boundary, so the inner loop has no branches
+static void padded_update( const vec3_uint_t &size, float *p, float *wrk, thread_pool_t &pool )
+{
+    const uint cols = size.y, deps = size.z;
+    const size_t row_offset = (size_t)cols * deps;
+    pool.run(size.x - 2u, [&]( uint r, uint ) {
+        for (uint c = 1u; c < cols - 1u; c++) {
+            const float *ptr = p + (r + 1u) * row_offset + (size_t)c * deps;
+            const float *below = ptr - row_offset, *above = ptr + row_offset, *left = ptr - deps, *right = ptr + deps;
+            float *out = wrk + (r + 1u) * row_offset + (size_t)c * deps;
+            for (uint d = 1u; d < deps - 1u; d++) {
+                const float value = (
+                      above[d] + right[d] + ptr[d + 1u]
+                    + below[d] + left[d] + ptr[d - 1u]
+                ) / 6.0 - ptr[d];
+                out[d] = ptr[d] + OMEGA*value;
+            }
+        }
+    });
+}
+
+// copies the inner field into a padded one with the boundary values of Matrix::get()
+static void fill_padded( const vec3_uint_t &size, const float *inner, float *padded )
+{
+    const uint rows = size.x - 2u, cols = size.y - 2u, deps = size.z - 2u;
+    for (uint r = 0u; r < size.x; r++) {
+        const float boundary = r == 0u ? 0.0f : r == size.x - 1u ? 1.0f : (float)(r*r) / (float)((rows+1)*(rows+1));
+        for (uint c = 0u; c < size.y; c++) {
+            for (uint d = 0u; d < size.z; d++) {
+                const bool inside = r >= 1u && r <= rows && c >= 1u && c <= cols && d >= 1u && d <= deps;
+                padded[((size_t)r * size.y + c) * size.z + d] = inside ? inner[((size_t)(r-1u) * cols + (c-1u)) * deps + (d-1u)] : boundary;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Checks that the padded update computes exactly the values of jacobi_update()
+ */
+static bool padded_matches( const vec3_uint_t &size, uint num_updates, thread_pool_t &pool )
+{
+    const size_t points = himeno_field_size(size), padded_points = (size_t)size.x * size.y * size.z;
+    vector<float> p(points), wrk(points), padded_p(padded_points), padded_wrk(padded_points), check(padded_points);
+    himeno_init(size, p.data(), pool);
+    fill_padded(size, p.data(), padded_p.data());
+    fill_padded(size, p.data(), padded_wrk.data());
+    const float *result = jacobi_update(size, num_updates, p.data(), wrk.data(), pool);
+    for (uint n = 0u; n < num_updates; n++) {
+        padded_update(size, padded_p.data(), padded_wrk.data(), pool);
+        swap(padded_p, padded_wrk);
+    }
+    fill_padded(size, result, check.data());
+    return memcmp(check.data(), padded_p.data(), padded_points * sizeof(float)) == 0;
+}
+
+static vector<uint> parse_list( const string &text )
+{
+    vector<uint> list;
+    for (size_t begin = 0u, end; begin < text.size(); begin = end + 1u) {
+        end = text.find(',', begin);
+        if (end == string::npos) end = text.size();
+        list.push_back(strtoul(text.substr(begin, end - begin).c_str(), NULL, 10));
+    }
+    return list;
+}
+
+int main( int argc, char *argv[] ) {
+
+    const topology_t &topology = system_topology();
+    vector<uint> thread_counts;
+    string grid_name = "quick", variant_filter;
+    double min_time = 0.1;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--threads") == 0) thread_counts = parse_list(argv[i+1]);
+        else if (strcmp(argv[i], "--grid") == 0) grid_name = argv[i+1];
+        else if (strcmp(argv[i], "--variants") == 0) variant_filter = "," + string(argv[i+1]) + ",";
+        else if (strcmp(argv[i], "--min-time") == 0) min_time = atof(argv[i+1]);
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    // 1, 2, 4, ... physical cores, the kernel is bound by the bandwidth
+    if (thread_counts.empty()) {
+        const uint cores = topology.threads(THREADS_PHYSICAL_CORES);
+        for (uint t = 1u; t < cores; t *= 2u) thread_counts.push_back(t);
+        thread_counts.push_back(cores);
+    }
+
+    // from a working set in L1 to one far beyond the L3
+    vector<grid_t> grids = { {12, 12, 24}, {34, 34, 66}, {66, 66, 130}, {130, 130, 258} };
+    if (grid_name == "full") grids = { {12, 12, 24}, {18, 18, 34}, {34, 34, 66}, {66, 66, 130}, {98, 98, 194}, {130, 130, 258}, {258, 258, 514} };
+
+    vector<variant_t> variants = {
+        { "update-float", false, 3.0, []( const vec3_uint_t &size, uint calls, thread_pool_t &pool ) {
+            float *p = g_p_float, *wrk = g_wrk_float;
+            p = jacobi_update(size, calls, p, wrk, pool);
+            if (p != g_p_float) swap(g_p_float, g_wrk_float);
+        } },
+        { "update-double", true, 3.0, []( const vec3_uint_t &size, uint calls, thread_pool_t &pool ) {
+            double *p = g_p_double, *wrk = g_wrk_double;
+            p = jacobi_update(size, calls, p, wrk, pool);
+            if (p != g_p_double) swap(g_p_double, g_wrk_double);
+        } },
+        { "gosa-float", false, 1.0, []( const vec3_uint_t &size, uint calls, thread_pool_t &pool ) {
+            for (uint c = 0u; c < calls; c++) g_gosa_float += jacobi_gosa(size, g_p_float, pool);
+        } },
+        { "gosa-double", true, 1.0, []( const vec3_uint_t &size, uint calls, thread_pool_t &pool ) {
+            for (uint c = 0u; c < calls; c++) g_gosa_double += jacobi_gosa(size, g_p_double, pool);
+        } },
+        { "padded-float", false, 3.0, []( const vec3_uint_t &size, uint calls, thread_pool_t &pool ) {
+            for (uint c = 0u; c < calls; c++) {
+                padded_update(size, g_padded_p, g_padded_wrk, pool);
+                swap(g_padded_p, g_padded_wrk);
+            }
+        } },
+    };
+
+    // the ceilings
+    printf("Topology: %s\n\n", describe_topology(topology).c_str());
+    {
+        thread_pool_t pool(1u);
+        if (!padded_matches(vec3_uint_t(12, 14, 18), 3u, pool)) fprintf(stderr, "Warning: padded-float differs from update-float\n");
+    }
+    map<uint, pair<double, double>> peaks;
+    printf("%7s %14s %14s\n", "threads", "peak_f32_gfs", "peak_f64_gfs");
+    for (uint threads : thread_counts) {
+        thread_pool_t pool(threads, topology.thread_cpus(threads));
+        peaks[threads] = { measure_peak<float8_t, float>(pool, min_time), measure_peak<double4_t, double>(pool, min_time) };
+        printf("%7u %14.2f %14.2f\n", threads, peaks[threads].first, peaks[threads].second);
+    }
+    printf("\n");
+
+    printf("%-13s %-12s %9s %-5s %7s %10s %9s %8s %6s %9s %9s %7s\n", "variant", "grid", "ws_kib", "level", "threads",
+        "ms_per_it", "gflop_s", "gb_s", "ai", "triad_gbs", "roof_gfs", "%roof");
+    for (const grid_t &grid : grids) {
+
+        const vec3_uint_t size(grid.rows, grid.cols, grid.deps);
+        const size_t points = himeno_field_size(size);
+        const size_t padded_points = (size_t)grid.rows * grid.cols * grid.deps;
+        char grid_text[32];
+        snprintf(grid_text, sizeof(grid_text), "%ux%ux%u", grid.rows, grid.cols, grid.deps);
+
+        for (uint threads : thread_counts) {
+
+            thread_pool_t pool(threads, topology.thread_cpus(threads));
+            g_p_float = new float[points];
+            g_wrk_float = new float[points];
+            g_p_double = new double[points];
+            g_wrk_double = new double[points];
+            g_padded_p = new float[padded_points];
+            g_padded_wrk = new float[padded_points];
+            himeno_init(size, g_p_float, pool);
+            himeno_init(size, g_wrk_float, pool);
+            himeno_init(size, g_p_double, pool);
+            himeno_init(size, g_wrk_double, pool);
+            fill_padded(size, g_p_float, g_padded_p);
+            fill_padded(size, g_p_float, g_padded_wrk);
+
+            // the bandwidth of the level the two float fields are in, double fields are twice as large
+            map<size_t, double> triad;
+            for (const variant_t &variant : variants) {
+
+                if (!variant_filter.empty() && variant_filter.find("," + variant.name + ",") == string::npos) continue;
+                const size_t value_size = variant.is_double ? sizeof(double) : sizeof(float);
+                const size_t working_set = 2u * points * value_size;
+                if (triad.find(working_set) == triad.end()) triad[working_set] = measure_triad(working_set, pool, min_time);
+
+                const double seconds = time_per_call([&]( uint calls ) { variant.run(size, calls, pool); }, min_time);
+                const double gflops = points * FLOPS_PER_POINT / seconds / 1.0e9;
+                const double gbs = points * variant.values_per_point * value_size / seconds / 1.0e9;
+                const double ai = FLOPS_PER_POINT / (variant.values_per_point * value_size);
+                const double peak = variant.is_double ? peaks[threads].second : peaks[threads].first;
+                const double roof = min(peak, ai * triad[working_set]);
+                printf("%-13s %-12s %9zu %-5s %7u %10.3f %9.2f %8.2f %6.3f %9.2f %9.2f %6.1f%%\n", variant.name.c_str(), grid_text,
+                    working_set >> 10, cache_level(working_set), threads, seconds * 1.0e3, gflops, gbs, ai, triad[working_set], roof, gflops * 100.0 / roof);
+                fflush(stdout);
+
+            }
+
+            delete[] g_p_float;
+            delete[] g_wrk_float;
+            delete[] g_p_double;
+            delete[] g_wrk_double;
+            delete[] g_padded_p;
+            delete[] g_padded_wrk;
+
+        }
+    }
+
+    // keeps the results alive
+    if (g_gosa_float == 12345.0f || g_gosa_double == 12345.0) printf("\n");
+    return 0;
+
+}